@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += widgets sql
+QT       += widgets sql concurrent
 
 TARGET = CommonUtil
 TEMPLATE = lib
@@ -25,13 +25,19 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
     settings.cpp \
     util.cpp \
-    database.cpp
+    database.cpp \
+    thumbnailcache.cpp \
+    thumbnailpack.cpp \
+    mediahash.cpp
 
 HEADERS += \
         commonutil_global.h \ 
     settings.h \
     util.h \
     database.h \
+    thumbnailcache.h \
+    thumbnailpack.h \
+    mediahash.h \
     shotcut_mlt_properties.h
 
 INCLUDEPATH = ../CuteLogger/include
@@ -20,42 +20,89 @@
  */
 
 #include "database.h"
+#include "thumbnailcache.h"
+#include "thumbnailpack.h"
 //#include "models/playlistmodel.h"
 //#include "mainwindow.h"
 #include <QtSql>
+#include <QtConcurrent>
 #include <QStandardPaths>
+#include <QThreadStorage>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
 #include <QDir>
 #include <Logger.h>
 
-#pragma pack(2)
-/*
- * 消除警告：warning: padding struct 'DatabaseJob' with 4 bytes to align 'image'
- * 消除警告：warning: padding size of 'DatabaseJob' with 6 bytes to alignment boundary
- * 由于系统目前的对齐模数是8个字节（#pragma pack(show) == 8），成员中有两个连续的bool变量，占两个字节，因此需要填充6个字节，因此出现此警告
- * 将对齐改为2字节对齐，正好不用填充
-*/
-struct DatabaseJob {
-    enum Type {
-        PutThumbnail,
-        GetThumbnail
-    } type;
-
-    QImage image;
-    QString hash;
-    bool result;
-    bool completed;
-    DatabaseJob()
-        : result(false)
-        , completed(false)
-    {}
-};
-#pragma pack()
+// The disk space of the thumbnail pack.
+static const qint64 kPackBudget = 512 * 1024 * 1024;
+// Old thumbnails moved into the pack per step while idle.
+static const int kMigrationBatch = 50;
+// SQLite allows 999 bound parameters per statement.
+static const int kMaxBindValues = 500;
 
 static Database* instance = nullptr;
 
+// A read-only connection owned by one thread and closed when it finishes.
+class ReaderConnection
+{
+public:
+    explicit ReaderConnection(const QString& path)
+    {
+        static QAtomicInt counter;
+        m_name = QString("thumbnail-reader-%1").arg(counter.fetchAndAddOrdered(1));
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", m_name);
+        db.setDatabaseName(path);
+        db.setConnectOptions("QSQLITE_OPEN_READONLY;QSQLITE_BUSY_TIMEOUT=2000");
+        if (!db.open())
+            LOG_ERROR() << db.lastError();
+    }
+
+    ~ReaderConnection()
+    {
+        {
+            QSqlDatabase db = QSqlDatabase::database(m_name, false);
+            db.close();
+        }
+        QSqlDatabase::removeDatabase(m_name);
+    }
+
+    QSqlDatabase database() const
+    {
+        return QSqlDatabase::database(m_name, false);
+    }
+
+private:
+    QString m_name;
+};
+
+static QThreadStorage<ReaderConnection*> readerConnections;
+
+static QString placeholders(int count)
+{
+    QStringList result;
+    for (int i = 0; i < count; ++i)
+        result << "?";
+    return result.join(',');
+}
+
 Database::Database(QObject *parent) :
     QThread(parent)
-    , m_commitTimer(nullptr)
+    , m_ready(false)
+    , m_shutdown(false)
+    , m_legacy(false)
+{
+    QDir dir(QStandardPaths::standardLocations(QStandardPaths::DataLocation).first());
+    if (!dir.exists())
+        dir.mkpath(dir.path());
+    m_path = dir.filePath("db.sqlite3");
+    m_pack.reset(new ThumbnailPack(dir, kPackBudget));
+
+    m_readers.setMaxThreadCount(qBound(2, QThread::idealThreadCount() / 2, 4));
+    // Keep the threads, and with them their connections, for the whole session.
+    m_readers.setExpiryTimeout(-1);
+}
+
+Database::~Database()
 {
 }
 
@@ -82,91 +129,228 @@ bool Database::upgradeVersion1()
     return success;
 }
 
-void Database::doJob(DatabaseJob * job)
+void Database::waitUntilReady()
 {
-    Q_ASSERT(job);
-    Q_ASSERT(m_commitTimer);
-    if (!m_commitTimer->isActive())
-        QSqlDatabase::database().transaction();
-    m_commitTimer->start();
+    QMutexLocker locker(&m_mutex);
+    while (!m_ready)
+        m_waitForReady.wait(&m_mutex);
+}
 
-    if (job->type == DatabaseJob::PutThumbnail) {
-        QByteArray ba;
-        QBuffer buffer(&ba);
-        buffer.open(QIODevice::WriteOnly);
-        job->image.save(&buffer, "PNG");
+QHash<QString, QImage> Database::readThumbnails(const QStringList& hashes)
+{
+    QHash<QString, QImage> result;
+    QStringList missing;
+    m_gets.fetchAndAddRelaxed(hashes.size());
 
-        QSqlQuery query;
-        query.prepare("DELETE FROM thumbnails WHERE hash = :hash;");
-        query.bindValue(":hash", job->hash);
-        query.exec();
-        query.prepare("INSERT INTO thumbnails VALUES (:hash, datetime('now'), :image);");
-        query.bindValue(":hash", job->hash);
-        query.bindValue(":image", ba);
-        job->result = query.exec();
-        if (!job->result)
+    ThumbnailCache& cache = ThumbnailCache::singleton();
+    foreach (const QString& hash, hashes) {
+        QImage image = cache.find(hash);
+        if (image.isNull())
+            missing << hash;
+        else
+            result.insert(hash, image);
+    }
+    if (missing.isEmpty()) {
+        m_hits.fetchAndAddRelaxed(result.size());
+        return result;
+    }
+    waitUntilReady();
+
+    m_mutex.lock();
+    bool legacy = m_legacy;
+    QStringList remaining;
+    foreach (const QString& hash, missing) {
+        if (m_uncommitted.contains(hash))
+            result.insert(hash, m_uncommitted.value(hash));
+        else
+            remaining << hash;
+    }
+    m_mutex.unlock();
+
+    missing.clear();
+    foreach (const QString& hash, remaining) {
+        QImage image = m_pack->find(hash);
+        if (image.isNull()) {
+            missing << hash;
+        } else {
+            result.insert(hash, image);
+            cache.insert(hash, image);
+        }
+    }
+    if (legacy && !missing.isEmpty())
+        readLegacyThumbnails(missing, result);
+    m_hits.fetchAndAddRelaxed(result.size());
+    return result;
+}
+
+void Database::readLegacyThumbnails(const QStringList& hashes, QHash<QString, QImage>& result)
+{
+    if (!readerConnections.hasLocalData())
+        readerConnections.setLocalData(new ReaderConnection(m_path));
+    QSqlDatabase db = readerConnections.localData()->database();
+    QHash<QString, QImage> found;
+    for (int i = 0; i < hashes.size(); i += kMaxBindValues) {
+        QStringList chunk = hashes.mid(i, kMaxBindValues);
+        QSqlQuery query(db);
+        query.prepare(QString("SELECT hash, image FROM thumbnails WHERE hash IN (%1);")
+                      .arg(placeholders(chunk.size())));
+        foreach (const QString& hash, chunk)
+            query.addBindValue(hash);
+        if (!query.exec()) {
             LOG_ERROR() << query.lastError();
-    } else if (job->type == DatabaseJob::GetThumbnail) {
-        QImage result;
-        QSqlQuery query;
-        query.prepare("SELECT image FROM thumbnails WHERE hash = :hash;");
-        query.bindValue(":hash", job->hash);
-        if (query.exec() && query.first()) {
-            result.loadFromData(query.value(0).toByteArray(), "PNG");
-            QSqlQuery update;
-            update.prepare("UPDATE thumbnails SET accessed = datetime('now') WHERE hash = :hash ;");
-            update.bindValue(":hash", job->hash);
-            if (!update.exec())
-                LOG_ERROR() << update.lastError();
+            continue;
         }
-        job->image = result;
+        while (query.next()) {
+            QImage image;
+            image.loadFromData(query.value(1).toByteArray(), "PNG");
+            found.insert(query.value(0).toString(), image);
+        }
+    }
+    if (found.isEmpty())
+        return;
+
+    // Move them into the pack.
+    QMutexLocker locker(&m_mutex);
+    QHash<QString, QImage>::const_iterator i = found.constBegin();
+    for (; i != found.constEnd(); ++i) {
+        result.insert(i.key(), i.value());
+        ThumbnailCache::singleton().insert(i.key(), i.value());
+        if (m_shutdown || m_uncommitted.contains(i.key()))
+            continue;
+        m_puts.append(qMakePair(i.key(), i.value()));
+        m_uncommitted.insert(i.key(), i.value());
+        m_migrated << i.key();
     }
-    deleteOldThumbnails();
-    job->completed = true;
+    m_waitForNewJob.wakeAll();
 }
 
-void Database::commitTransaction()
+QImage Database::getThumbnail(const QString &hash)
 {
-    QSqlDatabase::database().commit();
+    return readThumbnails(QStringList() << hash).value(hash);
+}
+
+QHash<QString, QImage> Database::getThumbnails(const QStringList& hashes)
+{
+    return readThumbnails(hashes);
+}
+
+QFuture<QImage> Database::getThumbnailAsync(const QString& hash)
+{
+    return QtConcurrent::run(&m_readers, [this, hash]() {
+        return getThumbnail(hash);
+    });
+}
+
+QFuture< QHash<QString, QImage> > Database::getThumbnailsAsync(const QStringList& hashes)
+{
+    return QtConcurrent::run(&m_readers, [this, hashes]() {
+        return readThumbnails(hashes);
+    });
 }
 
 bool Database::putThumbnail(const QString& hash, const QImage& image)
 {
-    DatabaseJob job;
-    job.type = DatabaseJob::PutThumbnail;
-    job.hash = hash;
-    job.image = image;
-    submitAndWaitForJob(&job);
-    return job.result;
+    QHash<QString, QImage> images;
+    images.insert(hash, image);
+    return putThumbnails(images);
 }
 
-void Database::submitAndWaitForJob(DatabaseJob * job)
+bool Database::putThumbnails(const QHash<QString, QImage>& images)
 {
-    Q_ASSERT(job);
-    job->completed = false;
-    m_mutex.lock();
-    m_jobs.append(job);
-    if (m_jobs.size() == 1) {
-        //worker was idle until now
-        m_waitForNewJob.wakeAll();
+    QMutexLocker locker(&m_mutex);
+    if (m_shutdown)
+        return false;
+    QHash<QString, QImage>::const_iterator i = images.constBegin();
+    for (; i != images.constEnd(); ++i) {
+        m_puts.append(qMakePair(i.key(), i.value()));
+        m_uncommitted.insert(i.key(), i.value());
+        ThumbnailCache::singleton().insert(i.key(), i.value());
+    }
+    m_putCount.fetchAndAddRelaxed(images.size());
+    m_waitForNewJob.wakeAll();
+    return true;
+}
+
+void Database::writeThumbnails(const QList< QPair<QString, QImage> >& images)
+{
+    QList<qint64> written;
+    for (int i = 0; i < images.size(); ++i) {
+        if (!m_pack->insert(images[i].first, images[i].second))
+            LOG_WARNING() << "failed to store thumbnail" << images[i].first;
+        written << images[i].second.cacheKey();
     }
-    while (!job->completed) {
-        m_waitForFinished.wait(&m_mutex);
+
+    // The pack serves them now. Keep any that were replaced by a newer put
+    // in the meantime.
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < images.size(); ++i) {
+        const QString& hash = images[i].first;
+        if (m_uncommitted.value(hash).cacheKey() == written[i])
+            m_uncommitted.remove(hash);
     }
-    m_mutex.unlock();
 }
 
-QImage Database::getThumbnail(const QString &hash)
+void Database::deleteLegacyThumbnails(const QStringList& hashes)
 {
-    DatabaseJob job;
-    job.type = DatabaseJob::GetThumbnail;
-    job.hash = hash;
-    submitAndWaitForJob(&job);
-    return job.image;
+    QSqlDatabase::database().transaction();
+    for (int i = 0; i < hashes.size(); i += kMaxBindValues) {
+        QStringList chunk = hashes.mid(i, kMaxBindValues);
+        QSqlQuery query;
+        query.prepare(QString("DELETE FROM thumbnails WHERE hash IN (%1);")
+                      .arg(placeholders(chunk.size())));
+        foreach (const QString& hash, chunk)
+            query.addBindValue(hash);
+        if (!query.exec())
+            LOG_ERROR() << query.lastError();
+    }
+    QSqlDatabase::database().commit();
+}
+
+void Database::migrateLegacyThumbnails()
+{
+    QSqlQuery query;
+    query.prepare("SELECT hash, image FROM thumbnails LIMIT :count;");
+    query.bindValue(":count", kMigrationBatch);
+    if (!query.exec()) {
+        LOG_ERROR() << query.lastError();
+        QMutexLocker locker(&m_mutex);
+        m_legacy = false;
+        return;
+    }
+    QStringList hashes;
+    while (query.next()) {
+        QString hash = query.value(0).toString();
+        // A newer thumbnail may have been stored since.
+        if (!m_pack->contains(hash)) {
+            QImage image;
+            image.loadFromData(query.value(1).toByteArray(), "PNG");
+            if (!image.isNull())
+                m_pack->insert(hash, image);
+        }
+        hashes << hash;
+    }
+    query.finish();
+
+    if (!hashes.isEmpty()) {
+        deleteLegacyThumbnails(hashes);
+        return;
+    }
+    if (!query.exec("UPDATE version SET version = 2;"))
+        LOG_ERROR() << query.lastError();
+    query.exec("VACUUM;");
+    LOG_INFO() << "thumbnails moved to the pack";
+    QMutexLocker locker(&m_mutex);
+    m_legacy = false;
 }
 
 void Database::shutdown()
 {
+    m_mutex.lock();
+    m_shutdown = true;
+    m_waitForNewJob.wakeAll();
+    m_mutex.unlock();
+    m_readers.waitForDone();
+
     requestInterruption();
     wait();
     QString connection = QSqlDatabase::database().connectionName();
@@ -175,12 +359,20 @@ void Database::shutdown()
     instance = nullptr;
 }
 
-void Database::deleteOldThumbnails()
+Database::Stats Database::stats() const
 {
-    QSqlQuery query;
-    // OFFSET is the numner of thumbnails to cache.
-    if (!query.exec("DELETE FROM thumbnails WHERE hash IN (SELECT hash FROM thumbnails ORDER BY accessed DESC LIMIT -1 OFFSET 10000);"))
-        LOG_ERROR() << query.lastError();
+    Stats result;
+    result.gets = m_gets.load();
+    result.hits = m_hits.load();
+    result.puts = m_putCount.load();
+    return result;
+}
+
+void Database::resetStats()
+{
+    m_gets.store(0);
+    m_hits.store(0);
+    m_putCount.store(0);
 }
 
 void Database::run()
@@ -188,24 +380,18 @@ void Database::run()
 //    connect(&MAIN, SIGNAL(aboutToShutDown()),
 //            this, SLOT(shutdown()), Qt::DirectConnection);
 
-    QDir dir(QStandardPaths::standardLocations(QStandardPaths::DataLocation).first());
-    if (!dir.exists())
-        dir.mkpath(dir.path());
-
     QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
-    db.setDatabaseName(dir.filePath("db.sqlite3"));
+    db.setDatabaseName(m_path);
     db.open();
 
-    m_commitTimer = new QTimer();
-    Q_ASSERT(m_commitTimer);
-    m_commitTimer->setSingleShot(true);
-    m_commitTimer->setInterval(5000);
-    connect(m_commitTimer, SIGNAL(timeout()),
-            this, SLOT(commitTransaction()));
+    // WAL lets the reader connections run while this thread writes.
+    QSqlQuery query;
+    if (!query.exec("PRAGMA journal_mode = WAL;"))
+        LOG_ERROR() << query.lastError();
+    query.exec("PRAGMA synchronous = NORMAL;");
 
     // Initialize version table, if needed.
     int version = 0;
-    QSqlQuery query;
     if (query.exec("CREATE TABLE version (version INTEGER);")) {
         if (!query.exec("INSERT INTO version VALUES (0);"))
             LOG_ERROR() << "Failed to create version table.";
@@ -218,25 +404,135 @@ void Database::run()
     if (version < 1 && upgradeVersion1())
         version = 1;
     LOG_DEBUG() << "Database version is" << version;
+    m_pack->open();
+
+    m_mutex.lock();
+    m_legacy = version < 2;
+    m_ready = true;
+    m_waitForReady.wakeAll();
+    m_mutex.unlock();
 
     while (true) {
-        DatabaseJob * newJob = nullptr;
+        QList< QPair<QString, QImage> > puts;
+        QStringList migrated;
         m_mutex.lock();
-        if (m_jobs.isEmpty())
-            m_waitForNewJob.wait(&m_mutex, 1000);
-        else
-            newJob = m_jobs.takeFirst();
+        // Keep moving old thumbnails while there is nothing else to do.
+        if (m_puts.isEmpty() && !m_shutdown)
+            m_waitForNewJob.wait(&m_mutex, m_legacy? 50 : 1000);
+        puts.swap(m_puts);
+        migrated.swap(m_migrated);
+        bool legacy = m_legacy && !m_shutdown;
         m_mutex.unlock();
-        QCoreApplication::processEvents();
-        if (newJob) {
-            doJob(newJob);
-            m_waitForFinished.wakeAll();
-        }
+        if (!puts.isEmpty())
+            writeThumbnails(puts);
+        if (!migrated.isEmpty())
+            deleteLegacyThumbnails(migrated);
+        else if (legacy && puts.isEmpty())
+            migrateLegacyThumbnails();
         if (isInterruptionRequested())
             break;
     }
-    if (m_commitTimer->isActive())
-        commitTransaction();
-    delete m_commitTimer;
+    // Puts queued before shutdown() are still written.
+    m_mutex.lock();
+    QList< QPair<QString, QImage> > puts;
+    QStringList migrated;
+    puts.swap(m_puts);
+    migrated.swap(m_migrated);
+    m_mutex.unlock();
+    if (!puts.isEmpty())
+        writeThumbnails(puts);
+    if (!migrated.isEmpty())
+        deleteLegacyThumbnails(migrated);
+    m_pack->flush();
+}
+
+static QImage benchmarkImage(int i)
+{
+    // Smooth with some noise, which compresses about like a video frame.
+    QImage image(160, 90, QImage::Format_ARGB32);
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            int noise = (x * 7919 + y * 104729 + i * 31) % 23;
+            line[x] = qRgb((x + i) % 256, (y * 2 + i) % 256, (x + y + noise) % 256);
+        }
+    }
+    return image;
 }
 
+void Database::benchmark(int count)
+{
+    QTemporaryDir dir;
+    if (!dir.isValid())
+        return;
+    QList<QImage> images;
+    for (int i = 0; i < count; ++i)
+        images << benchmarkImage(i);
+    QElapsedTimer timer;
+    qint64 sqliteWrite, sqliteRead, packWrite, packRead;
+    qint64 sqliteSize, packSize;
+
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "benchmark");
+        db.setDatabaseName(QDir(dir.path()).filePath("db.sqlite3"));
+        db.open();
+        QSqlQuery query(db);
+        query.exec("PRAGMA journal_mode = WAL;");
+        query.exec("CREATE TABLE thumbnails (hash TEXT PRIMARY KEY NOT NULL, accessed DATETIME NOT NULL, image BLOB);");
+
+        timer.start();
+        db.transaction();
+        query.prepare("INSERT OR REPLACE INTO thumbnails VALUES (:hash, datetime('now'), :image);");
+        for (int i = 0; i < count; ++i) {
+            QByteArray ba;
+            QBuffer buffer(&ba);
+            buffer.open(QIODevice::WriteOnly);
+            images[i].save(&buffer, "PNG");
+            query.bindValue(":hash", QString::number(i));
+            query.bindValue(":image", ba);
+            query.exec();
+        }
+        db.commit();
+        sqliteWrite = timer.restart();
+
+        query.prepare("SELECT image FROM thumbnails WHERE hash = :hash;");
+        for (int i = 0; i < count; ++i) {
+            query.bindValue(":hash", QString::number(i));
+            QImage image;
+            if (query.exec() && query.first())
+                image.loadFromData(query.value(0).toByteArray(), "PNG");
+        }
+        sqliteRead = timer.elapsed();
+        query.finish();
+        db.close();
+        sqliteSize = QFileInfo(db.databaseName()).size() + QFileInfo(db.databaseName() + "-wal").size();
+    }
+    QSqlDatabase::removeDatabase("benchmark");
+
+    {
+        ThumbnailPack pack(QDir(dir.path()), kPackBudget);
+        pack.open();
+        timer.start();
+        for (int i = 0; i < count; ++i)
+            pack.insert(QString::number(i), images[i]);
+        pack.flush();
+        packWrite = timer.restart();
+
+        quint32 sum = 0;
+        for (int i = 0; i < count; ++i) {
+            QImage image = pack.find(QString::number(i));
+            // Touch the pixels as a consumer would.
+            if (!image.isNull())
+                sum += image.constScanLine(image.height() - 1)[0];
+        }
+        packRead = timer.elapsed();
+        packSize = pack.size();
+        Q_UNUSED(sum)
+    }
+
+    LOG_INFO() << "thumbnail store benchmark with" << count << "thumbnails of 160x90";
+    LOG_INFO() << "PNG in SQLite: write" << sqliteWrite << "ms, read" << sqliteRead << "ms,"
+               << sqliteSize / 1024 << "KiB";
+    LOG_INFO() << "pack:          write" << packWrite << "ms, read" << packRead << "ms,"
+               << packSize / 1024 << "KiB";
+}
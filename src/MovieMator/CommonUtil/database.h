@@ -25,42 +25,99 @@
 #include "commonutil_global.h"
 
 #include <QThread>
+#include <QThreadPool>
 #include <QImage>
 #include <QMutex>
 #include <QWaitCondition>
+#include <QFuture>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QStringList>
+#include <QAtomicInt>
+#include <QScopedPointer>
 
-struct DatabaseJob;
-class QTimer;
+class ThumbnailPack;
+
+/*!
+  \class Database
+  \brief The thumbnail store.
+
+  Thumbnails are kept uncompressed in a memory-mapped ThumbnailPack, so
+  reading one costs no decoding. Writes are queued to the database thread;
+  until a write is done it is served from memory, so a read right after a
+  put always sees the new image. Reads run on the calling thread and
+  concurrently with each other and with the writer; the asynchronous
+  variants run on a small pool of reader threads. Decoded images are kept
+  in ThumbnailCache, which is checked first.
+
+  The SQLite database in WAL mode holds the schema version and, from older
+  versions, PNG thumbnails. Those are moved into the pack when they are read
+  and in the background while the writer is idle.
+
+  \threadsafe
+*/
 class COMMONUTILSHARED_EXPORT Database : public QThread
 {
     Q_OBJECT
     explicit Database(QObject *parent = nullptr);
 
 public:
+    struct Stats {
+        int gets;       // thumbnails requested
+        int hits;       // requests found in the store
+        int puts;       // thumbnails stored
+    };
+
     static Database& singleton(QWidget* parent = nullptr);
+    ~Database();
 
     bool upgradeVersion1();
+    // Queue a thumbnail to be stored; returns false once shut down.
     bool putThumbnail(const QString& hash, const QImage& image);
+    bool putThumbnails(const QHash<QString, QImage>& images);
+    // Read on the calling thread.
     QImage getThumbnail(const QString& hash);
+    QHash<QString, QImage> getThumbnails(const QStringList& hashes);
+    // Read on the reader pool.
+    QFuture<QImage> getThumbnailAsync(const QString& hash);
+    QFuture< QHash<QString, QImage> > getThumbnailsAsync(const QStringList& hashes);
     void shutdown();
 
-private slots:
-    void commitTransaction();
+    Stats stats() const;
+    void resetStats();
+
+    // Log the write and read speed of the pack against PNG in SQLite.
+    static void benchmark(int count);
 
 //private slots:
 //    void shutdown();
 
 private:
-    void doJob(DatabaseJob * job);
-    void submitAndWaitForJob(DatabaseJob * job);
-    void deleteOldThumbnails();
+    void waitUntilReady();
+    QHash<QString, QImage> readThumbnails(const QStringList& hashes);
+    void readLegacyThumbnails(const QStringList& hashes, QHash<QString, QImage>& result);
+    void writeThumbnails(const QList< QPair<QString, QImage> >& images);
+    void deleteLegacyThumbnails(const QStringList& hashes);
+    void migrateLegacyThumbnails();
     void run();
 
-    QList<DatabaseJob*> m_jobs;
-    QMutex m_mutex;
-    QWaitCondition m_waitForFinished;
+    QString m_path;
+    QThreadPool m_readers;
+    QScopedPointer<ThumbnailPack> m_pack;
+    mutable QMutex m_mutex;     // guards the members below
     QWaitCondition m_waitForNewJob;
-    QTimer * m_commitTimer;
+    QWaitCondition m_waitForReady;
+    bool m_ready;
+    bool m_shutdown;
+    bool m_legacy;              // the SQLite table still has thumbnails
+    QList< QPair<QString, QImage> > m_puts;
+    QHash<QString, QImage> m_uncommitted;
+    QStringList m_migrated;
+
+    QAtomicInt m_gets;
+    QAtomicInt m_hits;
+    QAtomicInt m_putCount;
 };
 
 #define DB Database::singleton()
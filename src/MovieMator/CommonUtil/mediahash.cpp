@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mediahash.h"
+#include "settings.h"
+#include "util.h"
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtConcurrent>
+#include <Logger.h>
+#include <algorithm>
+#ifndef Q_OS_WIN
+#include <sys/stat.h>
+#endif
+
+static const quint32 kFileMagic = 0x4d4d4848; // "MMHH"
+static const qint32 kFileVersion = 1;
+// Files remembered; the least recently used are forgotten first.
+static const int kMaxEntries = 20000;
+// Both ends of larger files are hashed, as in Util::getFileHash().
+static const qint64 kSampleSize = 1000000;
+
+MediaHash& MediaHash::singleton()
+{
+    static MediaHash* instance = new MediaHash;
+    return *instance;
+}
+
+MediaHash::MediaHash()
+    : QObject()
+    , m_dirty(false)
+    , m_saveTimer(this)
+{
+    // Mostly waiting on storage; more threads would only compete for it.
+    m_pool.setMaxThreadCount(2);
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(2000);
+    connect(&m_saveTimer, SIGNAL(timeout()), this, SLOT(save()));
+    if (QCoreApplication::instance()) {
+        moveToThread(QCoreApplication::instance()->thread());
+        connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), this, SLOT(save()));
+    }
+    load();
+}
+
+MediaHash::~MediaHash()
+{
+    m_pool.waitForDone();
+    save();
+}
+
+bool MediaHash::identify(const QString& path, QString* canonical, Entry* entry)
+{
+    QFileInfo info(path);
+    if (path.isEmpty() || !info.isFile())
+        return false;
+    *canonical = info.canonicalFilePath();
+    entry->size = info.size();
+    entry->modified = info.lastModified().toMSecsSinceEpoch();
+    entry->inode = 0;
+#ifndef Q_OS_WIN
+    struct stat st;
+    if (::stat(QFile::encodeName(*canonical).constData(), &st) == 0)
+        entry->inode = quint64(st.st_ino);
+#endif
+    entry->used = QDateTime::currentMSecsSinceEpoch() / 1000;
+    return true;
+}
+
+QString MediaHash::lookup(const QString& path, Algorithm algorithm, QString* canonical, Entry* identity)
+{
+    if (!identify(path, canonical, identity))
+        return QString();
+    QMutexLocker locker(&m_mutex);
+    QHash<QString, Entry>::iterator i = m_entries.find(*canonical);
+    if (i == m_entries.end())
+        return QString();
+    bool fast = i->hash.size() == 16;
+    if (i->size != identity->size || i->modified != identity->modified
+            || i->inode != identity->inode || fast != (algorithm == Fast))
+        return QString();
+    i->used = identity->used;
+    return i->hash;
+}
+
+void MediaHash::remember(const QString& canonical, Entry entry)
+{
+    QMutexLocker locker(&m_mutex);
+    m_entries.insert(canonical, entry);
+    m_dirty = true;
+    // The timer belongs to the main thread.
+    QMetaObject::invokeMethod(&m_saveTimer, "start", Qt::QueuedConnection);
+}
+
+QString MediaHash::cached(const QString& path)
+{
+    QString canonical;
+    Entry identity;
+    return lookup(path, Settings.mediaFastHash()? Fast : Md5, &canonical, &identity);
+}
+
+QString MediaHash::hash(const QString& path)
+{
+    Algorithm algorithm = Settings.mediaFastHash()? Fast : Md5;
+    QString canonical;
+    Entry identity;
+    QString result = lookup(path, algorithm, &canonical, &identity);
+    if (result.isEmpty() && !canonical.isEmpty()) {
+        result = compute(canonical, algorithm);
+        if (!result.isEmpty()) {
+            identity.hash = result;
+            remember(canonical, identity);
+        }
+    }
+    return result;
+}
+
+void MediaHash::hashAsync(const QString& path)
+{
+    QString result = cached(path);
+    if (!result.isEmpty()) {
+        // Never call back into the requester from within its request.
+        QMetaObject::invokeMethod(this, "hashReady", Qt::QueuedConnection,
+                                  Q_ARG(QString, path), Q_ARG(QString, result));
+        return;
+    }
+    m_mutex.lock();
+    bool pending = m_pending.contains(path);
+    m_pending.insert(path);
+    m_mutex.unlock();
+    if (pending)
+        return;
+
+    QtConcurrent::run(&m_pool, [this, path]() {
+        QString result = hash(path);
+        m_mutex.lock();
+        m_pending.remove(path);
+        m_mutex.unlock();
+        if (!result.isEmpty())
+            emit hashReady(path, result);
+    });
+}
+
+bool MediaHash::matches(const QString& path, const QString& hash)
+{
+    if (hash.isEmpty())
+        return false;
+    Algorithm algorithm = hash.size() == 16? Fast : Md5;
+    QString canonical;
+    Entry identity;
+    QString result = lookup(path, algorithm, &canonical, &identity);
+    if (result.isEmpty() && !canonical.isEmpty())
+        result = compute(canonical, algorithm);
+    return result == hash;
+}
+
+QString MediaHash::compute(const QString& path, Algorithm algorithm)
+{
+    if (algorithm == Md5)
+        return Util::getFileHash(path);
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QString();
+    QByteArray data;
+    qint64 size = file.size();
+    if (size > kSampleSize * 2) {
+        data = file.read(kSampleSize);
+        if (file.seek(size - kSampleSize))
+            data.append(file.read(kSampleSize));
+    } else {
+        data = file.readAll();
+    }
+    file.close();
+
+    // FNV-1a, a word at a time.
+    const quint64 prime = Q_UINT64_C(1099511628211);
+    quint64 h = Q_UINT64_C(14695981039346656037);
+    const char* p = data.constData();
+    int n = data.size();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        quint64 word;
+        memcpy(&word, p + i, sizeof(word));
+        h = (h ^ word) * prime;
+    }
+    for (; i < n; ++i)
+        h = (h ^ quint8(p[i])) * prime;
+    h = (h ^ quint64(size)) * prime;
+    return QString("%1").arg(h, 16, 16, QChar('0'));
+}
+
+QString MediaHash::cacheFile() const
+{
+    QDir dir(QStandardPaths::standardLocations(QStandardPaths::DataLocation).first());
+    if (!dir.exists())
+        dir.mkpath(dir.path());
+    return dir.filePath("mediahashes.dat");
+}
+
+void MediaHash::load()
+{
+    QFile file(cacheFile());
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+    QDataStream in(&file);
+    quint32 magic;
+    qint32 version;
+    qint32 count;
+    in >> magic >> version >> count;
+    if (magic != kFileMagic || version != kFileVersion)
+        return;
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString path;
+        Entry entry;
+        in >> path >> entry.size >> entry.modified >> entry.inode >> entry.used >> entry.hash;
+        if (in.status() == QDataStream::Ok)
+            m_entries.insert(path, entry);
+    }
+    LOG_DEBUG() << "remembered hashes of" << m_entries.size() << "files";
+}
+
+void MediaHash::save()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_dirty)
+        return;
+    if (m_entries.size() > kMaxEntries) {
+        QList<qint64> used;
+        foreach (const Entry& entry, m_entries)
+            used << entry.used;
+        std::sort(used.begin(), used.end());
+        qint64 oldest = used.at(m_entries.size() - kMaxEntries);
+        QHash<QString, Entry>::iterator i = m_entries.begin();
+        while (i != m_entries.end()) {
+            if (i->used < oldest)
+                i = m_entries.erase(i);
+            else
+                ++i;
+        }
+    }
+
+    QSaveFile file(cacheFile());
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    QDataStream out(&file);
+    out << kFileMagic << kFileVersion << qint32(m_entries.size());
+    QHash<QString, Entry>::const_iterator i = m_entries.constBegin();
+    for (; i != m_entries.constEnd(); ++i)
+        out << i.key() << i->size << i->modified << i->inode << i->used << i->hash;
+    if (file.commit())
+        m_dirty = false;
+    else
+        LOG_WARNING() << "failed to save" << file.fileName();
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEDIAHASH_H
+#define MEDIAHASH_H
+
+#include "commonutil_global.h"
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+
+/*!
+  \class MediaHash
+  \brief Media file hashes (kShotcutHashProperty), remembered across sessions.
+
+  \threadsafe
+
+  A hash is kept with the identity of the file it was made from: canonical
+  path, size, modification time and, where available, inode. As long as
+  those match, the file is not read again, which matters most for media on
+  network storage. hashAsync() computes on a small pool and emits hashReady().
+
+  Hashes are MD5 of the first and last megabyte as in Util::getFileHash(),
+  32 hex digits; with the media/fastHash setting they are FNV-1a over the
+  same data and the size, 16 hex digits. The length tells them apart, so
+  matches() compares against a hash of either kind.
+*/
+class COMMONUTILSHARED_EXPORT MediaHash : public QObject
+{
+    Q_OBJECT
+public:
+    enum Algorithm {
+        Md5,
+        Fast
+    };
+
+    static MediaHash& singleton();
+    ~MediaHash();
+
+    // The remembered hash if the file has not changed since, otherwise empty.
+    QString cached(const QString& path);
+    // The remembered hash or one computed on the calling thread.
+    QString hash(const QString& path);
+    // Compute on the pool unless remembered; hashReady() follows either way.
+    void hashAsync(const QString& path);
+    // Whether the file has this hash, computed the way the hash was.
+    bool matches(const QString& path, const QString& hash);
+
+    static QString compute(const QString& path, Algorithm algorithm);
+
+signals:
+    void hashReady(const QString& path, const QString& hash);
+
+private slots:
+    void save();
+
+private:
+    struct Entry {
+        qint64 size;
+        qint64 modified;
+        quint64 inode;
+        qint64 used;
+        QString hash;
+    };
+
+    MediaHash();
+    static bool identify(const QString& path, QString* canonical, Entry* entry);
+    QString lookup(const QString& path, Algorithm algorithm, QString* canonical, Entry* identity);
+    void remember(const QString& canonical, Entry entry);
+    QString cacheFile() const;
+    void load();
+
+    QMutex m_mutex;     // guards the members below
+    QHash<QString, Entry> m_entries;
+    QSet<QString> m_pending;
+    bool m_dirty;
+    QThreadPool m_pool;
+    QTimer m_saveTimer;
+};
+
+#endif // MEDIAHASH_H
@@ -248,6 +248,66 @@ bool ShotcutSettings::playerGPU() const
     return settings.value("player/gpu", false).toBool();
 }
 
+int ShotcutSettings::playerFrameCacheSize() const
+{
+    return settings.value("player/frameCacheSize", 512).toInt();
+}
+
+void ShotcutSettings::setPlayerFrameCacheSize(int megabytes)
+{
+    settings.setValue("player/frameCacheSize", megabytes);
+}
+
+int ShotcutSettings::playerPreviewScale() const
+{
+    return settings.value("player/previewScale", 1).toInt();
+}
+
+void ShotcutSettings::setPlayerPreviewScale(int scale)
+{
+    settings.setValue("player/previewScale", scale);
+}
+
+bool ShotcutSettings::proxyEnabled() const
+{
+    return settings.value("proxy/enabled", true).toBool();
+}
+
+void ShotcutSettings::setProxyEnabled(bool b)
+{
+    settings.setValue("proxy/enabled", b);
+}
+
+bool ShotcutSettings::mediaFastHash() const
+{
+    return settings.value("media/fastHash", false).toBool();
+}
+
+void ShotcutSettings::setMediaFastHash(bool b)
+{
+    settings.setValue("media/fastHash", b);
+}
+
+int ShotcutSettings::undoMemoryLimit() const
+{
+    return settings.value("undo/memoryLimit", 256).toInt();
+}
+
+void ShotcutSettings::setUndoMemoryLimit(int megabytes)
+{
+    settings.setValue("undo/memoryLimit", megabytes);
+}
+
+bool ShotcutSettings::projectLazyLoad() const
+{
+    return settings.value("project/lazyLoad", true).toBool();
+}
+
+void ShotcutSettings::setProjectLazyLoad(bool b)
+{
+    settings.setValue("project/lazyLoad", b);
+}
+
 void ShotcutSettings::setPlayerJACK(bool b)
 {
     settings.setValue("player/jack", b);
@@ -273,6 +333,16 @@ void ShotcutSettings::setPlayerMuted(bool b)
     settings.setValue("player/muted", b);
 }
 
+bool ShotcutSettings::playerPixelBuffers() const
+{
+    return settings.value("player/pixelBuffers", true).toBool();
+}
+
+void ShotcutSettings::setPlayerPixelBuffers(bool b)
+{
+    settings.setValue("player/pixelBuffers", b);
+}
+
 QString ShotcutSettings::playerProfile() const
 {
     return settings.value("player/profile", "").toString();
@@ -314,6 +384,16 @@ void ShotcutSettings::setPlayerScrubAudio(bool b)
     settings.setValue("player/scrubAudio", b);
 }
 
+bool ShotcutSettings::playerShowStats() const
+{
+    return settings.value("player/showStats", false).toBool();
+}
+
+void ShotcutSettings::setPlayerShowStats(bool b)
+{
+    settings.setValue("player/showStats", b);
+}
+
 int ShotcutSettings::playerVolume() const
 {
     return settings.value("player/volume", 35).toInt();
@@ -345,6 +425,16 @@ void ShotcutSettings::setPlaylistThumbnails(const QString& s)
     emit playlistThumbnailsChanged();
 }
 
+int ShotcutSettings::thumbnailMemoryCacheSize() const
+{
+    return settings.value("thumbnails/memoryCacheSize", 128).toInt();
+}
+
+void ShotcutSettings::setThumbnailMemoryCacheSize(int megabytes)
+{
+    settings.setValue("thumbnails/memoryCacheSize", megabytes);
+}
+
 bool ShotcutSettings::timelineShowWaveforms() const
 {
     return settings.value("timeline/waveforms", true).toBool();
@@ -378,6 +468,16 @@ void ShotcutSettings::setTimelineRippleAllTracks(bool b)
     emit timelineRippleAllTracksChanged();
 }
 
+bool ShotcutSettings::timelineRenderPreviewAuto() const
+{
+    return settings.value("timeline/renderPreviewAuto", false).toBool();
+}
+
+void ShotcutSettings::setTimelineRenderPreviewAuto(bool b)
+{
+    settings.setValue("timeline/renderPreviewAuto", b);
+}
+
 QString ShotcutSettings::filterFavorite(const QString& filterName)
 {
     return settings.value("filter/favorite/" + filterName, "").toString();
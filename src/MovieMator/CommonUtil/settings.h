@@ -91,6 +91,18 @@ public:
     void setPlayerGamma(const QString&);
     bool playerGPU() const;
     void setPlayerGPU(bool);
+    int playerFrameCacheSize() const;
+    void setPlayerFrameCacheSize(int);
+    int playerPreviewScale() const;
+    void setPlayerPreviewScale(int);
+    bool proxyEnabled() const;
+    void setProxyEnabled(bool);
+    bool mediaFastHash() const;
+    void setMediaFastHash(bool);
+    int undoMemoryLimit() const;
+    void setUndoMemoryLimit(int);
+    bool projectLazyLoad() const;
+    void setProjectLazyLoad(bool);
     QString playerInterpolation() const;
     void setPlayerInterpolation(const QString&);
     bool playerJACK() const;
@@ -99,6 +111,8 @@ public:
     void setPlayerKeyerMode(int);
     bool playerMuted() const;
     void setPlayerMuted(bool);
+    bool playerPixelBuffers() const;
+    void setPlayerPixelBuffers(bool);
     QString playerProfile() const;
     void setPlayerProfile(const QString&);
     bool playerProgressive() const;
@@ -106,6 +120,8 @@ public:
     bool playerRealtime() const;
     void setPlayerRealtime(bool);
     bool playerScrubAudio() const;
+    bool playerShowStats() const;
+    void setPlayerShowStats(bool);
     void setPlayerScrubAudio(bool);
     int playerVolume() const;
     void setPlayerVolume(int);
@@ -114,6 +130,8 @@ public:
 
     QString playlistThumbnails() const;
     void setPlaylistThumbnails(const QString&);
+    int thumbnailMemoryCacheSize() const;
+    void setThumbnailMemoryCacheSize(int);
 
     bool timelineShowWaveforms() const;
     void setTimelineShowWaveforms(bool);
@@ -121,6 +139,8 @@ public:
     void setTimelineShowThumbnails(bool);
     bool timelineRippleAllTracks() const;
     void setTimelineRippleAllTracks(bool);
+    bool timelineRenderPreviewAuto() const;
+    void setTimelineRenderPreviewAuto(bool);
 
     QString filterFavorite(const QString& filterName);
     void setFilterFavorite(const QString& filterName, const QString& value);
@@ -48,6 +48,7 @@
 #define kShotcutDetailProperty "moviemator:detail"
 #define kShotcutHashProperty "moviemator:hash"
 #define kFilterTrackProperty "moviemator:filterTrack"
+#define kOriginalResourceProperty "moviemator:originalResource"
 
 #define kProducerTypeProperty "moviemator:producer_type"
 
@@ -66,7 +67,7 @@
 
 /* Internal only */
 
-#define kAudioLevelsProperty "_moviemator:audio-levels"
+#define kAudioPeaksProperty "_moviemator:audio-peaks"
 #define kBackgroundCaptureProperty "_moviemator:bgcapture"
 #define kPlaylistIndexProperty "_moviemator:playlistIndex"
 #define kFilterInProperty "_moviemator:filter_in"
@@ -74,7 +75,9 @@
 #define kThumbnailInProperty "_moviemator:thumbnail-in"
 #define kThumbnailOutProperty "_moviemator:thumbnail-out"
 #define kUndoIdProperty "_moviemator:undo_id"
+#define kUndoRevisionProperty "_moviemator:undo-revision"
 #define kUuidProperty "_moviemator:uuid"
 #define kMultitrackItemProperty "_moviemator:multitrack-item"
+#define kFrameCacheKeyProperty "_moviemator:frame-cache-key"
 
 #endif // SHOTCUT_MLT_PROPERTIES_H
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thumbnailcache.h"
+#include "settings.h"
+#include <QMutexLocker>
+
+ThumbnailCache& ThumbnailCache::singleton()
+{
+    static ThumbnailCache instance;
+    return instance;
+}
+
+ThumbnailCache::ThumbnailCache()
+    : m_hits(0)
+    , m_misses(0)
+    , m_evictions(0)
+{
+    setBudget(Settings.thumbnailMemoryCacheSize());
+}
+
+void ThumbnailCache::setBudget(int megabytes)
+{
+    QMutexLocker locker(&m_mutex);
+    int count = m_cache.count();
+    m_cache.setMaxCost(qMax(0, megabytes) * 1024);
+    m_evictions += count - m_cache.count();
+}
+
+QImage ThumbnailCache::find(const QString& key)
+{
+    QMutexLocker locker(&m_mutex);
+    QImage* image = m_cache.object(key);
+    if (image) {
+        ++m_hits;
+        return *image;
+    }
+    ++m_misses;
+    return QImage();
+}
+
+void ThumbnailCache::insert(const QString& key, const QImage& image)
+{
+    if (image.isNull())
+        return;
+    int cost = qMax(1, image.bytesPerLine() * image.height() / 1024);
+    QMutexLocker locker(&m_mutex);
+    if (cost > m_cache.maxCost())
+        return;
+    // QCache does not report what it drops; infer it from the count.
+    int count = m_cache.count() + (m_cache.contains(key)? 0 : 1);
+    m_cache.insert(key, new QImage(image), cost);
+    m_evictions += count - m_cache.count();
+}
+
+void ThumbnailCache::remove(const QString& key)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.remove(key);
+}
+
+void ThumbnailCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.clear();
+}
+
+int ThumbnailCache::hits() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hits;
+}
+
+int ThumbnailCache::misses() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_misses;
+}
+
+int ThumbnailCache::evictions() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_evictions;
+}
+
+int ThumbnailCache::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_cache.totalCost();
+}
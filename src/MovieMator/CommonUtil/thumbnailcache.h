@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include "commonutil_global.h"
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+
+/*!
+  \class ThumbnailCache
+  \brief Process-wide LRU of decoded thumbnails in front of the thumbnail database.
+
+  \threadsafe
+
+  Entries use the database cache keys. The cost of each entry is its image
+  size and the total is bounded by the thumbnails/memoryCacheSize setting.
+  Database looks here before reading SQLite and adds every image it stores or
+  reads, so QML delegates that are re-created while scrolling do not pay for
+  a query and a PNG decode again.
+*/
+class COMMONUTILSHARED_EXPORT ThumbnailCache
+{
+public:
+    static ThumbnailCache& singleton();
+
+    void setBudget(int megabytes);
+    QImage find(const QString& key);
+    void insert(const QString& key, const QImage& image);
+    void remove(const QString& key);
+    void clear();
+
+    int hits() const;
+    int misses() const;
+    int evictions() const;
+    // The memory in use in kilobytes.
+    int size() const;
+
+private:
+    ThumbnailCache();
+
+    mutable QMutex m_mutex;
+    // Costs are in kilobytes to stay within int for large budgets.
+    QCache<QString, QImage> m_cache;
+    int m_hits;
+    int m_misses;
+    int m_evictions;
+};
+
+#endif // THUMBNAILCACHE_H
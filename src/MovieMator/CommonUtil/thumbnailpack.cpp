@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thumbnailpack.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <Logger.h>
+#include <algorithm>
+#include <cstddef>
+
+static const qint64 kSegmentSize = 64 * 1024 * 1024;
+static const quint32 kRecordMagic = 0x48544d4d; // "MMTH"
+// Pixels start on this boundary so that scanlines stay aligned.
+static const qint64 kAlignment = 16;
+
+// A record is this header, the UTF-8 key and the pixels, each aligned.
+struct RecordHeader {
+    quint32 magic;
+    quint32 checksum;       // of the fields below and the key
+    quint32 bytesPerLine;
+    quint16 keyLength;
+    quint16 format;
+    quint16 width;
+    quint16 height;
+};
+
+struct ThumbnailPack::Segment {
+    QString path;
+    QFile file;
+    uchar* map;
+    qint64 used;
+    int number;
+    bool obsolete;
+
+    Segment() : map(nullptr), used(0), number(0), obsolete(false) {}
+    ~Segment()
+    {
+        if (map)
+            file.unmap(map);
+        file.close();
+        if (obsolete)
+            QFile::remove(path);
+    }
+};
+
+static inline qint64 aligned(qint64 n)
+{
+    return (n + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+static quint32 recordChecksum(const RecordHeader& header, const char* key)
+{
+    QByteArray data(reinterpret_cast<const char*>(&header.bytesPerLine),
+                    int(sizeof(RecordHeader) - offsetof(RecordHeader, bytesPerLine)));
+    data.append(key, header.keyLength);
+    return qChecksum(data.constData(), uint(data.size()));
+}
+
+static bool isOpaque(const QImage& image)
+{
+    if (!image.hasAlphaChannel())
+        return true;
+    QImage argb = image.convertToFormat(QImage::Format_ARGB32);
+    for (int y = 0; y < argb.height(); ++y) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(argb.constScanLine(y));
+        for (int x = 0; x < argb.width(); ++x) {
+            if (qAlpha(line[x]) != 255)
+                return false;
+        }
+    }
+    return true;
+}
+
+ThumbnailPack::ThumbnailPack(const QDir& dir, qint64 budget)
+    : m_dir(dir)
+    , m_budget(qMax(budget, kSegmentSize))
+{
+}
+
+ThumbnailPack::~ThumbnailPack()
+{
+    flush();
+    QMutexLocker locker(&m_mutex);
+    m_index.clear();
+    m_segments.clear();
+}
+
+void ThumbnailPack::releaseSegment(void* segment)
+{
+    delete static_cast<QSharedPointer<Segment>*>(segment);
+}
+
+QSharedPointer<ThumbnailPack::Segment> ThumbnailPack::openSegment(int number, bool create)
+{
+    QSharedPointer<Segment> segment(new Segment);
+    segment->number = number;
+    segment->path = m_dir.filePath(QString("thumbnails-%1.pack").arg(number, 4, 10, QChar('0')));
+    segment->file.setFileName(segment->path);
+    if (!segment->file.open(QIODevice::ReadWrite)) {
+        LOG_WARNING() << "failed to open" << segment->path;
+        return QSharedPointer<Segment>();
+    }
+    // A new segment is zero-filled, which ends the scan at the first unused byte.
+    if (create)
+        segment->file.resize(0);
+    if (segment->file.size() != kSegmentSize)
+        segment->file.resize(kSegmentSize);
+    segment->map = segment->file.map(0, kSegmentSize);
+    if (!segment->map) {
+        LOG_WARNING() << "failed to map" << segment->path;
+        return QSharedPointer<Segment>();
+    }
+    return segment;
+}
+
+void ThumbnailPack::scanSegment(const QSharedPointer<Segment>& segment)
+{
+    qint64 offset = 0;
+    while (offset + qint64(sizeof(RecordHeader)) <= kSegmentSize) {
+        RecordHeader header;
+        memcpy(&header, segment->map + offset, sizeof(header));
+        if (header.magic != kRecordMagic)
+            break;
+        qint64 keyOffset = offset + qint64(sizeof(RecordHeader));
+        qint64 dataOffset = aligned(keyOffset + header.keyLength);
+        qint64 end = aligned(dataOffset + qint64(header.bytesPerLine) * header.height);
+        QImage::Format format = QImage::Format(header.format);
+        if (end > kSegmentSize || !header.width || !header.height
+                || (format != QImage::Format_RGB888 && format != QImage::Format_ARGB32))
+            break;
+        const char* key = reinterpret_cast<const char*>(segment->map + keyOffset);
+        // A record cut short by a crash ends the segment.
+        if (header.checksum != recordChecksum(header, key))
+            break;
+        Entry entry = { segment, dataOffset, header.width, header.height, int(header.bytesPerLine), format };
+        m_index.insert(QString::fromUtf8(key, header.keyLength), entry);
+        offset = end;
+    }
+    segment->used = offset;
+}
+
+bool ThumbnailPack::open()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_segments.isEmpty())
+        return true;
+    if (!m_dir.exists())
+        m_dir.mkpath(m_dir.path());
+
+    QList<int> numbers;
+    foreach (const QString& name, m_dir.entryList(QStringList() << "thumbnails-*.pack", QDir::Files)) {
+        bool ok = false;
+        // thumbnails-NNNN.pack
+        int number = name.mid(11, name.size() - 16).toInt(&ok);
+        if (ok)
+            numbers << number;
+    }
+    std::sort(numbers.begin(), numbers.end());
+    foreach (int number, numbers) {
+        QSharedPointer<Segment> segment = openSegment(number, false);
+        if (!segment)
+            continue;
+        scanSegment(segment);
+        m_segments << segment;
+    }
+    while (qint64(m_segments.size()) * kSegmentSize > m_budget && m_segments.size() > 1)
+        dropOldestSegment();
+    locker.unlock();
+
+    if (m_segments.isEmpty())
+        addSegment();
+    LOG_DEBUG() << "thumbnail pack has" << count() << "thumbnails in" << m_segments.size() << "segments";
+    return isOpen();
+}
+
+bool ThumbnailPack::isOpen() const
+{
+    QMutexLocker locker(&m_mutex);
+    return !m_segments.isEmpty();
+}
+
+QImage ThumbnailPack::find(const QString& key) const
+{
+    QMutexLocker locker(&m_mutex);
+    QHash<QString, Entry>::const_iterator i = m_index.constFind(key);
+    if (i == m_index.constEnd())
+        return QImage();
+    const Entry& entry = i.value();
+    // The image refers to the mapping, which it keeps alive until released.
+    // The const constructor makes any write to it detach into a copy instead
+    // of going through to the shared mapping and the pack file.
+    const uchar* data = entry.segment->map + entry.offset;
+    return QImage(data, entry.width, entry.height, entry.bytesPerLine,
+                  entry.format, &ThumbnailPack::releaseSegment, new QSharedPointer<Segment>(entry.segment));
+}
+
+bool ThumbnailPack::contains(const QString& key) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.contains(key);
+}
+
+bool ThumbnailPack::insert(const QString& key, const QImage& image)
+{
+    if (image.isNull() || image.width() > 0xffff || image.height() > 0xffff)
+        return false;
+    QByteArray keyBytes = key.toUtf8();
+    if (keyBytes.size() > 0xffff)
+        return false;
+    QImage stored = image.convertToFormat(isOpaque(image)? QImage::Format_RGB888 : QImage::Format_ARGB32);
+
+    RecordHeader header;
+    header.magic = kRecordMagic;
+    header.bytesPerLine = quint32(stored.bytesPerLine());
+    header.keyLength = quint16(keyBytes.size());
+    header.format = quint16(stored.format());
+    header.width = quint16(stored.width());
+    header.height = quint16(stored.height());
+    header.checksum = recordChecksum(header, keyBytes.constData());
+
+    qint64 keySize = aligned(qint64(sizeof(RecordHeader)) + keyBytes.size()) - qint64(sizeof(RecordHeader));
+    qint64 dataSize = qint64(stored.bytesPerLine()) * stored.height();
+    qint64 recordSize = qint64(sizeof(RecordHeader)) + keySize + aligned(dataSize);
+    if (recordSize > kSegmentSize)
+        return false;
+
+    m_mutex.lock();
+    QSharedPointer<Segment> segment = m_segments.isEmpty()? QSharedPointer<Segment>() : m_segments.last();
+    m_mutex.unlock();
+    if (!segment || segment->used + recordSize > kSegmentSize) {
+        if (!addSegment())
+            return false;
+        m_mutex.lock();
+        segment = m_segments.last();
+        m_mutex.unlock();
+    }
+
+    // Write the header last so that an interrupted write is not picked up.
+    qint64 offset = segment->used;
+    keyBytes.append(QByteArray(int(keySize - keyBytes.size()), '\0'));
+    if (!segment->file.seek(offset + qint64(sizeof(RecordHeader)))
+            || segment->file.write(keyBytes) != keyBytes.size()
+            || segment->file.write(reinterpret_cast<const char*>(stored.constBits()), dataSize) != dataSize
+            || !segment->file.seek(offset)
+            || segment->file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != qint64(sizeof(header))) {
+        LOG_WARNING() << "failed to write" << segment->path << segment->file.errorString();
+        return false;
+    }
+    segment->file.flush();
+
+    Entry entry = { segment, offset + qint64(sizeof(RecordHeader)) + keySize,
+                    stored.width(), stored.height(), stored.bytesPerLine(), stored.format() };
+    QMutexLocker locker(&m_mutex);
+    segment->used = offset + recordSize;
+    if (m_segments.contains(segment))
+        m_index.insert(key, entry);
+    return true;
+}
+
+void ThumbnailPack::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_segments.isEmpty())
+        m_segments.last()->file.flush();
+}
+
+int ThumbnailPack::count() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.size();
+}
+
+qint64 ThumbnailPack::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    qint64 result = 0;
+    foreach (const QSharedPointer<Segment>& segment, m_segments)
+        result += segment->used;
+    return result;
+}
+
+bool ThumbnailPack::addSegment()
+{
+    m_mutex.lock();
+    int number = m_segments.isEmpty()? 1 : m_segments.last()->number + 1;
+    m_mutex.unlock();
+    QSharedPointer<Segment> segment = openSegment(number, true);
+    if (!segment)
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    m_segments << segment;
+    while (qint64(m_segments.size()) * kSegmentSize > m_budget && m_segments.size() > 1)
+        dropOldestSegment();
+    return true;
+}
+
+// Called with the mutex locked.
+void ThumbnailPack::dropOldestSegment()
+{
+    QSharedPointer<Segment> segment = m_segments.takeFirst();
+    segment->obsolete = true;
+    QHash<QString, Entry>::iterator i = m_index.begin();
+    while (i != m_index.end()) {
+        if (i.value().segment == segment)
+            i = m_index.erase(i);
+        else
+            ++i;
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THUMBNAILPACK_H
+#define THUMBNAILPACK_H
+
+#include "commonutil_global.h"
+
+#include <QDir>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+
+/*!
+  \class ThumbnailPack
+  \brief Append-only, memory-mapped store of uncompressed thumbnails.
+
+  \threadsafe find() may be called from any thread; insert() and flush()
+  from one writer thread at a time.
+
+  Thumbnails are appended as raw pixels to fixed-size segment files which are
+  mapped into memory, and find() returns a QImage that points straight into
+  the mapping, so a read costs a hash lookup and no decoding. Opaque images
+  are stored as RGB888 to save a quarter of the space; others keep their
+  alpha, which the audio levels use as data. The index is rebuilt by scanning
+  the record headers when the pack is opened. When the segments exceed the
+  budget the oldest one is dropped as a whole; images already handed out
+  keep its mapping alive until they are released.
+
+  Records are in host byte order. The pack is a local cache and is never
+  copied between machines.
+*/
+class COMMONUTILSHARED_EXPORT ThumbnailPack
+{
+public:
+    ThumbnailPack(const QDir& dir, qint64 budget);
+    ~ThumbnailPack();
+
+    bool open();
+    bool isOpen() const;
+    QImage find(const QString& key) const;
+    bool contains(const QString& key) const;
+    bool insert(const QString& key, const QImage& image);
+    void flush();
+
+    int count() const;
+    // The bytes written to the segments.
+    qint64 size() const;
+
+private:
+    struct Segment;
+    struct Entry {
+        QSharedPointer<Segment> segment;
+        qint64 offset;      // of the pixels within the segment
+        int width;
+        int height;
+        int bytesPerLine;
+        QImage::Format format;
+    };
+
+    static void releaseSegment(void* segment);
+    QSharedPointer<Segment> openSegment(int number, bool create);
+    void scanSegment(const QSharedPointer<Segment>& segment);
+    bool addSegment();
+    void dropOldestSegment();
+
+    QDir m_dir;
+    qint64 m_budget;
+    mutable QMutex m_mutex;     // guards the index and the segment list
+    QList< QSharedPointer<Segment> > m_segments;   // oldest first, the last is written
+    QHash<QString, Entry> m_index;
+};
+
+#endif // THUMBNAILPACK_H
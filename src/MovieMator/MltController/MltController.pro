@@ -26,6 +26,9 @@ SOURCES += \
         mltcontroller.cpp \
     glwidget.cpp \
     sharedframe.cpp \
+    playbackstats.cpp \
+    framepool.cpp \
+    framecache.cpp \
     qmltypes/qmlprofile.cpp
 
 HEADERS += \
@@ -33,6 +36,9 @@ HEADERS += \
         mltcontroller_global.h \ 
     glwidget.h \
     sharedframe.h \
+    playbackstats.h \
+    framepool.h \
+    framecache.h \
     transportcontrol.h \
     qmltypes/qmlprofile.h
 
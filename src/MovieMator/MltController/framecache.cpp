@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "framecache.h"
+#include <QMutexLocker>
+#include <Logger.h>
+
+// In kilobytes, see m_cache.
+static int frameCost(const SharedFrame& frame)
+{
+    return qMax(1, (frame.get_image_width() * frame.get_image_height() * 3 / 2) / 1024);
+}
+
+FrameCache::FrameCache()
+    : m_revision(0)
+    , m_hits(0)
+    , m_misses(0)
+{
+    m_cache.setMaxCost(0);
+}
+
+void FrameCache::setProducer(const QString& key)
+{
+    QMutexLocker locker(&m_mutex);
+    m_producer = key;
+}
+
+void FrameCache::setBudget(int megabytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.setMaxCost(qMax(0, megabytes) * 1024);
+}
+
+bool FrameCache::isEnabled() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_cache.maxCost() > 0 && !m_producer.isEmpty();
+}
+
+quint32 FrameCache::revision() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_revision;
+}
+
+SharedFrame FrameCache::find(int position)
+{
+    QMutexLocker locker(&m_mutex);
+    FrameCacheKey key = { m_producer, m_revision, position };
+    SharedFrame* frame = m_cache.object(key);
+    if (frame) {
+        ++m_hits;
+        return *frame;
+    }
+    ++m_misses;
+    return SharedFrame();
+}
+
+void FrameCache::insert(const SharedFrame& frame, quint32 revision)
+{
+    if (!frame.is_valid() || frame.get_image_format() != mlt_image_yuv420p)
+        return;
+    QMutexLocker locker(&m_mutex);
+    if (revision != m_revision || m_producer.isEmpty() || m_cache.maxCost() <= 0)
+        return;
+    FrameCacheKey key = { m_producer, revision, frame.get_position() };
+    if (m_cache.contains(key))
+        return;
+    locker.unlock();
+
+    // Keep only the image so that cached frames do not hold on to audio or
+    // to the services that produced them.
+    Mlt::Frame clone = frame.clone(false, true);
+    SharedFrame* cached = new SharedFrame(clone);
+    int cost = frameCost(frame);
+
+    locker.relock();
+    if (revision != m_revision || key.producer != m_producer)
+        delete cached;
+    else
+        m_cache.insert(key, cached, cost);
+}
+
+void FrameCache::invalidate(int in, int out)
+{
+    QMutexLocker locker(&m_mutex);
+    quint32 previous = m_revision++;
+    foreach (const FrameCacheKey& key, m_cache.keys()) {
+        // Older revisions are unreachable; let them age out of the LRU.
+        if (key.producer != m_producer || key.revision != previous)
+            continue;
+        if (key.position >= in && (out < 0 || key.position <= out)) {
+            m_cache.remove(key);
+        } else {
+            SharedFrame* frame = m_cache.take(key);
+            FrameCacheKey current = key;
+            current.revision = m_revision;
+            m_cache.insert(current, frame, frameCost(*frame));
+        }
+    }
+}
+
+void FrameCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_revision;
+    m_cache.clear();
+}
+
+int FrameCache::hits() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hits;
+}
+
+int FrameCache::misses() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_misses;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include "mltcontroller_global.h"
+
+#include <QCache>
+#include <QMutex>
+#include <QString>
+#include "sharedframe.h"
+
+struct FrameCacheKey
+{
+    QString producer;
+    quint32 revision;
+    int position;
+
+    bool operator==(const FrameCacheKey& other) const {
+        return position == other.position && revision == other.revision
+                && producer == other.producer;
+    }
+};
+
+inline uint qHash(const FrameCacheKey& key, uint seed = 0)
+{
+    return qHash(key.producer, seed) ^ uint(key.position) ^ (key.revision << 16);
+}
+
+/*!
+  \class FrameCache
+  \brief LRU cache of displayed preview frames for scrubbing and frame stepping.
+
+  \threadsafe
+
+  Frames are stored as image-only clones in the yuv420p layout FrameRenderer
+  uploads, keyed by producer, edit revision and position. The cost of each
+  entry is its image size and the total is bounded by the player/frameCacheSize
+  setting.
+
+  Every timeline edit and filter change calls invalidate(), which bumps the
+  revision so that no frame cached before it is found again. Frames of the
+  current producer outside the invalidated range are carried over to the new
+  revision; the others are dropped. insert() takes the revision that was
+  current when the frame was shown and refuses frames rendered before the
+  latest edit.
+*/
+
+class MLTCONTROLLERSHARED_EXPORT FrameCache
+{
+public:
+    FrameCache();
+
+    void setProducer(const QString& key);
+    void setBudget(int megabytes);
+    bool isEnabled() const;
+    quint32 revision() const;
+
+    SharedFrame find(int position);
+    void insert(const SharedFrame& frame, quint32 revision);
+    void invalidate(int in = 0, int out = -1);
+    void clear();
+
+    int hits() const;
+    int misses() const;
+
+private:
+    mutable QMutex m_mutex;
+    // Costs are in kilobytes to stay within int for large budgets.
+    QCache<FrameCacheKey, SharedFrame> m_cache;
+    QString m_producer;
+    quint32 m_revision;
+    int m_hits;
+    int m_misses;
+};
+
+#endif // FRAMECACHE_H
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "framepool.h"
+#include <QMutexLocker>
+#include <Logger.h>
+#include <QtGlobal>
+
+// Every block starts with a header recording its size class so that
+// release() can be used as a plain mlt_destructor. Blocks are allocated
+// 32-byte aligned and the header is 32 bytes, so the payload stays aligned
+// for AVX image code.
+static const size_t kAlignment = 32;
+static const size_t kHeaderSize = kAlignment;
+// Smallest size class; audio buffers and thumbnails land here.
+static const size_t kMinimumClass = 4096;
+// Free buffers kept per size class and in total.
+static const int kMaxFreePerClass = 8;
+static const qint64 kMaxCachedBytes = 512 * 1024 * 1024;
+
+static size_t sizeClass(size_t size)
+{
+    if (size <= kMinimumClass)
+        return kMinimumClass;
+    size_t power = kMinimumClass;
+    while (power < size / 2)
+        power <<= 1;
+    // Four classes between power and 2 * power.
+    size_t step = power / 4;
+    return (size + step - 1) / step * step;
+}
+
+FramePool& FramePool::singleton()
+{
+    // Intentionally never destroyed: frames may still be released while
+    // static objects are being torn down at exit.
+    static FramePool* instance = new FramePool;
+    return *instance;
+}
+
+FramePool::FramePool()
+    : m_hits(0)
+    , m_misses(0)
+    , m_bytesInUse(0)
+    , m_peakBytes(0)
+    , m_cachedBytes(0)
+{
+}
+
+FramePool::~FramePool()
+{
+    purge();
+}
+
+void* FramePool::alloc(int size)
+{
+    if (size <= 0)
+        return nullptr;
+    size_t blockSize = sizeClass(size_t(size));
+    void* block = nullptr;
+
+    m_mutex.lock();
+    QMap<size_t, QVector<void*> >::iterator it = m_free.find(blockSize);
+    if (it != m_free.end() && !it.value().isEmpty()) {
+        block = it.value().takeLast();
+        m_cachedBytes -= qint64(blockSize);
+        ++m_hits;
+    } else {
+        ++m_misses;
+    }
+    m_bytesInUse += qint64(blockSize);
+    m_peakBytes = qMax(m_peakBytes, m_bytesInUse);
+    m_mutex.unlock();
+
+    if (!block) {
+        block = qMallocAligned(kHeaderSize + blockSize, kAlignment);
+        if (!block) {
+            LOG_ERROR() << "failed to allocate frame buffer of" << blockSize << "bytes";
+            QMutexLocker locker(&m_mutex);
+            m_bytesInUse -= qint64(blockSize);
+            return nullptr;
+        }
+        *static_cast<size_t*>(block) = blockSize;
+    }
+    return static_cast<char*>(block) + kHeaderSize;
+}
+
+void FramePool::release(void* buffer)
+{
+    if (!buffer)
+        return;
+    void* block = static_cast<char*>(buffer) - kHeaderSize;
+    singleton().put(block, *static_cast<size_t*>(block));
+}
+
+void FramePool::put(void* block, size_t size)
+{
+    QMutexLocker locker(&m_mutex);
+    m_bytesInUse -= qint64(size);
+    QVector<void*>& list = m_free[size];
+    if (list.size() < kMaxFreePerClass && m_cachedBytes + qint64(size) <= kMaxCachedBytes) {
+        list.append(block);
+        m_cachedBytes += qint64(size);
+    } else {
+        locker.unlock();
+        qFreeAligned(block);
+    }
+}
+
+void FramePool::purge()
+{
+    QMutexLocker locker(&m_mutex);
+    foreach (const QVector<void*>& list, m_free) {
+        foreach (void* block, list)
+            qFreeAligned(block);
+    }
+    m_free.clear();
+    m_cachedBytes = 0;
+}
+
+qint64 FramePool::hits() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hits;
+}
+
+qint64 FramePool::misses() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_misses;
+}
+
+qint64 FramePool::bytesInUse() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_bytesInUse;
+}
+
+qint64 FramePool::peakBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_peakBytes;
+}
+
+qint64 FramePool::cachedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_cachedBytes;
+}
+
+QString FramePool::summary() const
+{
+    QMutexLocker locker(&m_mutex);
+    return QString("frame pool hits %1 misses %2 in use %3 MiB peak %4 MiB cached %5 MiB")
+            .arg(m_hits)
+            .arg(m_misses)
+            .arg(double(m_bytesInUse) / (1024 * 1024), 0, 'f', 1)
+            .arg(double(m_peakBytes) / (1024 * 1024), 0, 'f', 1)
+            .arg(double(m_cachedBytes) / (1024 * 1024), 0, 'f', 1);
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include "mltcontroller_global.h"
+
+#include <QMutex>
+#include <QMap>
+#include <QVector>
+#include <QString>
+
+/*!
+  \class FramePool
+  \brief Recycles the image and audio buffers attached to preview frames.
+
+  \threadsafe
+
+  Buffers are grouped in size classes (four per power of two) so that
+  frames of the same resolution always share a class. release() is an
+  mlt_destructor, so a buffer handed to Mlt::Frame::set() returns to the
+  pool when the frame is closed. After a few frames of playback at a fixed
+  resolution every request is served from the free lists.
+*/
+
+class MLTCONTROLLERSHARED_EXPORT FramePool
+{
+public:
+    static FramePool& singleton();
+
+    void* alloc(int size);
+    static void release(void* buffer);
+
+    qint64 hits() const;
+    qint64 misses() const;
+    qint64 bytesInUse() const;
+    qint64 peakBytes() const;
+    qint64 cachedBytes() const;
+    QString summary() const;
+    void purge();
+
+private:
+    FramePool();
+    ~FramePool();
+    FramePool(FramePool const&);
+    void operator=(FramePool const&);
+
+    void put(void* block, size_t size);
+
+    mutable QMutex m_mutex;
+    QMap<size_t, QVector<void*> > m_free;
+    qint64 m_hits;
+    qint64 m_misses;
+    qint64 m_bytesInUse;
+    qint64 m_peakBytes;
+    qint64 m_cachedBytes;
+};
+
+#endif // FRAMEPOOL_H
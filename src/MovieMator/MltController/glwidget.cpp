@@ -30,6 +30,7 @@
 #include <Mlt.h>
 #include <Logger.h>
 #include "glwidget.h"
+#include "framepool.h"
 #include "settings.h"
 #include "qmlutilities.h"
 //#include "qmltypes/qmlfilter.h"
@@ -45,6 +46,16 @@ static const int FRAMEDISPLAYED_MIN_MS = 80; // max 12.5 fps
 static const int FRAMEDISPLAYED_MIN_MS = 10; // max 100 fps
 #endif
 
+// Automatic preview scaling lowers the resolution one step when more than
+// this fraction of frames was dropped over the statistics window.
+static const double AUTO_SCALE_DROP_RATE = 0.1;
+static const int AUTO_SCALE_MIN_FRAMES = 48;
+static const int AUTO_SCALE_INTERVAL_MS = 1000;
+static const int MAX_PREVIEW_SCALE = 4;
+
+// Frame property holding the FrameCache revision current at consumer-frame-show.
+static const char* kFrameCacheRevisionProperty = "moviemator.cache_revision";
+
 #ifdef QT_NO_DEBUG
 #define check_error(fn) {}
 #else
@@ -60,6 +71,32 @@ typedef GLenum (*ClientWaitSync_fp) (GLsync sync, GLbitfield flags, GLuint64 tim
 static ClientWaitSync_fp ClientWaitSync = nullptr;
 #endif
 
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+
+// Fences let the GUI thread wait on the GPU for the render thread's texture
+// uploads instead of the render thread blocking in glFinish(). Resolved once
+// on the render context; null if the driver lacks GL_ARB_sync.
+typedef GLsync (QOPENGLF_APIENTRYP FenceSync_fp) (GLenum condition, GLbitfield flags);
+typedef void (QOPENGLF_APIENTRYP WaitSync_fp) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (QOPENGLF_APIENTRYP DeleteSync_fp) (GLsync sync);
+static FenceSync_fp FenceSync = nullptr;
+static WaitSync_fp WaitSync = nullptr;
+static DeleteSync_fp DeleteSync = nullptr;
+
+static void resolveFenceFunctions(QOpenGLContext* context)
+{
+    if (FenceSync || context->isOpenGLES())
+        return;
+    if (context->format().version() < qMakePair(3, 2) && !context->hasExtension("GL_ARB_sync"))
+        return;
+    WaitSync = reinterpret_cast<WaitSync_fp>(context->getProcAddress("glWaitSync"));
+    DeleteSync = reinterpret_cast<DeleteSync_fp>(context->getProcAddress("glDeleteSync"));
+    if (WaitSync && DeleteSync)
+        FenceSync = reinterpret_cast<FenceSync_fp>(context->getProcAddress("glFenceSync"));
+}
+
 using namespace Mlt;
 
 GLWidget::GLWidget(QObject *parent)
@@ -77,6 +114,13 @@ GLWidget::GLWidget(QObject *parent)
     , m_zoom(0.0f)
     , m_offset(QPoint(0, 0))
     , m_shareContext(nullptr)
+    , m_playbackStats(new PlaybackStats(this))
+    , m_textureShowTime(0)
+    , m_paintedShowTime(0)
+    , m_textureFence(nullptr)
+    , m_previewScaleMode(Settings.playerPreviewScale())
+    , m_previewScale(1)
+    , m_autoPreviewScale(1)
 {
     LOG_DEBUG() << "begin";
     m_texture[0] = m_texture[1] = m_texture[2] = 0;
@@ -92,6 +136,7 @@ GLWidget::GLWidget(QObject *parent)
     setCommonProperties(rootContext());
 
     rootContext()->setContextProperty("video", this);
+    rootContext()->setContextProperty("playbackStats", m_playbackStats);
 
 
 
@@ -105,6 +150,8 @@ GLWidget::GLWidget(QObject *parent)
     connect(quickWindow(), SIGNAL(sceneGraphInitialized()), SLOT(initializeGL()), Qt::DirectConnection);
     connect(quickWindow(), SIGNAL(sceneGraphInitialized()), SLOT(setBlankScene()), Qt::QueuedConnection);
     connect(quickWindow(), SIGNAL(beforeRendering()), SLOT(paintGL()), Qt::DirectConnection);
+    m_previewScaleTimer.setInterval(AUTO_SCALE_INTERVAL_MS);
+    connect(&m_previewScaleTimer, SIGNAL(timeout()), SLOT(adjustPreviewScale()));
     LOG_DEBUG() << "end";
     qDebug() << "end";
 
@@ -182,7 +229,7 @@ void GLWidget::initializeGL()
         m_shareContext->setShareContext(quickWindow()->openglContext());
         m_shareContext->create();
     }
-    m_frameRenderer = new FrameRenderer(quickWindow()->openglContext(), &m_offscreenSurface);
+    m_frameRenderer = new FrameRenderer(quickWindow()->openglContext(), &m_offscreenSurface, m_playbackStats);
     Q_ASSERT(m_frameRenderer);
     Q_ASSERT(quickWindow()->openglContext());
     quickWindow()->openglContext()->makeCurrent(quickWindow());
@@ -361,6 +408,59 @@ static void uploadTextures(QOpenGLContext* context, SharedFrame& frame, GLuint t
     check_error(f);
 }
 
+// Create the Y, U and V textures with storage for the given frame size but
+// no contents. The streaming upload path only calls this when the size changes.
+static void allocateTextures(QOpenGLFunctions* f, GLuint texture[], int width, int height)
+{
+    Q_ASSERT(f);
+
+    if (texture[0])
+        f->glDeleteTextures(3, texture);
+    check_error(f);
+    f->glGenTextures(3, texture);
+    check_error(f);
+
+    for (int i = 0; i < 3; ++i) {
+        f->glBindTexture  (GL_TEXTURE_2D, texture[i]);
+        check_error(f);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        check_error(f);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        check_error(f);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        check_error(f);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        check_error(f);
+        f->glTexImage2D   (GL_TEXTURE_2D, 0, GL_LUMINANCE, i? width/2 : width, i? height/2 : height, 0,
+                        GL_LUMINANCE, GL_UNSIGNED_BYTE, nullptr);
+        check_error(f);
+    }
+}
+
+// Replace the contents of the Y, U and V textures. When a pixel unpack buffer
+// is bound, base is an offset into that buffer rather than a client pointer.
+static void updateTextures(QOpenGLFunctions* f, GLuint texture[], int width, int height, quintptr base)
+{
+    Q_ASSERT(f);
+
+    const quintptr offsets[3] = {
+        0,
+        quintptr(width * height),
+        quintptr(width * height + width/2 * height/2)
+    };
+    f->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    check_error(f);
+    for (int i = 0; i < 3; ++i) {
+        f->glBindTexture  (GL_TEXTURE_2D, texture[i]);
+        check_error(f);
+        f->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, i? width/2 : width, i? height/2 : height,
+                           GL_LUMINANCE, GL_UNSIGNED_BYTE, reinterpret_cast<const GLvoid*>(base + offsets[i]));
+        check_error(f);
+    }
+    f->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    check_error(f);
+}
+
 void GLWidget::paintGL()
 {
 #ifndef QT_NO_DEBUG
@@ -391,6 +491,17 @@ void GLWidget::paintGL()
 
     if (!m_texture[0]) return;
 
+    // Make the GPU, not this thread, wait for the render thread's upload.
+    m_mutex.lock();
+    GLsync fence = m_textureFence;
+    m_textureFence = nullptr;
+    qint64 textureShowTime = m_textureShowTime;
+    m_mutex.unlock();
+    if (fence) {
+        WaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+        DeleteSync(fence);
+    }
+
     // Bind textures.
     for (int i = 0; i < 3; ++i) {
         if (m_texture[i]) {
@@ -457,6 +568,10 @@ void GLWidget::paintGL()
     // Render
     glDrawArrays(GL_TRIANGLE_STRIP, 0, vertices.size());
     check_error(f);
+    if (textureShowTime != m_paintedShowTime) {
+        m_paintedShowTime = textureShowTime;
+        m_playbackStats->record(PlaybackStats::Painted, m_paintedShowTime);
+    }
 
     // Cleanup
     m_shader->disableAttributeArray(m_vertexLocation);
@@ -644,6 +759,8 @@ int GLWidget::reconfigure(bool isMulti)
         delete m_threadStopEvent;
         m_threadStopEvent = nullptr;
 
+        m_previewScale = 1;
+
         delete m_threadCreateEvent;
         m_threadCreateEvent = m_consumer->listen("consumer-thread-create", this, reinterpret_cast<mlt_listener>(onThreadCreate));
         delete m_threadJoinEvent;
@@ -712,6 +829,119 @@ int GLWidget::reconfigure(bool isMulti)
     return error;
 }
 
+void GLWidget::play(double speed)
+{
+    if (!qFuzzyIsNull(speed))
+        applyPreviewScale(m_previewScaleMode? m_previewScaleMode : m_autoPreviewScale);
+    Controller::play(speed);
+    if (qFuzzyIsNull(speed)) {
+        restoreFullResolution();
+        emit paused();
+    } else {
+        if (!m_previewScaleMode) {
+            m_playbackStats->resetDroppedWindow();
+            m_previewScaleTimer.start();
+        }
+        emit playing();
+    }
+}
+
+void GLWidget::pause()
+{
+    Controller::pause();
+    restoreFullResolution();
+    emit paused();
+}
+
+void GLWidget::setPreviewScale(int mode)
+{
+    m_previewScaleMode = (mode == 2 || mode == 4)? mode : (mode? 1 : 0);
+    m_autoPreviewScale = 1;
+    if (m_producer && !qFuzzyIsNull(m_producer->get_speed())) {
+        if (applyPreviewScale(m_previewScaleMode? m_previewScaleMode : m_autoPreviewScale))
+            m_consumer->start();
+        if (m_previewScaleMode) {
+            m_previewScaleTimer.stop();
+        } else {
+            m_playbackStats->resetDroppedWindow();
+            m_previewScaleTimer.start();
+        }
+    }
+}
+
+// Render the preview consumer at 1/scale of the profile size. The profile
+// itself is untouched, so export and everything else stay at full size.
+// Returns true if the size changed; the consumer is then stopped and the
+// caller must start it again.
+bool GLWidget::applyPreviewScale(int scale)
+{
+    if (!m_consumer || !m_consumer->is_valid() || !qstrcmp(m_consumer->get("mlt_service"), "multi"))
+        return false;
+    scale = qBound(1, scale, MAX_PREVIEW_SCALE);
+    if (scale == m_previewScale)
+        return false;
+    m_previewScale = scale;
+    if (scale == 1) {
+        m_consumer->set("width", profile().width());
+        m_consumer->set("height", profile().height());
+    } else {
+        m_consumer->set("width", qMax(2, profile().width() / scale / 2 * 2));
+        m_consumer->set("height", qMax(2, profile().height() / scale / 2 * 2));
+    }
+    LOG_INFO() << "preview scale" << scale;
+    if (!m_consumer->is_stopped())
+        m_consumer->stop();
+    return true;
+}
+
+void GLWidget::restoreFullResolution()
+{
+    m_previewScaleTimer.stop();
+    if (applyPreviewScale(1)) {
+        m_consumer->start();
+        refresh(false);
+    }
+}
+
+void GLWidget::adjustPreviewScale()
+{
+    if (m_previewScaleMode || !m_producer || qFuzzyIsNull(m_producer->get_speed()))
+        return;
+    if (m_playbackStats->droppedWindowSize() < AUTO_SCALE_MIN_FRAMES)
+        return;
+    if (m_playbackStats->droppedRate() > AUTO_SCALE_DROP_RATE && m_previewScale < MAX_PREVIEW_SCALE) {
+        m_autoPreviewScale = m_previewScale * 2;
+        if (applyPreviewScale(m_autoPreviewScale))
+            m_consumer->start();
+        m_playbackStats->resetDroppedWindow();
+    }
+}
+
+void GLWidget::seek(int position)
+{
+    // While paused, a frame already in the cache is shown without asking
+    // MLT to decode it again. The producer is still moved so that playback
+    // and the next refresh continue from here.
+    if (m_producer && m_frameRenderer && !m_glslManager && !Settings.playerJACK()
+            && m_consumer && m_consumer->is_valid() && !m_consumer->is_stopped()
+            && qFuzzyIsNull(m_producer->get_speed()) && m_frameCache.isEnabled()) {
+        SharedFrame frame = m_frameCache.find(position);
+        if (frame.is_valid()) {
+            m_producer->seek(position);
+            QMetaObject::invokeMethod(m_frameRenderer, "showCachedFrame", Qt::QueuedConnection,
+                                      Q_ARG(SharedFrame, frame));
+            emit paused();
+            return;
+        }
+    }
+    // Seeking pauses, so return to full resolution first. The consumer is
+    // left stopped and Controller::seek() starts it again.
+    m_previewScaleTimer.stop();
+    applyPreviewScale(1);
+    Controller::seek(position);
+    emit paused();
+}
+
 QPoint GLWidget::offset() const
 {
     return QPoint(int(m_offset.x() - (MLT.profile().width()  * m_zoom -  width()) / 2),
@@ -720,9 +950,12 @@ QPoint GLWidget::offset() const
 
 void GLWidget::onFrameDisplayed(const SharedFrame &frame)
 {
+    qint64 showTime = frame.get_int64(PlaybackStats::kShowTimeProperty);
     m_mutex.lock();
     m_sharedFrame = frame;
+    m_textureShowTime = showTime;
     m_mutex.unlock();
+    m_playbackStats->record(PlaybackStats::TextureReady, showTime);
     quickWindow()->update();
 }
 
@@ -762,6 +995,18 @@ void GLWidget::updateTexture(GLuint yName, GLuint uName, GLuint vName)
     m_texture[0] = yName;
     m_texture[1] = uName;
     m_texture[2] = vName;
+    if (m_frameRenderer) {
+        GLsync fence = m_frameRenderer->takeDisplayFence();
+        qint64 showTime = m_frameRenderer->displayShowTime();
+        m_mutex.lock();
+        // The newer fence also covers the upload of a frame never painted.
+        qSwap(fence, m_textureFence);
+        m_textureShowTime = showTime;
+        m_mutex.unlock();
+        if (fence)
+            DeleteSync(fence);
+        m_playbackStats->record(PlaybackStats::TextureReady, showTime);
+    }
     quickWindow()->update();
 }
 
@@ -770,17 +1015,23 @@ void GLWidget::on_frame_show(mlt_consumer, void* self, mlt_frame frame_ptr)
 {
 
     Q_ASSERT(self);
-     Mlt::Frame frame(frame_ptr);
-
-
-
+    Mlt::Frame frame(frame_ptr);
 
     if (frame.get_int("rendered")) {
         GLWidget* widget = static_cast<GLWidget*>(self);
+        qint64 showTime = PlaybackStats::now();
+        frame.set(PlaybackStats::kShowTimeProperty, int64_t(showTime));
+        frame.set(kFrameCacheRevisionProperty, int(widget->m_frameCache.revision()));
         int timeout = (widget->consumer()->get_int("real_time") > 0)? 0: 1000;
         if (widget->m_frameRenderer && widget->m_frameRenderer->semaphore()->tryAcquire(1, timeout)) {
+            widget->m_playbackStats->record(PlaybackStats::SemaphoreAcquired, showTime);
             QMetaObject::invokeMethod(widget->m_frameRenderer, "showFrame", Qt::QueuedConnection, Q_ARG(Mlt::Frame, frame));
+        } else if (widget->m_frameRenderer) {
+            widget->m_playbackStats->recordDropped();
         }
+    } else {
+        // A real-time consumer skipped rendering this frame to keep up.
+        static_cast<GLWidget*>(self)->m_playbackStats->recordDropped();
     }
 //#if MOVIEMATOR_FREE
 //    //Free版到5分钟暂停预览
@@ -833,15 +1084,22 @@ void RenderThread::run()
     }
 }
 
-FrameRenderer::FrameRenderer(QOpenGLContext* shareContext, QSurface* surface)
+FrameRenderer::FrameRenderer(QOpenGLContext* shareContext, QSurface* surface, PlaybackStats* stats)
      : QThread(nullptr)
      , m_semaphore(3)
      , m_context(nullptr)
      , m_surface(surface)
      , m_previousMSecs(QDateTime::currentMSecsSinceEpoch())
+     , m_stats(stats)
+     , m_displayShowTime(0)
+     , m_displayFence(nullptr)
+     , m_pixelBufferIndex(0)
+     , m_usePixelBuffers(-1)
      , m_gl32(nullptr)
 {
     Q_ASSERT(shareContext);
+    for (int i = 0; i < PixelBufferCount; ++i)
+        m_pixelBuffers[i] = nullptr;
     m_renderTexture[0] = m_renderTexture[1] = m_renderTexture[2] = 0;
     m_displayTexture[0] = m_displayTexture[1] = m_displayTexture[2] = 0;
     if (Settings.playerGPU() || shareContext->supportsThreadedOpenGL()) {
@@ -864,19 +1122,69 @@ FrameRenderer::~FrameRenderer()
     delete m_gl32;
 }
 
+// Convert the packed yuv422 image the consumer renders into the planar
+// yuv420p the shader expects, using a pooled buffer. Returns false if the
+// frame is not in a form this handles so that MLT can convert it instead.
+static bool convertToYuv420p(Mlt::Frame& frame)
+{
+    mlt_image_format format = mlt_image_yuv422;
+    int width = 0;
+    int height = 0;
+    const uint8_t* src = frame.get_image(format, width, height);
+    if (!src || format != mlt_image_yuv422 || width <= 0 || height <= 0 || (width & 1) || (height & 1))
+        return false;
+
+    int size = width * height * 3 / 2;
+    uint8_t* image = static_cast<uint8_t*>(FramePool::singleton().alloc(size));
+    if (!image)
+        return false;
+    uint8_t* y = image;
+    uint8_t* u = image + width * height;
+    uint8_t* v = u + width / 2 * height / 2;
+    int stride = width * 2;
+    for (int row = 0; row < height; row += 2) {
+        const uint8_t* s0 = src + row * stride;
+        const uint8_t* s1 = s0 + stride;
+        uint8_t* y0 = y + row * width;
+        uint8_t* y1 = y0 + width;
+        for (int x = 0; x < width; x += 2) {
+            // Packed as Y0 U Y1 V; average chroma of the two lines.
+            y0[x] = s0[0];
+            y0[x + 1] = s0[2];
+            y1[x] = s1[0];
+            y1[x + 1] = s1[2];
+            *u++ = uint8_t((s0[1] + s1[1] + 1) >> 1);
+            *v++ = uint8_t((s0[3] + s1[3] + 1) >> 1);
+            s0 += 4;
+            s1 += 4;
+        }
+    }
+    frame.set("image", image, size, FramePool::release);
+    frame.set("format", mlt_image_yuv420p);
+    return true;
+}
+
 void FrameRenderer::showFrame(Mlt::Frame frame)
 {
   //  LOG_DEBUG()<<"showFrame begins";
     int width = 0;
     int height = 0;
+    qint64 showTime = frame.get_int64(PlaybackStats::kShowTimeProperty);
 
     if (!Settings.playerGPU()) {
         // Convert the image format before creating the SharedFrame.
-        mlt_image_format format = mlt_image_yuv420p;
-        int width = 0;
-        int height = 0;
-        frame.get_image(format, width, height);
+        if (!convertToYuv420p(frame)) {
+            mlt_image_format format = mlt_image_yuv420p;
+            int width = 0;
+            int height = 0;
+            frame.get_image(format, width, height);
+        }
         m_displayFrame = SharedFrame(frame);
+        // Only frames shown while paused are cached; those are the ones
+        // revisited when scrubbing and frame stepping.
+        if (MLT.producer() && qFuzzyIsNull(MLT.producer()->get_speed())
+                && m_displayFrame.get_image_width() == MLT.profile().width())
+            MLT.frameCache().insert(m_displayFrame, quint32(frame.get_int(kFrameCacheRevisionProperty)));
     }
 
     Q_ASSERT(m_surface->surfaceHandle());
@@ -911,6 +1219,8 @@ void FrameRenderer::showFrame(Mlt::Frame frame)
 #else
             m_context->functions()->glFinish();
 #endif // USE_GL_FENCE
+            m_stats->record(PlaybackStats::UploadDone, showTime);
+            m_displayShowTime = showTime;
             emit textureReady(*textureId);
             m_context->doneCurrent();
 
@@ -919,19 +1229,8 @@ void FrameRenderer::showFrame(Mlt::Frame frame)
             qSwap(m_renderFrame, m_displayFrame);
         }
         else {
-            // Using a threaded OpenGL to upload textures.
-            m_context->makeCurrent(m_surface);
-            QOpenGLFunctions* f = m_context->functions();
-
-            uploadTextures(m_context, m_displayFrame, m_renderTexture);
-            f->glBindTexture(GL_TEXTURE_2D, 0);
-            check_error(f);
-            f->glFinish();
-
-            for (int i = 0; i < 3; ++i)
-                qSwap(m_renderTexture[i], m_displayTexture[i]);
-            emit textureReady(m_displayTexture[0], m_displayTexture[1], m_displayTexture[2]);
-            m_context->doneCurrent();
+            displayFrame(showTime);
+            return;
         }
 
         // Throttle the frequency of frameDisplayed signals to prevent them from
@@ -952,11 +1251,147 @@ void FrameRenderer::showFrame(Mlt::Frame frame)
   //  LOG_DEBUG()<<"showFrame ends";
 }
 
+// Upload m_displayFrame on the threaded OpenGL context, hand the textures to
+// GLWidget and release the renderer slot.
+void FrameRenderer::displayFrame(qint64 showTime)
+{
+    m_context->makeCurrent(m_surface);
+    QOpenGLFunctions* f = m_context->functions();
+
+    if (m_usePixelBuffers < 0) {
+        m_usePixelBuffers = initPixelBuffers();
+        resolveFenceFunctions(m_context);
+    }
+    if (m_usePixelBuffers)
+        uploadTexturesStreaming(m_displayFrame);
+    else
+        uploadTextures(m_context, m_displayFrame, m_renderTexture);
+    f->glBindTexture(GL_TEXTURE_2D, 0);
+    check_error(f);
+    if (FenceSync) {
+        // GLWidget::paintGL() waits on the fence; flush so that it gets to the GPU.
+        m_displayFence = FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        f->glFlush();
+    } else {
+        f->glFinish();
+    }
+
+    for (int i = 0; i < 3; ++i)
+        qSwap(m_renderTexture[i], m_displayTexture[i]);
+    qSwap(m_renderTextureSize, m_displayTextureSize);
+    m_stats->record(PlaybackStats::UploadDone, showTime);
+    m_displayShowTime = showTime;
+    emit textureReady(m_displayTexture[0], m_displayTexture[1], m_displayTexture[2]);
+    m_context->doneCurrent();
+
+    // Throttle the frequency of frameDisplayed signals to prevent them from
+    // interfering with timely and smooth video updates.
+    int elapsedMSecs = int(QDateTime::currentMSecsSinceEpoch() - m_previousMSecs);
+    if (elapsedMSecs >= FRAMEDISPLAYED_MIN_MS) {
+        m_previousMSecs = QDateTime::currentMSecsSinceEpoch();
+        // The frame is now done being modified and can be shared with the rest
+        // of the application.
+        emit frameDisplayed(m_displayFrame);
+    }
+
+    m_semaphore.release();
+}
+
+void FrameRenderer::showCachedFrame(const SharedFrame& frame)
+{
+    // Take a renderer slot like a consumer frame would; skip the cached
+    // frame rather than block if MLT frames are still queued.
+    if (!m_semaphore.tryAcquire())
+        return;
+    m_displayFrame = frame;
+    if (m_context && m_context->isValid()) {
+        displayFrame(PlaybackStats::now());
+    } else {
+        emit frameDisplayed(m_displayFrame);
+        m_semaphore.release();
+    }
+}
+
 SharedFrame FrameRenderer::getDisplayFrame()
 {
     return m_displayFrame;
 }
 
+GLsync FrameRenderer::takeDisplayFence()
+{
+    GLsync fence = m_displayFence;
+    m_displayFence = nullptr;
+    return fence;
+}
+
+// Must be called with m_context current.
+bool FrameRenderer::initPixelBuffers()
+{
+    Q_ASSERT(m_context);
+
+    if (!Settings.playerPixelBuffers())
+        return false;
+    // Pixel buffer objects are core since OpenGL 2.1, which includes Mesa llvmpipe.
+    // OpenGL ES 2 has no buffer mapping without extensions, so it keeps the old path.
+    if (m_context->isOpenGLES())
+        return false;
+    if (m_context->format().version() < qMakePair(2, 1)
+            && !m_context->hasExtension("GL_ARB_pixel_buffer_object"))
+        return false;
+
+    for (int i = 0; i < PixelBufferCount; ++i) {
+        m_pixelBuffers[i] = new QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer);
+        m_pixelBuffers[i]->setUsagePattern(QOpenGLBuffer::StreamDraw);
+        if (!m_pixelBuffers[i]->create()) {
+            LOG_WARNING() << "failed to create pixel buffer; using direct texture upload";
+            for (int j = 0; j <= i; ++j) {
+                delete m_pixelBuffers[j];
+                m_pixelBuffers[j] = nullptr;
+            }
+            return false;
+        }
+    }
+    m_pixelBufferIndex = 0;
+    LOG_INFO() << "using pixel buffer texture upload";
+    return true;
+}
+
+// Must be called with m_context current.
+void FrameRenderer::uploadTexturesStreaming(SharedFrame& frame)
+{
+    Q_ASSERT(frame.is_valid());
+    QOpenGLFunctions* f = m_context->functions();
+    Q_ASSERT(f);
+
+    int width = frame.get_image_width();
+    int height = frame.get_image_height();
+    int size = width * height + 2 * (width/2 * height/2);
+    const uint8_t* image = frame.get_image();
+
+    // Texture storage is only allocated when the resolution changes.
+    if (!m_renderTexture[0] || m_renderTextureSize != QSize(width, height)) {
+        allocateTextures(f, m_renderTexture, width, height);
+        m_renderTextureSize = QSize(width, height);
+    }
+
+    QOpenGLBuffer* buffer = m_pixelBuffers[m_pixelBufferIndex];
+    m_pixelBufferIndex = (m_pixelBufferIndex + 1) % PixelBufferCount;
+    buffer->bind();
+    // Orphan the previous storage so that mapping does not wait for the
+    // driver to finish a transfer still reading from this buffer.
+    buffer->allocate(size);
+    void* mapped = buffer->map(QOpenGLBuffer::WriteOnly);
+    if (mapped) {
+        memcpy(mapped, image, size_t(size));
+        buffer->unmap();
+        updateTextures(f, m_renderTexture, width, height, 0);
+        buffer->release();
+    } else {
+        buffer->release();
+        updateTextures(f, m_renderTexture, width, height, reinterpret_cast<quintptr>(image));
+    }
+}
+
 void FrameRenderer::cleanup()
 {
     LOG_DEBUG() << "begin";
@@ -969,6 +1404,26 @@ void FrameRenderer::cleanup()
         m_context->doneCurrent();
         m_renderTexture[0] = m_renderTexture[1] = m_renderTexture[2] = 0;
         m_displayTexture[0] = m_displayTexture[1] = m_displayTexture[2] = 0;
+        m_renderTextureSize = m_displayTextureSize = QSize();
+    }
+    if (m_pixelBuffers[0]) {
+        Q_ASSERT(m_context);
+        m_context->makeCurrent(m_surface);
+        for (int i = 0; i < PixelBufferCount; ++i) {
+            delete m_pixelBuffers[i];
+            m_pixelBuffers[i] = nullptr;
+        }
+        m_context->doneCurrent();
+        m_usePixelBuffers = -1;
+    }
+    if (m_displayFence) {
+        // The last upload's fence was never taken by GLWidget::updateTexture().
+        Q_ASSERT(m_context);
+        m_context->makeCurrent(m_surface);
+        if (DeleteSync)
+            DeleteSync(m_displayFence);
+        m_context->doneCurrent();
+        m_displayFence = nullptr;
     }
     LOG_DEBUG() << "end";
 }
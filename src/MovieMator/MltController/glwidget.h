@@ -29,13 +29,17 @@
 #include <QOpenGLFunctions>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLFramebufferObject>
+#include <QOpenGLBuffer>
 #include <QOpenGLContext>
 #include <QOffscreenSurface>
 #include <QMutex>
 #include <QThread>
+#include <QTimer>
 #include <QRect>
+#include <QSize>
 #include "mltcontroller.h"
 #include "sharedframe.h"
+#include "playbackstats.h"
 
 class QOpenGLFunctions_3_2_Core;
 class QOpenGLTexture;
@@ -67,19 +71,12 @@ public:
     int setProducer(Mlt::Producer*, bool isMulti = false);
     int reconfigure(bool isMulti);
 
-    void play(double speed = 1.0) {
-        Controller::play(speed);
-        if (qFuzzyIsNull(speed)) emit paused();
-        else emit playing();
-    }
-    void seek(int position) {
-        Controller::seek(position);
-        emit paused();
-    }
-    void pause() {
-        Controller::pause();
-        emit paused();
-    }
+    void play(double speed = 1.0);
+    void seek(int position);
+    void pause();
+    // 0 is automatic; 1, 2 or 4 divides the preview size while playing.
+    void setPreviewScale(int mode);
+    int previewScale() const { return m_previewScale; }
     int displayWidth() const { return m_rect.width(); }
     int displayHeight() const { return m_rect.height(); }
 
@@ -88,6 +85,7 @@ public:
     QRect rect() const { return m_rect; }
     float zoom() const { return m_zoom * MLT.profile().width() / m_rect.width(); }
     QPoint offset() const;
+    PlaybackStats* playbackStats() const { return m_playbackStats; }
 
     void setCommonProperties(QQmlContext* context);
 
@@ -136,6 +134,17 @@ private:
     QOpenGLContext* m_shareContext;
     SharedFrame m_sharedFrame;
     QMutex m_mutex;
+    PlaybackStats* m_playbackStats;
+    qint64 m_textureShowTime;   // written by the render thread, guarded by m_mutex
+    qint64 m_paintedShowTime;
+    GLsync m_textureFence;      // signaled when the upload of m_texture is done, guarded by m_mutex
+    int m_previewScaleMode;
+    int m_previewScale;
+    int m_autoPreviewScale;
+    QTimer m_previewScaleTimer;
+
+    bool applyPreviewScale(int scale);
+    void restoreFullResolution();
 
     static void on_frame_show(mlt_consumer, void* self, mlt_frame frame);
 
@@ -144,6 +153,7 @@ private slots:
     void resizeGL(int width, int height);
     void updateTexture(GLuint yName, GLuint uName, GLuint vName);
     void paintGL();
+    void adjustPreviewScale();
 
 protected:
     void resizeEvent(QResizeEvent* event);
@@ -173,12 +183,18 @@ class FrameRenderer : public QThread
 {
     Q_OBJECT
 public:
-    FrameRenderer(QOpenGLContext* shareContext, QSurface* surface);
+    FrameRenderer(QOpenGLContext* shareContext, QSurface* surface, PlaybackStats* stats);
     ~FrameRenderer();
     QSemaphore* semaphore() { return &m_semaphore; }
     QOpenGLContext* context() const { return m_context; }
     SharedFrame getDisplayFrame();
+    // consumer-frame-show time of the frame whose textures were last emitted.
+    qint64 displayShowTime() const { return m_displayShowTime; }
+    // The fence following the upload of the textures last emitted, or null.
+    // The caller owns it. Call from a slot connected to textureReady().
+    GLsync takeDisplayFence();
     Q_INVOKABLE void showFrame(Mlt::Frame frame);
+    Q_INVOKABLE void showCachedFrame(const SharedFrame& frame);
 
 public slots:
     void cleanup();
@@ -188,12 +204,27 @@ signals:
     void frameDisplayed(const SharedFrame& frame);
 
 private:
+    // Number of pixel unpack buffers cycled by the streaming upload path.
+    enum { PixelBufferCount = 3 };
+
+    bool initPixelBuffers();
+    void uploadTexturesStreaming(SharedFrame& frame);
+    void displayFrame(qint64 showTime);
+
     QSemaphore m_semaphore;
     SharedFrame m_renderFrame;
     SharedFrame m_displayFrame;
     QOpenGLContext* m_context;
     QSurface* m_surface;
     qint64 m_previousMSecs;
+    PlaybackStats* m_stats;
+    qint64 m_displayShowTime;
+    GLsync m_displayFence;
+    QOpenGLBuffer* m_pixelBuffers[PixelBufferCount];
+    int m_pixelBufferIndex;
+    int m_usePixelBuffers; // -1 until probed on the render context
+    QSize m_renderTextureSize;
+    QSize m_displayTextureSize;
 public:
     GLuint m_renderTexture[3];
     GLuint m_displayTexture[3];
@@ -25,11 +25,13 @@
 #include <QMetaType>
 #include <QFileInfo>
 #include <QUuid>
+#include <algorithm>
 #include <Logger.h>
 #include <Mlt.h>
 #include "glwidget.h"
 #include "settings.h"
 #include "shotcut_mlt_properties.h"
+#include "mediahash.h"
 //#include "mltqtmodule.h"
 #include "qmlutilities.h"
 #include <util.h>
@@ -56,6 +58,7 @@ Controller::Controller()
     m_profile = new Mlt::Profile("atsc_720p_24");
     Q_ASSERT(m_profile);
     updateAvformatCaching(0);
+    m_frameCache.setBudget(Settings.playerGPU()? 0 : Settings.playerFrameCacheSize());
     LOG_DEBUG() << "end";
 }
 
@@ -90,6 +93,11 @@ int Controller::setProducer(Mlt::Producer* producer, bool)
         close();
     if (producer && producer->is_valid()) {
         m_producer = producer;
+        // The key lives on the underlying service so that wrappers of the
+        // same tractor or clip share cached frames.
+        if (!m_producer->get(kFrameCacheKeyProperty))
+            m_producer->set(kFrameCacheKeyProperty, QUuid::createUuid().toByteArray().constData());
+        m_frameCache.setProducer(QString::fromLatin1(m_producer->get(kFrameCacheKeyProperty)));
     }
     else {
         // Cleanup on error
@@ -254,7 +262,7 @@ void Controller::play(double speed)
                 m_consumer->stop();
         }
         m_consumer->start();
-        refreshConsumer(Settings.playerScrubAudio());
+        refresh(Settings.playerScrubAudio());
     }
     if (m_jackFilter)
         m_jackFilter->fire_event("jack-start");
@@ -310,7 +318,7 @@ void Controller::onJackStarted(int position)
     if (m_producer) {
         m_producer->set_speed(1);
         m_producer->seek(position);
-        refreshConsumer();
+        refresh(false);
     }
 }
 
@@ -335,7 +343,7 @@ void Controller::onJackStopped(int position)
     }
     if (m_consumer && m_consumer->get_int("real_time") >= -1)
         m_consumer->purge();
-    refreshConsumer();
+    refresh(false);
 }
 
 bool Controller::enableJack(bool enable)
@@ -397,7 +405,7 @@ double Controller::volume() const
 
 void Controller::onWindowResize()
 {
-    refreshConsumer();
+    refresh(false);
 }
 
 void Controller::seek(int position)
@@ -420,7 +428,7 @@ void Controller::seek(int position)
                 m_consumer->start();
             } else {
                 m_consumer->purge();
-                refreshConsumer(Settings.playerScrubAudio());
+                refresh(Settings.playerScrubAudio());
             }
         }
     }
@@ -430,6 +438,17 @@ void Controller::seek(int position)
 }
 
 void Controller::refreshConsumer(bool scrubAudio)
+{
+    m_frameCache.invalidate();
+    refresh(scrubAudio);
+}
+
+void Controller::invalidateFrameCache(int in, int out)
+{
+    m_frameCache.invalidate(in, out);
+}
+
+void Controller::refresh(bool scrubAudio)
 {
     LOG_DEBUG() << "begin";
     if (m_consumer) {
@@ -841,6 +860,65 @@ QImage Controller::image(Producer& producer, int frameNumber, int width, int hei
     return result;
 }
 
+void Controller::images(Producer& producer, QList<int> frameNumbers, int width, int height,
+                        const ImageCallback& callback)
+{
+    Q_ASSERT(producer.is_valid());
+    // In ascending order avformat decodes forward from the previous frame
+    // instead of seeking back to a key frame for every image.
+    std::sort(frameNumbers.begin(), frameNumbers.end());
+    frameNumbers.erase(std::unique(frameNumbers.begin(), frameNumbers.end()), frameNumbers.end());
+
+    int length = producer.get_length();
+    int next = 0;
+    foreach (int frameNumber, frameNumbers) {
+        // Like image(), prime the decoder a couple of frames before the end.
+        if (frameNumber > length - 3) {
+            for (int i = qMax(next, frameNumber - 2); i < frameNumber; ++i) {
+                producer.seek(i);
+                Mlt::Frame* frame = producer.get_frame();
+                image(frame, width, height);
+                delete frame;
+            }
+        }
+        producer.seek(frameNumber);
+        Mlt::Frame* frame = producer.get_frame();
+        QImage result = image(frame, width, height);
+        delete frame;
+        next = frameNumber + 1;
+        if (!callback(frameNumber, result))
+            break;
+    }
+}
+
+QList<QImage> Controller::images(Producer& producer, QList<int> frameNumbers, int width, int height)
+{
+    QList<QImage> result;
+    images(producer, frameNumbers, width, height, [&result](int, const QImage& image) {
+        result << image;
+        return true;
+    });
+    return result;
+}
+
+Producer* Controller::thumbnailProducer(Profile& profile, QString service, const char* resource)
+{
+    if (service == "avformat-novalidate")
+        service = "avformat";
+    else if (service.startsWith("xml"))
+        service = "xml-nogl";
+    Mlt::Producer* producer = new Mlt::Producer(profile, service.toUtf8().constData(), resource);
+    if (producer->is_valid()) {
+        Mlt::Filter scaler(profile, "swscale");
+        Mlt::Filter padder(profile, "resize");
+        Mlt::Filter converter(profile, "avcolor_space");
+        producer->attach(scaler);
+        producer->attach(padder);
+        producer->attach(converter);
+    }
+    return producer;
+}
+
 void Controller::updateAvformatCaching(int trackCount)
 {
     int i = QThread::idealThreadCount() + trackCount;
@@ -937,25 +1015,32 @@ void Controller::setSavedProducer(Mlt::Producer* producer)
     m_savedProducer.reset(new Mlt::Producer(producer));
 }
 
-QString Controller::getHash(Mlt::Properties& properties) const
+QString Controller::getHash(Mlt::Properties& properties, bool wait) const
 {
     Q_ASSERT(properties.is_valid());
     QString hash = properties.get(kShotcutHashProperty);
     if (hash.isEmpty()) {
-        QString service = properties.get("mlt_service");
-        QString resource = QString::fromUtf8(properties.get("resource"));
-
-        if (service == "timewarp")
-            resource = QString::fromUtf8(properties.get("warp_resource"));
-        else if (service == "vidstab")
-            resource = QString::fromUtf8(properties.get("filename"));
-        QString hash = Util::getFileHash(resource);
+        QString resource = hashResource(properties);
+        MediaHash& mediaHash = MediaHash::singleton();
+        hash = wait? mediaHash.hash(resource) : mediaHash.cached(resource);
         if (!hash.isEmpty())
             properties.set(kShotcutHashProperty, hash.toLatin1().constData());
+        else if (!wait)
+            mediaHash.hashAsync(resource);
     }
     return hash;
 }
 
+QString Controller::hashResource(Mlt::Properties& properties)
+{
+    QString service = properties.get("mlt_service");
+    if (service == "timewarp")
+        return QString::fromUtf8(properties.get("warp_resource"));
+    else if (service == "vidstab")
+        return QString::fromUtf8(properties.get("filename"));
+    return QString::fromUtf8(properties.get("resource"));
+}
+
 
 const QString& Controller::MltXMLMimeType()
 {
@@ -25,11 +25,14 @@
 #include "mltcontroller_global.h"
 
 #include <QImage>
+#include <QList>
 #include <QString>
 #include <QUuid>
 #include <QScopedPointer>
 #include <Mlt.h>
 #include "transportcontrol.h"
+#include "framecache.h"
+#include <functional>
 
 // forward declarations
 class QQuickView;
@@ -83,7 +86,12 @@ public:
     double volume() const;
     void onWindowResize();
     virtual void seek(int position);
+    // Redraw the current frame after an edit; this also invalidates cached frames.
     void refreshConsumer(bool scrubAudio = false);
+    // Drop the cached frames of [in, out] (out -1 is the end) after an edit
+    // that changed only that range; frames elsewhere stay cached.
+    void invalidateFrameCache(int in = 0, int out = -1);
+    FrameCache& frameCache() { return m_frameCache; }
     void saveXML(const QString& filename, Service* service = nullptr, bool withRelativePaths = true);
     QString XML(Service* service = nullptr);
 
@@ -109,8 +117,20 @@ public:
     void setOut(int);
     void restart();
     void resetURL();
+    void setURL(const QString& url) { m_url = url; }
     QImage image(Frame *frame, int width, int height);
     QImage image(Mlt::Producer& producer, int frameNumber, int width, int height);
+    // Called for each decoded frame of images(); return false to stop early.
+    typedef std::function<bool(int frameNumber, const QImage& image)> ImageCallback;
+    // Decode several frames of one producer in a single forward pass. The
+    // frame numbers are sorted and duplicates dropped; the callback is called
+    // on the calling thread in ascending frame order.
+    void images(Mlt::Producer& producer, QList<int> frameNumbers, int width, int height,
+                const ImageCallback& callback);
+    QList<QImage> images(Mlt::Producer& producer, QList<int> frameNumbers, int width, int height);
+    // A new producer for thumbnails of the resource with the scaling and
+    // colorspace filters attached, to be reused for all its frames.
+    static Mlt::Producer* thumbnailProducer(Mlt::Profile& profile, QString service, const char* resource);
     void updateAvformatCaching(int trackCount);
     bool isAudioFilter(const QString& name);
     int realTime() const;
@@ -144,7 +164,12 @@ public:
     void setSavedProducer(Mlt::Producer* producer);
 
     virtual void setCommonProperties(QQmlContext* context) = 0;
-    QString getHash(Mlt::Properties& properties) const;
+    // The media hash, computed and stored in the properties if missing. Unless
+    // wait is set, a hash that is not known yet is computed in the background
+    // and an empty string is returned; MediaHash::hashReady() tells when.
+    QString getHash(Mlt::Properties& properties, bool wait = true) const;
+    // The file whose hash identifies the service.
+    static QString hashResource(Mlt::Properties& properties);
 
     const QString& MltXMLMimeType();
 
@@ -153,9 +178,13 @@ private:
     QString getXMLWithoutProfile(QString &strXml);
 
 protected:
+    // Ask a paused consumer to render the current position again.
+    void refresh(bool scrubAudio);
+
     Mlt::Repository* m_repo;
     Mlt::Producer* m_producer;
     Mlt::FilteredConsumer* m_consumer;
+    FrameCache m_frameCache;
 
 private:
     Mlt::Profile* m_profile;
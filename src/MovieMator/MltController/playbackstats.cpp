@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "playbackstats.h"
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <algorithm>
+
+const char* PlaybackStats::kShowTimeProperty = "moviemator.show_time";
+
+static const char* stageNames[PlaybackStats::StageCount] = {
+    "acquire", "upload", "texture", "paint"
+};
+
+PlaybackStats::PlaybackStats(QObject* parent)
+    : QObject(parent)
+    , m_dropNext(0)
+    , m_dropped(0)
+    , m_displayed(0)
+{
+    for (int i = 0; i < StageCount; ++i) {
+        m_samples[i].reserve(WindowSize);
+        m_next[i] = 0;
+    }
+    m_dropWindow.reserve(WindowSize);
+}
+
+static QElapsedTimer startedTimer()
+{
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+}
+
+qint64 PlaybackStats::now()
+{
+    static const QElapsedTimer timer = startedTimer();
+    return timer.nsecsElapsed() / 1000;
+}
+
+void PlaybackStats::record(Stage stage, qint64 showTime)
+{
+    if (showTime <= 0 || stage < 0 || stage >= StageCount)
+        return;
+    float ms = float(now() - showTime) / 1000.0f;
+    QMutexLocker locker(&m_mutex);
+    QVector<float>& samples = m_samples[stage];
+    if (samples.size() < WindowSize) {
+        samples.append(ms);
+    } else {
+        samples[m_next[stage]] = ms;
+        m_next[stage] = (m_next[stage] + 1) % WindowSize;
+    }
+    if (stage == SemaphoreAcquired) {
+        if (m_dropWindow.size() < WindowSize) {
+            m_dropWindow.append(0);
+        } else {
+            m_dropWindow[m_dropNext] = 0;
+            m_dropNext = (m_dropNext + 1) % WindowSize;
+        }
+    } else if (stage == Painted) {
+        ++m_displayed;
+        locker.unlock();
+        emit updated();
+    }
+}
+
+void PlaybackStats::recordDropped()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_dropped;
+    if (m_dropWindow.size() < WindowSize) {
+        m_dropWindow.append(1);
+    } else {
+        m_dropWindow[m_dropNext] = 1;
+        m_dropNext = (m_dropNext + 1) % WindowSize;
+    }
+    locker.unlock();
+    emit updated();
+}
+
+int PlaybackStats::droppedFrames() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_dropped;
+}
+
+int PlaybackStats::displayedFrames() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_displayed;
+}
+
+double PlaybackStats::percentile(int stage, double percent) const
+{
+    if (stage < 0 || stage >= StageCount)
+        return 0.0;
+    QVector<float> samples;
+    {
+        QMutexLocker locker(&m_mutex);
+        samples = m_samples[stage];
+    }
+    if (samples.isEmpty())
+        return 0.0;
+    int n = qBound(0, int(percent / 100.0 * (samples.size() - 1) + 0.5), samples.size() - 1);
+    std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+    return double(samples[n]);
+}
+
+double PlaybackStats::droppedRate() const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_dropWindow.isEmpty())
+        return 0.0;
+    int count = 0;
+    foreach (char dropped, m_dropWindow)
+        count += dropped;
+    return double(count) / m_dropWindow.size();
+}
+
+int PlaybackStats::droppedWindowSize() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_dropWindow.size();
+}
+
+void PlaybackStats::resetDroppedWindow()
+{
+    QMutexLocker locker(&m_mutex);
+    m_dropWindow.clear();
+    m_dropNext = 0;
+}
+
+QString PlaybackStats::summary() const
+{
+    QString result;
+    for (int i = 0; i < StageCount; ++i) {
+        result += QString("%1 p50 %2 p95 %3 p99 %4 ms\n")
+                .arg(QString::fromLatin1(stageNames[i]), -8)
+                .arg(percentile(i, 50), 6, 'f', 1)
+                .arg(percentile(i, 95), 6, 'f', 1)
+                .arg(percentile(i, 99), 6, 'f', 1);
+    }
+    result += QString("dropped %1 of %2 (%3%)")
+            .arg(droppedFrames())
+            .arg(droppedFrames() + displayedFrames())
+            .arg(droppedRate() * 100.0, 0, 'f', 1);
+    return result;
+}
+
+void PlaybackStats::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < StageCount; ++i) {
+        m_samples[i].clear();
+        m_next[i] = 0;
+    }
+    m_dropWindow.clear();
+    m_dropNext = 0;
+    m_dropped = 0;
+    m_displayed = 0;
+    locker.unlock();
+    emit updated();
+}
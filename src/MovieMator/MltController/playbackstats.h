@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYBACKSTATS_H
+#define PLAYBACKSTATS_H
+
+#include "mltcontroller_global.h"
+
+#include <QObject>
+#include <QMutex>
+#include <QVector>
+#include <QString>
+
+/*!
+  \class PlaybackStats
+  \brief Collects per-stage latency of preview frames on their way to the screen.
+
+  \threadsafe
+
+  Every rendered frame is stamped with the time the consumer fired
+  consumer-frame-show. Each later stage records its latency relative to
+  that stamp into a fixed-size window, and percentiles are computed over
+  the most recent samples on request. Frames that could not enter the
+  FrameRenderer queue are counted as dropped.
+*/
+
+class MLTCONTROLLERSHARED_EXPORT PlaybackStats : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int droppedFrames READ droppedFrames NOTIFY updated)
+    Q_PROPERTY(int displayedFrames READ displayedFrames NOTIFY updated)
+    Q_PROPERTY(QString summary READ summary NOTIFY updated)
+
+public:
+    enum Stage {
+        SemaphoreAcquired = 0, // GLWidget::on_frame_show got a renderer slot
+        UploadDone,            // FrameRenderer::showFrame finished the upload
+        TextureReady,          // GLWidget received the new textures
+        Painted,               // GLWidget::paintGL drew the frame
+        StageCount
+    };
+    Q_ENUMS(Stage)
+
+    // Name of the frame property holding the consumer-frame-show timestamp.
+    static const char* kShowTimeProperty;
+
+    explicit PlaybackStats(QObject* parent = nullptr);
+
+    // Monotonic time in microseconds used for all stage timestamps.
+    static qint64 now();
+
+    void record(Stage stage, qint64 showTime);
+    void recordDropped();
+
+    int droppedFrames() const;
+    int displayedFrames() const;
+    QString summary() const;
+
+    // Latency in milliseconds at the given percentile (0-100) of the window.
+    Q_INVOKABLE double percentile(int stage, double percent) const;
+    Q_INVOKABLE double droppedRate() const;
+    // Number of frames the dropped rate is currently computed over.
+    int droppedWindowSize() const;
+    void resetDroppedWindow();
+    Q_INVOKABLE void reset();
+
+signals:
+    void updated();
+
+private:
+    enum { WindowSize = 240 };
+
+    mutable QMutex m_mutex;
+    QVector<float> m_samples[StageCount];
+    int m_next[StageCount];
+    // One entry per frame that reached the consumer: 1 if it was dropped.
+    QVector<char> m_dropWindow;
+    int m_dropNext;
+    int m_dropped;
+    int m_displayed;
+};
+
+#endif // PLAYBACKSTATS_H
@@ -16,6 +16,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "sharedframe.h"
+#include "framepool.h"
 
 #pragma pack(4)
 /**
@@ -93,9 +94,9 @@ Mlt::Frame SharedFrame::clone(bool audio, bool image, bool alpha) const
                                          get_audio_samples(),
                                          get_audio_channels());
         }
-        copy = mlt_pool_alloc(size);
+        copy = FramePool::singleton().alloc(size);
         memcpy(copy, data, size_t(size));
-        cloneFrame.set("audio", copy, size, mlt_pool_release);
+        cloneFrame.set("audio", copy, size, FramePool::release);
     } else {
         cloneFrame.set("audio", 0);
         cloneFrame.set("audio_format", mlt_audio_none);
@@ -113,9 +114,9 @@ Mlt::Frame SharedFrame::clone(bool audio, bool image, bool alpha) const
                                          get_image_height(),
                                          nullptr);
         }
-        copy = mlt_pool_alloc(size);
+        copy = FramePool::singleton().alloc(size);
         memcpy(copy, data, size_t(size));
-        cloneFrame.set("image", copy, size, mlt_pool_release);
+        cloneFrame.set("image", copy, size, FramePool::release);
     } else {
         cloneFrame.set("image", 0);
         cloneFrame.set("image_format", mlt_image_none);
@@ -129,9 +130,9 @@ Mlt::Frame SharedFrame::clone(bool audio, bool image, bool alpha) const
         if (!size) {
             size = get_image_width() * get_image_height();
         }
-        copy = mlt_pool_alloc(size);
+        copy = FramePool::singleton().alloc(size);
         memcpy(copy, data, size_t(size));
-        cloneFrame.set("alpha", copy, size, mlt_pool_release);
+        cloneFrame.set("alpha", copy, size, FramePool::release);
     } else {
         cloneFrame.set("alpha", 0);
     }
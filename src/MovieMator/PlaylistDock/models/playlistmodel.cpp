@@ -73,22 +73,8 @@ public:
 
     Mlt::Producer* tempProducer()
     {
-        if (!m_tempProducer) {
-            QString service = m_producer.get("mlt_service");
-            if (service == "avformat-novalidate")
-                service = "avformat";
-            else if (service.startsWith("xml"))
-                service = "xml-nogl";
-            m_tempProducer = new Mlt::Producer(m_profile, service.toUtf8().constData(), m_producer.get("resource"));
-            if (m_tempProducer->is_valid()) {
-                Mlt::Filter scaler(m_profile, "swscale");
-                Mlt::Filter padder(m_profile, "resize");
-                Mlt::Filter converter(m_profile, "avcolor_space");
-                m_tempProducer->attach(scaler);
-                m_tempProducer->attach(padder);
-                m_tempProducer->attach(converter);
-            }
-        }
+        if (!m_tempProducer)
+            m_tempProducer = Mlt::Controller::thumbnailProducer(m_profile, m_producer.get("mlt_service"), m_producer.get("resource"));
         return m_tempProducer;
     }
 
@@ -124,37 +110,46 @@ public:
         int inPoint = qRound(m_in / MLT.profile().fps() * m_profile.fps());
         int outPoint = qRound(m_out / MLT.profile().fps() * m_profile.fps());
 
-        QImage image = DB.getThumbnail(cacheKey(inPoint));
-        if (image.isNull()) {
+        bool both = setting == "tall" || setting == "wide";
+        QStringList keys;
+        keys << cacheKey(inPoint);
+        if (both)
+            keys << cacheKey(outPoint);
+        QHash<QString, QImage> cached = DB.getThumbnails(keys);
+        QImage inImage = cached.value(cacheKey(inPoint));
+        QImage outImage = both? cached.value(cacheKey(outPoint)) : QImage();
+
+        // Decode whatever is missing from the cache in one pass.
+        QList<int> frames;
+        if (inImage.isNull())
+            frames << inPoint;
+        if (both && outImage.isNull())
+            frames << outPoint;
+        if (!frames.isEmpty() && tempProducer()->is_valid()) {
             LOG_DEBUG()<<"playlistmodel makeThumbnail is called";
-            image = makeThumbnail(inPoint);
-            m_producer.set(kThumbnailInProperty, new QImage(image), 0, (mlt_destructor) deleteQImage, NULL);
-            DB.putThumbnail(cacheKey(inPoint), image);
-        } else {
-            m_producer.set(kThumbnailInProperty, new QImage(image), 0, (mlt_destructor) deleteQImage, NULL);
+            int height = PlaylistModel::THUMBNAIL_HEIGHT * 2;
+            int width = PlaylistModel::THUMBNAIL_WIDTH * 2;
+            QHash<QString, QImage> made;
+            MLT.images(*tempProducer(), frames, width, height, [&](int frameNumber, const QImage& image) {
+                made.insert(cacheKey(frameNumber), image);
+                if (frameNumber == inPoint)
+                    inImage = image;
+                if (frameNumber == outPoint)
+                    outImage = image;
+                return true;
+            });
+            DB.putThumbnails(made);
         }
+
+        m_producer.set(kThumbnailInProperty, new QImage(inImage), 0, (mlt_destructor) deleteQImage, NULL);
         m_model->showThumbnail(m_row);
 
-        if (setting == "tall" || setting == "wide") {
-            image = DB.getThumbnail(cacheKey(outPoint));
-            if (image.isNull()) {
-                image = makeThumbnail(outPoint);
-                m_producer.set(kThumbnailOutProperty, new QImage(image), 0, (mlt_destructor) deleteQImage, NULL);
-                DB.putThumbnail(cacheKey(outPoint), image);
-            } else {
-                m_producer.set(kThumbnailOutProperty, new QImage(image), 0, (mlt_destructor) deleteQImage, NULL);
-            }
+        if (both) {
+            m_producer.set(kThumbnailOutProperty, new QImage(outImage), 0, (mlt_destructor) deleteQImage, NULL);
             m_model->showThumbnail(m_row);
         }
     }
 
-    QImage makeThumbnail(int frameNumber)
-    {
-        int height = PlaylistModel::THUMBNAIL_HEIGHT * 2;
-        int width = PlaylistModel::THUMBNAIL_WIDTH * 2;
-        return MLT.image(*tempProducer(), frameNumber, width, height);
-    }
-
 signals:
     void thumbnailUpdated(int row);
 };
@@ -219,7 +214,7 @@ QVariant PlaylistModel::data(const QModelIndex &index, int role) const
                     result = QString::fromUtf8(info->producer->get("mlt_service"));
             }
             if (!info->producer->get(kShotcutHashProperty))
-                MLT.getHash(*info->producer);
+                MLT.getHash(*info->producer, false);
             return result;
         }
         case COLUMN_IN:
@@ -15,12 +15,15 @@ AbstractCommand::AbstractCommand(MultitrackModel &modelMultitrack, QUndoCommand
     , m_modelMultitrack(modelMultitrack)
     , m_selectionOld(m_modelMultitrack.selection())
     , m_bisFirstRedo(true)
+    , m_discarded(false)
 {
     //Q_ASSERT(g_isInUndoRedoProcess == false); //UpdateClipCommand 创建后并不会立即push，此处添加assert创建UpdateClipCommand时会出错。在pushcommand的时候添加。
 }
 
 void AbstractCommand::redo()
 {
+    if (m_discarded)
+        return;
     g_isInUndoRedoProcess = true;
 
 //#ifndef NDEBUG
@@ -57,6 +60,10 @@ void AbstractCommand::redo()
 
 void AbstractCommand::undo()
 {
+    if (m_discarded) {
+        LOG_WARNING() << "undo data of" << text() << "was discarded";
+        return;
+    }
     g_isInUndoRedoProcess = true;
 
     //恢复选中状态
@@ -123,3 +130,21 @@ void AbstractCommand::undo()
 //    qDebug()<<"currrent:";
 //    qDebug()<<currrent;
 //}
+
+bool AbstractCommand::discard(QUndoCommand* command)
+{
+    bool result = false;
+    AbstractCommand* abstractCommand = dynamic_cast<AbstractCommand*>(command);
+    if (abstractCommand && !abstractCommand->m_discarded) {
+        abstractCommand->releaseUndoData();
+        abstractCommand->m_discarded = true;
+        result = true;
+    }
+    for (int i = 0; i < command->childCount(); ++i)
+        result |= discard(const_cast<QUndoCommand*>(command->child(i)));
+#if QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
+    // QUndoStack deletes an obsolete command instead of undoing it.
+    command->setObsolete(true);
+#endif
+    return result;
+}
@@ -16,6 +16,13 @@ public:
     virtual void redo_impl() = 0;
     virtual void undo_impl() = 0;
 
+    // 释放 command及其子 command撤销所需的数据，之后它不能再撤销。
+    // 用于把撤销历史限制在 Settings.undoMemoryLimit()之内，从最早的开始。
+    static bool discard(QUndoCommand* command);
+    bool isDiscarded() const { return m_discarded; }
+    // Drop the XML and snapshots kept for undo.
+    virtual void releaseUndoData() {}
+
 private:
     MultitrackModel     &m_modelMultitrack;
     QString             m_strXmlOriginal;
@@ -23,6 +30,7 @@ private:
     TIMELINE_SELECTION  m_selectionOld;
     TIMELINE_SELECTION  m_selectionNew;
     bool                m_bisFirstRedo;
+    bool                m_discarded;
 };
 
 #endif // ABSTRACTCOMMAND_H
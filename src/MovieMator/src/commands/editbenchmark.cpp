@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "editbenchmark.h"
+#include "timelinecommands.h"
+#include "mltcontroller.h"
+#include "shotcut_mlt_properties.h"
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QFile>
+#include <Logger.h>
+#include <algorithm>
+
+static const int kClipLength = 50;
+static const int kGapLength = 24;
+static const int kGroupSize = 10;
+
+static QJsonObject summarize(QVector<qint64> nanoseconds)
+{
+    QJsonObject result;
+    if (nanoseconds.isEmpty())
+        return result;
+    std::sort(nanoseconds.begin(), nanoseconds.end());
+    const int n = nanoseconds.size();
+    qint64 total = 0;
+    foreach (qint64 t, nanoseconds)
+        total += t;
+    result["p50_us"] = nanoseconds.at(n / 2) / 1000.0;
+    result["p99_us"] = nanoseconds.at(qMin(n - 1, n * 99 / 100)) / 1000.0;
+    result["mean_us"] = total / n / 1000.0;
+    result["max_us"] = nanoseconds.last() / 1000.0;
+    return result;
+}
+
+EditBenchmark::EditBenchmark(int tracks, int clipsPerTrack)
+    : m_tracks(qMax(2, tracks))
+    , m_clipsPerTrack(qMax(3 * kGroupSize, clipsPerTrack))
+    , m_seed(1)
+{
+}
+
+void EditBenchmark::build()
+{
+    m_model.createIfNeeded();
+    while (m_model.trackList().size() < m_tracks)
+        m_model.addVideoTrack();
+    Mlt::Producer color(MLT.profile(), "color", "black");
+    Mlt::Producer noise(MLT.profile(), "noise");
+    color.set(kShotcutCaptionProperty, "benchmark");
+    noise.set(kShotcutCaptionProperty, "benchmark");
+    for (int i = 0; i < m_model.trackList().size(); ++i) {
+        QScopedPointer<Mlt::Producer> track(m_model.tractor()->track(m_model.trackList().at(i).mlt_index));
+        Mlt::Playlist playlist(*track);
+        playlist.clear();
+        Mlt::Producer& producer = (i % 2)? noise : color;
+        for (int c = 0; c < m_clipsPerTrack; ++c) {
+            if (c % kGroupSize == kGroupSize - 1)
+                playlist.blank(kGapLength - 1);
+            else
+                playlist.append(producer, 0, kClipLength - 1);
+        }
+    }
+}
+
+int EditBenchmark::random(int bound)
+{
+    // Deterministic, so that runs edit the same clips.
+    m_seed = m_seed * 1103515245u + 12345u;
+    return int((m_seed >> 16) % quint32(bound));
+}
+
+QJsonObject EditBenchmark::measure(const QString& name, int iterations, Factory factory)
+{
+    QVector<qint64> done, undone, redone;
+    int skipped = 0;
+    QElapsedTimer timer;
+    // Leave the first and last groups alone; edits there hit the ends of the track.
+    const int groups = m_clipsPerTrack / kGroupSize - 2;
+    for (int i = 0; i < iterations; ++i) {
+        int trackIndex = random(m_model.trackList().size());
+        int group = (1 + random(groups)) * kGroupSize;
+        AbstractCommand* command = factory(trackIndex, group);
+        if (!command) {
+            ++skipped;
+            continue;
+        }
+        timer.start();
+        m_undoStack.push(command);
+        done << timer.nsecsElapsed();
+        timer.start();
+        m_undoStack.undo();
+        undone << timer.nsecsElapsed();
+        timer.start();
+        m_undoStack.redo();
+        redone << timer.nsecsElapsed();
+        m_undoStack.undo();
+    }
+    QJsonObject result;
+    result["name"] = name;
+    result["samples"] = done.size();
+    result["skipped"] = skipped;
+    result["do"] = summarize(done);
+    result["undo"] = summarize(undone);
+    result["redo"] = summarize(redone);
+    LOG_INFO() << "edit benchmark:" << name
+               << QString("%1 tracks x %2 clips, %3 iterations").arg(m_tracks).arg(m_clipsPerTrack).arg(iterations)
+               << "p50/p99 us do"
+               << result["do"].toObject()["p50_us"].toDouble() << result["do"].toObject()["p99_us"].toDouble()
+               << "undo" << result["undo"].toObject()["p50_us"].toDouble() << result["undo"].toObject()["p99_us"].toDouble()
+               << "redo" << result["redo"].toObject()["p50_us"].toDouble() << result["redo"].toObject()["p99_us"].toDouble();
+    return result;
+}
+
+bool EditBenchmark::run(int iterations, const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        LOG_WARNING() << "edit benchmark: cannot write" << fileName;
+        return false;
+    }
+    build();
+
+    Mlt::Producer clip(MLT.profile(), "color", "white");
+    clip.set(kShotcutCaptionProperty, "benchmark");
+    clip.set_in_and_out(0, kClipLength - 1);
+    const QString clipXml = MLT.XML(&clip);
+    MultitrackModel& model = m_model;
+    auto trimIn = [&model](bool ripple) {
+        return [&model, ripple](int trackIndex, int group) -> AbstractCommand* {
+            int clipIndex = group + 4;
+            if (!model.trimClipInValid(trackIndex, clipIndex, 5, ripple))
+                return nullptr;
+            return new Timeline::TrimClipInCommand(model, trackIndex, clipIndex, 5, ripple);
+        };
+    };
+    auto trimOut = [&model](bool ripple) {
+        return [&model, ripple](int trackIndex, int group) -> AbstractCommand* {
+            int clipIndex = group + 4;
+            if (!model.trimClipOutValid(trackIndex, clipIndex, 5, ripple))
+                return nullptr;
+            return new Timeline::TrimClipOutCommand(model, trackIndex, clipIndex, 5, ripple);
+        };
+    };
+
+    QJsonArray cases;
+    // The clip before a gap moves into it.
+    cases << measure("moveClip", iterations, [&model](int trackIndex, int group) -> AbstractCommand* {
+        int clipIndex = group + kGroupSize - 2;
+        int position = model.getStartPositionOfClip(trackIndex, clipIndex) + kGapLength / 2;
+        if (!model.moveClipValid(trackIndex, trackIndex, clipIndex, position))
+            return nullptr;
+        return new Timeline::MoveClipCommand(model, trackIndex, trackIndex, clipIndex, position);
+    });
+    cases << measure("trimClipIn", iterations, trimIn(false));
+    cases << measure("trimClipInRipple", iterations, trimIn(true));
+    cases << measure("trimClipOut", iterations, trimOut(false));
+    cases << measure("trimClipOutRipple", iterations, trimOut(true));
+    cases << measure("splitClip", iterations, [&model](int trackIndex, int group) -> AbstractCommand* {
+        int clipIndex = group + 4;
+        int position = model.getStartPositionOfClip(trackIndex, clipIndex) + kClipLength / 2;
+        return new Timeline::SplitCommand(model, trackIndex, clipIndex, position);
+    });
+    cases << measure("insertClip", iterations, [&model, &clipXml](int trackIndex, int group) -> AbstractCommand* {
+        int position = model.getStartPositionOfClip(trackIndex, group + 4);
+        return new Timeline::InsertClipCommand(model, trackIndex, position, clipXml);
+    });
+    // A clip dragged over the end of the one before it.
+    cases << measure("addTransition", iterations, [&model](int trackIndex, int group) -> AbstractCommand* {
+        int clipIndex = group + 4;
+        int position = model.getStartPositionOfClip(trackIndex, clipIndex) - kClipLength / 5;
+        if (!model.addTransitionValid(trackIndex, trackIndex, clipIndex, position))
+            return nullptr;
+        return new Timeline::AddTransitionCommand(model, trackIndex, clipIndex, position);
+    });
+    cases << measure("removeTrack", iterations, [&model](int trackIndex, int) -> AbstractCommand* {
+        return new Timeline::RemoveTrackCommand(model, trackIndex);
+    });
+
+    QJsonObject report;
+    report["benchmark"] = "timeline-edits";
+    report["tracks"] = m_tracks;
+    report["clipsPerTrack"] = m_clipsPerTrack;
+    report["iterations"] = iterations;
+    report["fps"] = MLT.profile().fps();
+    report["cases"] = cases;
+    file.write(QJsonDocument(report).toJson());
+    LOG_INFO() << "edit benchmark: report written to" << fileName;
+    return true;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef EDITBENCHMARK_H
+#define EDITBENCHMARK_H
+
+#include "models/multitrackmodel.h"
+#include <QUndoStack>
+#include <QJsonObject>
+#include <functional>
+
+class AbstractCommand;
+
+/*!
+  \class EditBenchmark
+  \brief Times timeline edits on a synthetic project and reports them as JSON.
+
+  The project is built in a model of its own, tracks of color and noise
+  clips with a gap every tenth clip, so no media files are needed and the
+  open project is not touched.
+
+  Every case edits a pseudo-random clip through its Timeline command, then
+  undoes, redoes and undoes it again, so each sample starts from the same
+  project. "do" is the first redo as the command is pushed, which is the
+  model operation plus the undo snapshots. The report has the median, 99th
+  percentile, mean and maximum of each in microseconds.
+
+  \threadsafe Use from the main thread only.
+*/
+class EditBenchmark
+{
+public:
+    // At least 2 tracks and 30 clips per track are built.
+    EditBenchmark(int tracks, int clipsPerTrack);
+
+    // Runs every case iterations times; false if fileName cannot be written.
+    bool run(int iterations, const QString& fileName);
+
+private:
+    // The command for a sample on clips [group, group + 9) of trackIndex, the
+    // clip at group + 9 being a gap; nullptr if the edit is not valid there.
+    typedef std::function<AbstractCommand*(int trackIndex, int group)> Factory;
+
+    void build();
+    QJsonObject measure(const QString& name, int iterations, Factory factory);
+    int random(int bound);
+
+    MultitrackModel m_model;
+    QUndoStack m_undoStack;
+    int m_tracks;
+    int m_clipsPerTrack;
+    quint32 m_seed;
+};
+
+#endif // EDITBENCHMARK_H
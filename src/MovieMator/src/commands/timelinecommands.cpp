@@ -50,7 +50,7 @@ AppendClipCommand::AppendClipCommand(MultitrackModel &model, int trackIndex, con
     , m_model(model)
     , m_trackIndex(trackIndex)
     , m_xml(xml)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
 {
     setText(QObject::tr("Append to track"));
 }
@@ -61,7 +61,7 @@ void AppendClipCommand::redo_impl()
     LOG_DEBUG() << "trackIndex" << m_trackIndex;
 
     m_undoHelper.recordBeforeState();
-    Mlt::Producer producer(MLT.profile(), "xml-string", m_xml.toUtf8().constData());
+    Mlt::Producer producer(MLT.profile(), "xml-string", m_xml.toString().toUtf8().constData());
     Q_ASSERT(producer.is_valid());
     m_model.appendClip(m_trackIndex, producer);
     m_undoHelper.recordAfterState();
@@ -80,7 +80,7 @@ InsertClipCommand::InsertClipCommand(MultitrackModel &model, int trackIndex,
     , m_trackIndex(trackIndex)
     , m_position(position)
     , m_xml(xml)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
 {
     setText(QObject::tr("Insert into track"));
 }
@@ -89,7 +89,7 @@ void InsertClipCommand::redo_impl()
 {
     LOG_DEBUG() << "trackIndex" << m_trackIndex << "position" << m_position;
     m_undoHelper.recordBeforeState();
-    Mlt::Producer clip(MLT.profile(), "xml-string", m_xml.toUtf8().constData());
+    Mlt::Producer clip(MLT.profile(), "xml-string", m_xml.toString().toUtf8().constData());
     Q_ASSERT(clip.is_valid());
     m_model.insertClip(m_trackIndex, clip, m_position);
     m_undoHelper.recordAfterState();
@@ -108,7 +108,7 @@ OverwriteClipCommand::OverwriteClipCommand(MultitrackModel &model, int trackInde
     , m_trackIndex(trackIndex)
     , m_position(position)
     , m_xml(xml)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
 {
     setText(QObject::tr("Overwrite onto track"));
 }
@@ -117,7 +117,7 @@ void OverwriteClipCommand::redo_impl()
 {
     LOG_DEBUG() << "trackIndex" << m_trackIndex << "position" << m_position;
     m_undoHelper.recordBeforeState();
-    Mlt::Producer clip(MLT.profile(), "xml-string", m_xml.toUtf8().constData());
+    Mlt::Producer clip(MLT.profile(), "xml-string", m_xml.toString().toUtf8().constData());
     Q_ASSERT(clip.is_valid());
     m_playlistXml = m_model.overwrite(m_trackIndex, clip, m_position);
     m_undoHelper.recordAfterState();
@@ -136,7 +136,7 @@ LiftClipCommand::LiftClipCommand(MultitrackModel &model, TimelineDock &timeline,
     , m_trackIndex(trackIndex)
     , m_clipIndex(clipIndex)
     , m_xml(xml)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
     , m_timeline(timeline)
 {
     setText(QObject::tr("Lift from track"));
@@ -166,7 +166,7 @@ RemoveClipCommand::RemoveClipCommand(MultitrackModel &model, TimelineDock& timel
     , m_trackIndex(trackIndex)
     , m_clipIndex(clipIndex)
     , m_xml(xml)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
     , m_timeline(timeline)
 {
     setText(QObject::tr("Remove from track"));
@@ -309,7 +309,7 @@ MoveClipCommand::MoveClipCommand(MultitrackModel &model, int fromTrackIndex, int
         m_model.index(clipIndex, 0, m_model.index(fromTrackIndex)),
             MultitrackModel::StartRole).toInt())
     , m_toStart(position)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
 {
     setText(QObject::tr("Move clip"));
 }
@@ -339,7 +339,7 @@ TrimClipInCommand::TrimClipInCommand(MultitrackModel &model, int trackIndex, int
     , m_originalClipIndex(clipIndex)
     , m_delta(delta)
     , m_ripple(ripple)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
 {
     setText(QObject::tr("Trim clip in point"));
     if (!ripple)
@@ -380,7 +380,7 @@ TrimClipOutCommand::TrimClipOutCommand(MultitrackModel &model, int trackIndex, i
     , m_clipIndex(clipIndex)
     , m_delta(delta)
     , m_ripple(ripple)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
 {
     setText(QObject::tr("Trim clip out point"));
     if (!ripple)
@@ -516,7 +516,7 @@ AddTransitionCommand::AddTransitionCommand(MultitrackModel &model, int trackInde
     , m_clipIndex(clipIndex)
     , m_position(position)
     , m_transitionIndex(-1)
-    , m_undoHelper(model)
+    , m_undoHelper(model, this)
 {
     setText(QObject::tr("Add transition"));
 }
@@ -819,7 +819,7 @@ void RemoveTrackCommand::undo_impl()
     m_model.setTrackName(m_trackIndex, m_trackName);
 
     // Restore track from XML.
-    Mlt::Producer producer(MLT.profile(), "xml-string", m_xml.toUtf8().constData());
+    Mlt::Producer producer(MLT.profile(), "xml-string", m_xml.toString().toUtf8().constData());
     Q_ASSERT(producer.is_valid());
     Mlt::Playlist playlist(producer);
     Q_ASSERT(playlist.is_valid());
@@ -885,7 +885,7 @@ UpdateClipCommand::UpdateClipCommand(TimelineDock& timeline, MultitrackModel& mo
     , m_position(position)
     , m_isFirstRedo(true)
     , m_isSpeedChanged(false)
-    , m_undoHelper(*timeline.model())
+    , m_undoHelper(*timeline.model(), this)
 {
     setText(QObject::tr("Change clip properties"));
     m_undoHelper.recordBeforeState();
@@ -896,7 +896,7 @@ void UpdateClipCommand::redo_impl()
     LOG_DEBUG() << "trackIndex" << m_trackIndex << "clipIndex" << m_clipIndex << "position" << m_position;
     if (!m_isFirstRedo)
         m_undoHelper.recordBeforeState();
-    Mlt::Producer clip(MLT.profile(), "xml-string", m_xmlAfter.toUtf8().constData());
+    Mlt::Producer clip(MLT.profile(), "xml-string", m_xmlAfter.toString().toUtf8().constData());
     Q_ASSERT(clip.is_valid());
     Q_ASSERT(m_timeline.model());
 //    m_timeline.model()->liftClip(m_trackIndex, m_clipIndex);
@@ -926,7 +926,7 @@ RemoveTransitionCommand::RemoveTransitionCommand(MultitrackModel &model, int tra
     , m_clipIndex(clipIndex)
     , m_transitionIndex(transitionIndex)
     , m_position(position)
-    , m_undoHelper(model)
+    , m_undoHelper(model, this)
 {
     setText(QObject::tr("Remove transition"));
 }
@@ -974,7 +974,7 @@ RemoveTransitionsOnClipCommand::RemoveTransitionsOnClipCommand(MultitrackModel &
     , m_timeline(timeline)
     , m_trackIndex(trackIndex)
     , m_clipIndex(clipIndex)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
 {
     setText("Remove transition");
 }
@@ -1000,7 +1000,7 @@ MoveInsertClipCommand::MoveInsertClipCommand(MultitrackModel &model, int fromTra
     , m_toTrackIndex(toTrack)
     , m_clipIndex(clipIndex)
     , m_position(position)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
 {
     setText(QObject::tr("Move clip"));
 }
@@ -1522,6 +1522,41 @@ bool KeyFrameUpdateCommand::mergeWith(const QUndoCommand *other)
 }
 
 
+KeyFrameBulkCommand::KeyFrameBulkCommand(MultitrackModel& model, Mlt::Filter* filter, const QMap<QString, QString> &from_value, const QMap<QString, QString> &to_value, bool isFirst, AbstractCommand *parent)
+: AbstractCommand(model, parent)
+,m_from_value(from_value)
+,m_to_value(to_value)
+{
+    setText(QObject::tr("Change keyframes"));
+    Q_ASSERT(filter);
+
+    m_filter        = new Mlt::Filter(filter->get_filter());
+    m_bFirstExec    = isFirst;
+}
+
+KeyFrameBulkCommand::~KeyFrameBulkCommand()
+{
+    delete m_filter;
+}
+
+void KeyFrameBulkCommand::redo_impl()
+{
+    if(m_bFirstExec)//第一次自动执行不调用，外部已经执行
+    {
+        m_bFirstExec = false;
+        return;
+    }
+
+    Q_ASSERT(MAIN.filterController());
+    MAIN.filterController()->setAnimations(m_filter, m_to_value);
+}
+
+void KeyFrameBulkCommand::undo_impl()
+{
+    Q_ASSERT(MAIN.filterController());
+    MAIN.filterController()->setAnimations(m_filter, m_from_value);
+}
+
 
 FilterAttachCommand::FilterAttachCommand(MultitrackModel& model, QmlMetadata *meta, int rowIndex, int metaIndex, bool bAdd, bool isFirst, AbstractCommand * parent)
 : AbstractCommand(model, parent)
@@ -1676,7 +1711,7 @@ FilterClipCommand::FilterClipCommand(MultitrackModel& model, int trackIndex, int
     , m_clipIndex(clipIndex)
     , m_strFromXml(strFromXml)
     , m_strToXml(strToXml)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
 {
 
    setText(QObject::tr("FilterClipCommand"));
@@ -1685,7 +1720,7 @@ FilterClipCommand::FilterClipCommand(MultitrackModel& model, int trackIndex, int
 void FilterClipCommand::redo_impl()
 {
     //m_undoHelper.recordBeforeState();
-    m_model.refreshClipFromXmlForFilter(m_trackIndex, m_clipIndex, m_strToXml);
+    m_model.refreshClipFromXmlForFilter(m_trackIndex, m_clipIndex, m_strToXml.toString());
 
     //m_model.moveClip(m_fromTrackIndex, m_toTrackIndex, m_fromClipIndex, m_toStart);
     //m_undoHelper.recordAfterState();
@@ -1696,7 +1731,7 @@ void FilterClipCommand::undo_impl()
 {
    // LOG_DEBUG() << "fromTrack" << m_fromTrackIndex << "toTrack" << m_toTrackIndex;
    // m_undoHelper.undoChanges();
-     m_model.refreshClipFromXmlForFilter(m_trackIndex, m_clipIndex, m_strFromXml);
+     m_model.refreshClipFromXmlForFilter(m_trackIndex, m_clipIndex, m_strFromXml.toString());
 
 }
 */
@@ -1711,7 +1746,7 @@ TransitionPropertyCommand::TransitionPropertyCommand(TimelineDock& timeline, Mul
     , m_transitionName(transitionName)
     , m_propertyName(propertyName)
     , m_propertyValue(propertyValue)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
     , m_invert(invert)
     , m_softness(softness)
     , m_isFirstRedo(isFirst)
@@ -1728,7 +1763,7 @@ TransitionPropertyCommand::TransitionPropertyCommand(TimelineDock &timeline, Mul
     , m_transitionName(parameters.strTransitionName)
     , m_propertyName(parameters.strPropertyName)
     , m_propertyValue(parameters.strPropertyValue)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
     , m_invert(parameters.nInvertTransition)
     , m_softness(parameters.dTransitionSoftness)
     , m_isFirstRedo(bIsFirstRedo)
@@ -1795,7 +1830,7 @@ TransitionDurationSettingCommand::TransitionDurationSettingCommand(TimelineDock
     , m_trackIndex(trackIndex)
     , m_clipIndex(clipIndex)
     , m_duration(duration)
-    , m_undoHelper(m_model)
+    , m_undoHelper(m_model, this)
     , m_isFirstRedo(isFirst)
 {
     setText(QObject::tr("Change Transition Duration"));
@@ -1836,6 +1871,65 @@ bool TransitionDurationSettingCommand::mergeWith(const QUndoCommand *other)
 
 
 
+BatchCommand::BatchCommand(MultitrackModel &model, const QString &text, AbstractCommand *parent)
+    : AbstractCommand(model, parent)
+    , m_model(model)
+    , m_isFirstRedo(true)
+{
+    setText(text);
+}
+
+BatchCommand::~BatchCommand()
+{
+    qDeleteAll(m_commands);
+}
+
+void BatchCommand::add(QUndoCommand *command)
+{
+    Q_ASSERT(command);
+    command->redo();
+    m_commands << command;
+}
+
+void BatchCommand::redo_impl()
+{
+    // The commands were done as they were added.
+    if (m_isFirstRedo) {
+        m_isFirstRedo = false;
+        return;
+    }
+    LOG_DEBUG() << text() << m_commands.size() << "commands";
+    m_model.beginTransaction();
+    foreach (QUndoCommand* command, m_commands) {
+        AbstractCommand* abstractCommand = dynamic_cast<AbstractCommand*>(command);
+        if (abstractCommand)
+            abstractCommand->redo_impl();
+        else
+            command->redo();
+    }
+    m_model.commitTransaction();
+}
+
+void BatchCommand::undo_impl()
+{
+    LOG_DEBUG() << text() << m_commands.size() << "commands";
+    m_model.beginTransaction();
+    for (int i = m_commands.size() - 1; i >= 0; --i) {
+        AbstractCommand* abstractCommand = dynamic_cast<AbstractCommand*>(m_commands.at(i));
+        if (abstractCommand)
+            abstractCommand->undo_impl();
+        else
+            m_commands.at(i)->undo();
+    }
+    m_model.commitTransaction();
+}
+
+void BatchCommand::releaseUndoData()
+{
+    foreach (QUndoCommand* command, m_commands)
+        AbstractCommand::discard(command);
+}
+
 } // namespace
 
 #include "moc_timelinecommands.cpp"
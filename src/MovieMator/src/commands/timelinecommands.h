@@ -62,10 +62,11 @@ public:
     AppendClipCommand(MultitrackModel& model, int trackIndex, const QString& xml, AbstractCommand * parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); m_xml.clear(); }
 private:
     MultitrackModel& m_model;
     int m_trackIndex;
-    QString m_xml;
+    UndoXml m_xml;
     UndoHelper m_undoHelper;
 };
 
@@ -76,11 +77,12 @@ public:
     InsertClipCommand(MultitrackModel& model, int trackIndex, int position, const QString &xml, AbstractCommand * parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); m_xml.clear(); }
 private:
     MultitrackModel& m_model;
     int m_trackIndex;
     int m_position;
-    QString m_xml;
+    UndoXml m_xml;
     QStringList m_oldTracks;
     UndoHelper m_undoHelper;
 };
@@ -92,12 +94,13 @@ public:
     OverwriteClipCommand(MultitrackModel& model, int trackIndex, int position, const QString &xml, AbstractCommand * parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); m_xml.clear(); m_playlistXml.clear(); }
 private:
     MultitrackModel& m_model;
     int m_trackIndex;
-    QString m_playlistXml;
+    UndoXml m_playlistXml;
     int m_position;
-    QString m_xml;
+    UndoXml m_xml;
     UndoHelper m_undoHelper;
 };
 
@@ -108,11 +111,12 @@ public:
     LiftClipCommand(MultitrackModel& model, TimelineDock &timeline, int trackIndex, int clipIndex, const QString &xml, AbstractCommand * parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); m_xml.clear(); }
 private:
     MultitrackModel& m_model;
     int m_trackIndex;
     int m_clipIndex;
-    QString m_xml;
+    UndoXml m_xml;
     UndoHelper m_undoHelper;
     TimelineDock &m_timeline;
 };
@@ -124,11 +128,12 @@ public:
     RemoveClipCommand(MultitrackModel& model, TimelineDock& timeline, int trackIndex, int clipIndex, const QString &xml, AbstractCommand * parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); m_xml.clear(); }
 private:
     MultitrackModel& m_model;
     int m_trackIndex;
     int m_clipIndex;
-    QString m_xml;
+    UndoXml m_xml;
     UndoHelper m_undoHelper;
     TimelineDock& m_timeline;
 };
@@ -207,6 +212,7 @@ public:
     MoveClipCommand(MultitrackModel& model, int fromTrackIndex, int toTrackIndex, int clipIndex, int position, AbstractCommand * parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); }
 private:
     MultitrackModel& m_model;
     int m_fromTrackIndex;
@@ -223,6 +229,7 @@ public:
     TrimClipInCommand(MultitrackModel& model, int trackIndex, int clipIndex, int delta, bool ripple, AbstractCommand * parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); }
 protected:
     int id() const { return UndoIdTrimClipIn; }
 //    using AbstractCommand::mergeWith;
@@ -243,6 +250,7 @@ public:
     TrimClipOutCommand(MultitrackModel& model, int trackIndex, int clipIndex, int delta, bool ripple, AbstractCommand * parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); }
 protected:
     int id() const { return UndoIdTrimClipOut; }
     //using AbstractCommand::mergeWith;
@@ -315,6 +323,7 @@ public:
     AddTransitionCommand(MultitrackModel& model, int trackIndex, int clipIndex, int position, AbstractCommand * parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); }
 private:
     MultitrackModel& m_model;
     int m_trackIndex;
@@ -430,10 +439,11 @@ public:
     RemoveTrackCommand(MultitrackModel& model, int trackIndex, AbstractCommand* parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_xml.clear(); }
 private:
     MultitrackModel& m_model;
     int m_trackIndex;
-    QString m_xml;
+    UndoXml m_xml;
     TrackType m_trackType;
     QString m_trackName;
 };
@@ -464,12 +474,13 @@ public:
     void setSpeedChanged(bool isSpeedChanged) {m_isSpeedChanged = isSpeedChanged;}
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); m_xmlAfter.clear(); }
 private:
     TimelineDock& m_timeline;
     int m_trackIndex;
     int m_clipIndex;
     int m_position;
-    QString m_xmlAfter;
+    UndoXml m_xmlAfter;
     bool m_isFirstRedo;
     bool m_isSpeedChanged;
     UndoHelper m_undoHelper;
@@ -483,6 +494,7 @@ public:
     RemoveTransitionCommand(MultitrackModel &model, int trackIndex, int clipIndex, int transitionIndex, int position, AbstractCommand *parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); }
 private:
     MultitrackModel &m_model;
     int m_trackIndex;
@@ -499,6 +511,7 @@ public:
     RemoveTransitionsOnClipCommand(MultitrackModel &model, TimelineDock &timeline, int trackIndex, int clipIndex, AbstractCommand *parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); }
 private:
     MultitrackModel &m_model;
     TimelineDock &m_timeline;
@@ -514,6 +527,7 @@ public:
     MoveInsertClipCommand(MultitrackModel &model, int fromTrack, int toTrack, int clipIndex, int position, AbstractCommand *parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); }
 private:
     MultitrackModel &m_model;
     int m_fromTrackIndex;
@@ -530,12 +544,13 @@ public:
     FilterClipCommand(MultitrackModel& model, int TrackIndex, int clipIndex, QString strFromXml, QString strToXml, AbstractCommand * parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); m_strFromXml.clear(); m_strToXml.clear(); }
 private:
     MultitrackModel& m_model;
     int     m_trackIndex;
     int     m_clipIndex;
-    QString m_strFromXml;
-    QString m_strToXml;
+    UndoXml m_strFromXml;
+    UndoXml m_strToXml;
     UndoHelper m_undoHelper;
 };
 
@@ -684,6 +699,23 @@ private:
     QTime     m_execTime;
 };
 
+//批量修改关键帧：撤销和重做时整体设置涉及属性的动画字符串
+class KeyFrameBulkCommand: public AbstractCommand
+{
+public:
+    KeyFrameBulkCommand(MultitrackModel& model, Mlt::Filter* filter, const QMap<QString, QString> &from_value, const QMap<QString, QString> &to_value, bool isFirst, AbstractCommand * parent = nullptr);
+    ~KeyFrameBulkCommand();
+    void redo_impl();
+    void undo_impl();
+
+private:
+    Mlt::Filter* m_filter;
+    QMap<QString, QString>  m_from_value;     //修改前的动画字符串
+    QMap<QString, QString>  m_to_value;
+
+    bool      m_bFirstExec;
+};
+
 
 //选择clip
 class ClipsSelectCommand: public AbstractCommand
@@ -725,6 +757,7 @@ public:
     TransitionPropertyCommand(TimelineDock& timeline, MultitrackModel& model, const TransitionPropertyCommandParameters& parameters, bool bIsFirstRedo = true, AbstractCommand *parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); }
 
 protected:
     int id() const { return UndoIdTransitionProperty; }
@@ -752,6 +785,7 @@ public:
     TransitionDurationSettingCommand(TimelineDock &timeline, MultitrackModel& model, int trackIndex, int clipIndex, int duration, bool isFirst, AbstractCommand *parent = nullptr);
     void redo_impl();
     void undo_impl();
+    void releaseUndoData() { m_undoHelper.clear(); }
 
 protected:
     int id() const { return UndoIdTranstionDurationSetting; }
@@ -770,6 +804,26 @@ private:
 
 
 
+// 批量操作：期间 push的 command都加到这里，作为一步撤销。
+// redo和 undo时模型处于事务中，视图只在最后刷新一次。
+class BatchCommand : public AbstractCommand
+{
+public:
+    BatchCommand(MultitrackModel& model, const QString& text, AbstractCommand * parent = nullptr);
+    ~BatchCommand();
+    // Does command and takes it over. Commands that are not AbstractCommand
+    // are kept too, so that undo sees them in the order they were pushed.
+    void add(QUndoCommand* command);
+    bool isEmpty() const { return m_commands.isEmpty(); }
+    void redo_impl();
+    void undo_impl();
+    void releaseUndoData();
+private:
+    MultitrackModel& m_model;
+    QList<QUndoCommand*> m_commands;
+    bool m_isFirstRedo;
+};
+
 } // namespace Timeline
 
 #endif
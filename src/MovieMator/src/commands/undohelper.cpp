@@ -26,27 +26,139 @@
 #include <Logger.h>
 #include <QScopedPointer>
 #include <QUuid>
+#include <QHash>
+#include <QSet>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QUndoCommand>
 
 #include <QFile>
 
-#define UNDOHELPER_DEBUG
+//#define UNDOHELPER_DEBUG
 #ifdef UNDOHELPER_DEBUG
 #define UNDOLOG LOG_DEBUG()
 #else
 #define UNDOLOG if (false) LOG_DEBUG()
 #endif
 
-UndoHelper::UndoHelper(MultitrackModel& model)
+// The revision of a producer, bumped by MLT whenever one of its properties
+// changes. Filters forward their property changes to the service they are
+// attached to and attaching or detaching one fires "service-changed".
+struct ProducerRevision {
+    int serial;     // tells apart producers restored under the same UUID
+    QAtomicInt revision;
+};
+
+struct CachedXml {
+    int serial;
+    int revision;
+    UndoXml xml;
+};
+
+static QAtomicInt nextSerial(1);
+static QHash<QUuid, CachedXml> xmlCache;
+
+static void onProducerChanged(mlt_properties owner, ProducerRevision* self)
+{
+    Q_UNUSED(owner);
+    self->revision.ref();
+}
+
+static void deleteRevision(ProducerRevision* revision)
+{
+    delete revision;
+}
+
+static ProducerRevision* producerRevision(Mlt::Producer& producer)
+{
+    ProducerRevision* revision = static_cast<ProducerRevision*>(producer.get_data(kUndoRevisionProperty));
+    if (!revision) {
+        revision = new ProducerRevision;
+        revision->serial = nextSerial.fetchAndAddRelaxed(1);
+        producer.set(kUndoRevisionProperty, revision, 0, reinterpret_cast<mlt_destructor>(deleteRevision));
+        // The listeners are owned by the producer's events and go with it.
+        mlt_events_listen(producer.get_properties(), revision, "property-changed", reinterpret_cast<mlt_listener>(onProducerChanged));
+        mlt_events_listen(producer.get_properties(), revision, "service-changed", reinterpret_cast<mlt_listener>(onProducerChanged));
+    }
+    return revision;
+}
+
+void UndoHelper::filterChanged(Mlt::Filter& filter)
+{
+    mlt_service service = static_cast<mlt_service>(filter.get_data("service"));
+    if (!service)
+        return;
+    Mlt::Producer producer(mlt_producer(service));
+    if (!producer.is_valid())
+        return;
+    // Only producers that were serialized carry a revision; the cache is keyed on the parent.
+    ProducerRevision* revision = static_cast<ProducerRevision*>(producer.parent().get_data(kUndoRevisionProperty));
+    if (revision)
+        revision->revision.ref();
+}
+
+UndoXml::Stats UndoHelper::historyStats()
+{
+    QVector<const UndoXml*> cached;
+    cached.reserve(xmlCache.size());
+    QHash<QUuid, CachedXml>::const_iterator it = xmlCache.constBegin();
+    for (; it != xmlCache.constEnd(); ++it)
+        cached.append(&it->xml);
+    return UndoXml::stats(cached);
+}
+
+UndoHelper::UndoHelper(MultitrackModel& model, const QUndoCommand* command)
     : m_model(model)
     , m_hints(NoHints)
+    , m_command(command)
+    , m_beforeElapsed(0)
+    , m_serialized(0)
+    , m_reused(0)
 {
 }
 
+UndoXml UndoHelper::parentXml(const QUuid& uid, Mlt::Producer& clip, int& serial, int& revision)
+{
+    Mlt::Producer& parent = clip.parent();
+    // 转场是 tractor，改动在它的轨道和 transition上，不会通知到 tractor本身
+    if (parent.type() != producer_type) {
+        serial = revision = 0;
+        ++m_serialized;
+        return UndoXml(MLT.XML(&parent));
+    }
+    ProducerRevision* current = producerRevision(parent);
+    QHash<QUuid, CachedXml>::const_iterator it = xmlCache.constFind(uid);
+    if (it != xmlCache.constEnd() && it->serial == current->serial && it->revision == current->revision.load()) {
+        serial = it->serial;
+        revision = it->revision;
+        ++m_reused;
+        return it->xml;
+    }
+    UndoXml xml(MLT.XML(&parent));
+    ++m_serialized;
+    // Read after serializing: it may touch the producer.
+    serial = current->serial;
+    revision = current->revision.load();
+    CachedXml& cached = xmlCache[uid];
+    cached.serial = serial;
+    cached.revision = revision;
+    cached.xml = xml;
+    return xml;
+}
+
+QString UndoHelper::commandName() const
+{
+    return m_command? m_command->text() : QString("?");
+}
+
 void UndoHelper::recordBeforeState()
 {
 #ifdef UNDOHELPER_DEBUG
     debugPrintState();
 #endif
+    QElapsedTimer timer;
+    timer.start();
+    m_serialized = m_reused = 0;
     m_state.clear();
     m_clipsAdded.clear();
     m_insertedOrder.clear();
@@ -65,8 +177,8 @@ void UndoHelper::recordBeforeState()
             m_insertedOrder << uid;
             Info& info = m_state[uid];
             if (!(m_hints & SkipXML))
-                info.xml = MLT.XML(&clip->parent());
-//            printf("bbb--------%s\n", info.xml.toUtf8().constData());
+                info.xml = parentXml(uid, *clip, info.serial, info.revision);
+//            printf("bbb--------%s\n", info.xml.toString().toUtf8().constData());
 //            printf("-----------\n");
 //            printf("%s\n", MLT.XML(clip.data()).toUtf8().constData());
 
@@ -79,6 +191,17 @@ void UndoHelper::recordBeforeState()
             info.isBlank = playlist.is_blank(j);
         }
     }
+    if (!(m_hints & SkipXML)) {
+        // Forget the clips that left the timeline.
+        QHash<QUuid, CachedXml>::iterator it = xmlCache.begin();
+        while (it != xmlCache.end()) {
+            if (m_state.contains(it.key()))
+                ++it;
+            else
+                it = xmlCache.erase(it);
+        }
+    }
+    m_beforeElapsed = timer.elapsed();
     UNDOLOG << "recordBeforeState end";
 }
 
@@ -87,7 +210,11 @@ void UndoHelper::recordAfterState()
 #ifdef UNDOHELPER_DEBUG
     debugPrintState();
 #endif
-    QList<QUuid> clipsRemoved = m_state.keys();
+    QElapsedTimer timer;
+    timer.start();
+    int serializedBefore = m_serialized;
+    int reusedBefore = m_reused;
+    QSet<QUuid> clipsRemoved = m_state.keys().toSet();
     m_clipsAdded.clear();
     for (int i = 0; i < m_model.trackList().count(); ++i)
     {
@@ -140,16 +267,19 @@ void UndoHelper::recordAfterState()
 
                     Q_ASSERT(&clip->parent());
 
-                    QString newXml = MLT.XML(&clip->parent());
-                    UNDOLOG << "wzq xml:" << newXml;
-                    if (info.xml != newXml) {
+                    // An unchanged revision means the XML is the same.
+                    int serial = 0;
+                    int revision = 0;
+                    UndoXml newXml = parentXml(uid, *clip, serial, revision);
+                    bool unchanged = info.serial && serial == info.serial && revision == info.revision;
+                    if (!unchanged && info.xml != newXml) {
                         UNDOLOG << "Modified xml:" << uid;
                         info.changes = 0;
                         info.changes |= XMLModified;
                     }
                 }
             }
-            clipsRemoved.removeOne(uid);
+            clipsRemoved.remove(uid);
         }
     }
 
@@ -159,6 +289,10 @@ void UndoHelper::recordAfterState()
         m_state[uid].changes = Removed;
     }
 
+    LOG_DEBUG() << "undo snapshot of" << commandName() << "took"
+                << m_beforeElapsed << "+" << timer.elapsed() << "ms,"
+                << "serialized" << serializedBefore << "+" << (m_serialized - serializedBefore)
+                << "clips, reused" << reusedBefore << "+" << (m_reused - reusedBefore);
     UNDOLOG << "recordAfterState end";
 }
 
@@ -171,6 +305,8 @@ void UndoHelper::undoChanges()
     /* We're walking through the list in the order of uids, which is the order in which the
      * clips were laid out originally. As we go through the clips we make sure the clips behind
      * the current index are as they were originally before we move on to the next one */
+    // The earliest position the undo changed, for the viewer's frame cache.
+    int firstChanged = -1;
     foreach (QUuid uid, m_insertedOrder) {
         //Q_ASSERT()
         const Info& info = m_state[uid];
@@ -230,9 +366,9 @@ void UndoHelper::undoChanges()
 //                QTextStream ts1(&outFile1);
 //                ts1 << projectXML << endl;
 
-                Mlt::Producer restoredClip(MLT.profile(), "xml-string", info.xml.toUtf8().constData());
+                Mlt::Producer restoredClip(MLT.profile(), "xml-string", info.xml.toString().toUtf8().constData());
 //                char *sss = "xml-string";
-//                Mlt::Tractor restoredClip(MLT.profile(), (char *)sss, (char *)info.xml.toUtf8().constData());
+//                Mlt::Tractor restoredClip(MLT.profile(), (char *)sss, (char *)info.xml.toString().toUtf8().constData());
 
 //                mlt_properties_debug(restoredClip.get_properties(), "123456------------", stderr);
 
@@ -259,7 +395,7 @@ void UndoHelper::undoChanges()
                     int currentClipUuidIndex = m_insertedOrder.indexOf(uid);
                     QUuid nextClipUuid = m_insertedOrder.at(currentClipUuidIndex + 1);
                     const Info& nextInfo = m_state[nextClipUuid];
-                    Mlt::Producer nextClip(MLT.profile(), "xml-string", nextInfo.xml.toUtf8().constData());
+                    Mlt::Producer nextClip(MLT.profile(), "xml-string", nextInfo.xml.toString().toUtf8().constData());
 
 //                    mlt_service_type type = restoredClip.type();
                     Mlt::Tractor tractor(restoredClip);
@@ -317,7 +453,7 @@ void UndoHelper::undoChanges()
             Q_ASSERT(!(m_hints & SkipXML) && "Cannot restore clip without stored XML");
             Q_ASSERT(!info.xml.isEmpty());
             QModelIndex modelIndex = m_model.createIndex(currentIndex, 0, quintptr(info.oldTrackIndex));
-            Mlt::Producer restoredClip(MLT.profile(), "xml-string", info.xml.toUtf8().constData());
+            Mlt::Producer restoredClip(MLT.profile(), "xml-string", info.xml.toString().toUtf8().constData());
             Mlt::Tractor tractor(restoredClip);
             //QUuid uid = MLT.ensureHasUuid(tractor);
             //qDebug() << "uuid - " << QString(tractor.get(kUuidProperty));
@@ -342,6 +478,12 @@ void UndoHelper::undoChanges()
             MLT.setUuid(*clip, uid);
             emit m_model.modified();
         }
+
+        if (info.changes != NoChange && currentIndex < playlist.count()) {
+            int start = playlist.clip_start(currentIndex);
+            if (firstChanged < 0 || start < firstChanged)
+                firstChanged = start;
+        }
     }
 
     /* Finally we walk through the tracks once more, removing clips that
@@ -366,6 +508,8 @@ void UndoHelper::undoChanges()
 //            Q_ASSERT(!uid.isNull());
             if (m_clipsAdded.removeOne(uid) || uid.isNull()) {
                 UNDOLOG << "Removing clip at" << i;
+                if (firstChanged < 0 || playlist.clip_start(i) < firstChanged)
+                    firstChanged = playlist.clip_start(i);
                 m_model.beginRemoveRows(m_model.index(trackIndex), i, i);
                 if (clip->parent().get_data("mlt_mix"))
                     clip->parent().set("mlt_mix", nullptr, 0);
@@ -381,6 +525,9 @@ void UndoHelper::undoChanges()
         }
         trackIndex++;
     }
+    // Clips after the first change may have moved, so drop to the end.
+    if (firstChanged >= 0)
+        MLT.invalidateFrameCache(firstChanged);
     emit m_model.modified();
 #ifdef UNDOHELPER_DEBUG
     debugPrintState();
@@ -392,6 +539,13 @@ void UndoHelper::setHints(OptimizationHints hints)
     m_hints = hints;
 }
 
+void UndoHelper::clear()
+{
+    m_state.clear();
+    m_clipsAdded.clear();
+    m_insertedOrder.clear();
+}
+
 void UndoHelper::debugPrintState()
 {
     qDebug("timeline state: {");
@@ -20,11 +20,26 @@
 #define UNDOHELPER_H
 
 #include "models/multitrackmodel.h"
+#include "undoxml.h"
 #include <MltPlaylist.h>
+#include <MltFilter.h>
 #include <QString>
 #include <QMap>
 #include <QList>
 
+class QUndoCommand;
+
+/*!
+  \class UndoHelper
+  \brief Snapshots the clips of the timeline around an edit and reverts it.
+
+  The XML of each clip's parent is kept in a cache shared by all helpers and
+  keyed by the clip's UUID. Every cached producer carries a revision that
+  MLT bumps when it or one of its filters changes, so a snapshot serializes
+  only the clips whose revision moved since they were last serialized;
+  trimming or moving a clip does not touch its parent at all. Code that
+  changes a filter without an MLT event must call filterChanged().
+*/
 class UndoHelper
 {
 public:
@@ -33,15 +48,28 @@ public:
         NoHints,
         SkipXML
     };
-    UndoHelper(MultitrackModel & model);
+    // command is only used to name the timing log; it may be null.
+    UndoHelper(MultitrackModel & model, const QUndoCommand* command = nullptr);
 
     void recordBeforeState();
     void recordAfterState();
     void undoChanges();
     void setHints(OptimizationHints hints);
+    // Drop the recorded state; undoChanges() does nothing afterwards.
+    void clear();
+
+    // Mark the producer a filter is attached to as changed. Needed after
+    // changes MLT does not report, such as Mlt::Animation::remove(), or
+    // the cached XML of the producer is reused although it is stale.
+    static void filterChanged(Mlt::Filter& filter);
+    // UndoXml::stats() of the undo history alone; the XML cached for
+    // clips that no command refers to is live timeline state.
+    static UndoXml::Stats historyStats();
 
 private:
     void debugPrintState();
+    UndoXml parentXml(const QUuid& uid, Mlt::Producer& clip, int& serial, int& revision);
+    QString commandName() const;
 
     enum ChangeFlags {
         NoChange = 0x0,
@@ -57,9 +85,12 @@ private:
         int newTrackIndex;
         int newClipIndex;
         bool isBlank;
-        QString xml;
+        UndoXml xml;
         int frame_in;
         int frame_out;
+        // The parent's revision when xml was taken; serial 0 if unknown.
+        int serial;
+        int revision;
 
         int changes;
         Info()
@@ -70,6 +101,8 @@ private:
             , isBlank(false)
             , frame_in(-1)
             , frame_out(-1)
+            , serial(0)
+            , revision(0)
             , changes(NoChange)
         {}
     };
@@ -78,6 +111,11 @@ private:
     QList<QUuid> m_insertedOrder;
     MultitrackModel & m_model;
     OptimizationHints m_hints;
+    const QUndoCommand* m_command;
+    // Timing of the last snapshot.
+    qint64 m_beforeElapsed;
+    int m_serialized;
+    int m_reused;
 };
 
 #endif // UNDOHELPER_H
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "undoxml.h"
+#include <QCryptographicHash>
+#include <QHash>
+
+// Smaller documents, blanks and the like, do not gain from compression.
+static const int kCompressThreshold = 256;
+// zlib level; XML compresses well enough at low levels and edits stay fast.
+static const int kCompressLevel = 3;
+
+struct UndoXml::Entry {
+    QByteArray key;     // SHA-1 of the UTF-8 document
+    QByteArray data;
+    int rawSize;
+    bool compressed;
+    int ref;
+};
+
+// Never destroyed: static UndoXml instances elsewhere may outlive it.
+static QHash<QByteArray, UndoXml::Entry*>& table()
+{
+    static QHash<QByteArray, UndoXml::Entry*>* instance = new QHash<QByteArray, UndoXml::Entry*>;
+    return *instance;
+}
+
+static qint64 rawBytes = 0;
+static qint64 storedBytes = 0;
+
+UndoXml::UndoXml()
+    : d(nullptr)
+{
+}
+
+UndoXml::UndoXml(const QString& xml)
+    : d(nullptr)
+{
+    *this = xml;
+}
+
+UndoXml::UndoXml(const UndoXml& other)
+    : d(other.d)
+{
+    if (d)
+        ++d->ref;
+}
+
+UndoXml::~UndoXml()
+{
+    clear();
+}
+
+UndoXml& UndoXml::operator=(const UndoXml& other)
+{
+    if (other.d)
+        ++other.d->ref;
+    clear();
+    d = other.d;
+    return *this;
+}
+
+UndoXml& UndoXml::operator=(const QString& xml)
+{
+    clear();
+    if (xml.isEmpty())
+        return *this;
+    QByteArray utf8 = xml.toUtf8();
+    QByteArray key = QCryptographicHash::hash(utf8, QCryptographicHash::Sha1);
+    Entry* entry = table().value(key);
+    if (!entry) {
+        entry = new Entry;
+        entry->key = key;
+        entry->rawSize = utf8.size();
+        entry->compressed = utf8.size() > kCompressThreshold;
+        entry->data = entry->compressed? qCompress(utf8, kCompressLevel) : utf8;
+        entry->ref = 0;
+        table().insert(key, entry);
+        rawBytes += entry->rawSize;
+        storedBytes += entry->data.size();
+    }
+    ++entry->ref;
+    d = entry;
+    return *this;
+}
+
+QString UndoXml::toString() const
+{
+    if (!d)
+        return QString();
+    return QString::fromUtf8(d->compressed? qUncompress(d->data) : d->data);
+}
+
+void UndoXml::clear()
+{
+    if (d && --d->ref == 0) {
+        table().remove(d->key);
+        rawBytes -= d->rawSize;
+        storedBytes -= d->data.size();
+        delete d;
+    }
+    d = nullptr;
+}
+
+UndoXml::Stats UndoXml::stats()
+{
+    Stats result;
+    result.documents = table().size();
+    result.rawBytes = rawBytes;
+    result.storedBytes = storedBytes;
+    return result;
+}
+
+UndoXml::Stats UndoXml::stats(const QVector<const UndoXml*>& ignored)
+{
+    Stats result = stats();
+    QHash<Entry*, int> refs;
+    foreach (const UndoXml* xml, ignored) {
+        if (xml && xml->d)
+            ++refs[xml->d];
+    }
+    QHash<Entry*, int>::const_iterator it = refs.constBegin();
+    for (; it != refs.constEnd(); ++it) {
+        if (it.key()->ref > it.value())
+            continue;
+        --result.documents;
+        result.rawBytes -= it.key()->rawSize;
+        result.storedBytes -= it.key()->data.size();
+    }
+    return result;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UNDOXML_H
+#define UNDOXML_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+
+/*!
+  \class UndoXml
+  \brief MLT XML kept by the undo history, compressed and de-duplicated.
+
+  Every distinct document is stored once in a table shared by all
+  instances, so the same producer snapshotted by many commands costs one
+  copy. Documents of more than a few hundred bytes are kept zlib
+  compressed and inflated again by toString().
+
+  Two instances compare equal when they hold the same document, without
+  inflating either of them.
+
+  \threadsafe Not thread-safe; the undo history lives on the main thread.
+*/
+class UndoXml
+{
+public:
+    struct Stats {
+        int documents;          // distinct documents in the table
+        qint64 rawBytes;        // their UTF-8 size
+        qint64 storedBytes;     // what they actually take
+    };
+
+    UndoXml();
+    UndoXml(const QString& xml);
+    UndoXml(const UndoXml& other);
+    ~UndoXml();
+    UndoXml& operator=(const UndoXml& other);
+    UndoXml& operator=(const QString& xml);
+
+    bool operator==(const UndoXml& other) const { return d == other.d; }
+    bool operator!=(const UndoXml& other) const { return d != other.d; }
+
+    QString toString() const;
+    bool isEmpty() const { return !d; }
+    void clear();
+
+    static Stats stats();
+    // The same, leaving out the documents that nothing but the given
+    // instances holds, such as a cache of the live timeline.
+    static Stats stats(const QVector<const UndoXml*>& ignored);
+
+    struct Entry;   // private to undoxml.cpp
+
+private:
+    Entry* d;
+};
+
+#endif // UNDOXML_H
@@ -36,6 +36,8 @@
 #include <MltFilter.h>
 #include <map>
 #include "mainwindow.h"
+#include "docks/timelinedock.h"
+#include "commands/timelinecommands.h"
 #include "util.h"
 #include <assert.h>
 
@@ -696,18 +698,7 @@ void FilterController::insertKeyFrame(Mlt::Filter *filter, const QVector<key_fra
     Q_ASSERT(mltFilter);
     if(mltFilter->get_filter() != filter->get_filter())     return;
 
-    for(int nIndex = 0; nIndex < listKeyFrame.count(); nIndex++)
-    {
-        key_frame_item para = listKeyFrame.at(nIndex);
-
-        QMap<QString, QString>::Iterator iter = para.paraMap.begin();
-        while(iter != para.paraMap.end())
-        {
-            qmlFilter->cache_setKeyFrameParaValue(para.keyFrame, iter.key(), iter.value(), true);
-            iter++;
-        }
-    }
-    qmlFilter->syncCacheToProject();
+    qmlFilter->setKeyFrames(listKeyFrame);
 }
 
 void FilterController::removeKeyFrame(Mlt::Filter *filter, const QVector<key_frame_item> &listKeyFrame)
@@ -721,18 +712,54 @@ void FilterController::removeKeyFrame(Mlt::Filter *filter, const QVector<key_fra
     Q_ASSERT(mltFilter);
     if(mltFilter->get_filter() != filter->get_filter())     return;
 
+    qmlFilter->removeKeyFrames(listKeyFrame);
+}
+
+void FilterController::setKeyFrames(Mlt::Filter *filter, const QVector<key_frame_item> &listKeyFrame)
+{
+    if(m_currentFilterIndex == -1)          return;
+
+    QmlFilter *qmlFilter = m_currentFilter.data();
+    if(!qmlFilter)                          return;
+
+    Mlt::Filter* mltFilter = qmlFilter->getMltFilter();
+    Q_ASSERT(mltFilter);
+    if(mltFilter->get_filter() != filter->get_filter())     return;
+    if(listKeyFrame.isEmpty())              return;
+
+    // 撤销时整体恢复涉及属性的动画字符串
+    QMap<QString, QString> from_value;
     for(int nIndex = 0; nIndex < listKeyFrame.count(); nIndex++)
     {
-        key_frame_item para = listKeyFrame.at(nIndex);
+        foreach (const QString &name, listKeyFrame.at(nIndex).paraMap.keys())
+            if (!from_value.contains(name))
+                from_value.insert(name, QString::fromUtf8(mltFilter->get(name.toUtf8().constData())));
+    }
 
-        QMap<QString, QString>::Iterator iter = para.paraMap.begin();
-        while(iter != para.paraMap.end())
-        {
-            qmlFilter->removeAnimationKeyFrame(para.keyFrame, iter.key(), true);
-            iter++;
-        }
+    qmlFilter->setKeyFrames(listKeyFrame);
+
+    QMap<QString, QString> to_value;
+    foreach (const QString &name, from_value.keys())
+        to_value.insert(name, QString::fromUtf8(mltFilter->get(name.toUtf8().constData())));
+
+    MAIN.pushCommand(new Timeline::KeyFrameBulkCommand(*(MAIN.timelineDock()->model()), mltFilter, from_value, to_value, true));
+}
+
+void FilterController::setAnimations(Mlt::Filter *filter, const QMap<QString, QString> &animations)
+{
+    QmlFilter *qmlFilter = m_currentFilter.data();
+    if(m_currentFilterIndex != -1 && qmlFilter && qmlFilter->getMltFilter()
+            && qmlFilter->getMltFilter()->get_filter() == filter->get_filter())
+    {
+        qmlFilter->refreshAnimations(animations);
+        return;
     }
-    qmlFilter->syncCacheToProject();
+
+    // 不是当前滤镜时直接设置到 MLT滤镜上
+    QMap<QString, QString>::ConstIterator iter = animations.constBegin();
+    for (; iter != animations.constEnd(); ++iter)
+        filter->set(iter.key().toUtf8().constData(), iter.value().toUtf8().constData());
+    MLT.refreshConsumer();
 }
 
 void FilterController::updateKeyFrame(Mlt::Filter *filter, int nFrame, QString name, QString value)
@@ -114,6 +114,10 @@ public slots:
     void refreshNoAnimation(Mlt::Filter *filter, const QVector<key_frame_item> &listParameter);
     void insertKeyFrame(Mlt::Filter *filter, const QVector<key_frame_item> &listKeyFrame);
     void removeKeyFrame(Mlt::Filter *filter, const QVector<key_frame_item> &listKeyFrame);
+    //批量设置关键帧，每个属性的动画只生成并设置一次，只产生一个撤销步骤
+    void setKeyFrames(Mlt::Filter *filter, const QVector<key_frame_item> &listKeyFrame);
+    //设置滤镜属性的整个动画字符串，用于批量关键帧的撤销和重做
+    void setAnimations(Mlt::Filter *filter, const QMap<QString, QString> &animations);
     void updateKeyFrame(Mlt::Filter *filter, int nFrame, QString name, QString value);
 private slots:
     //接收m_attachedModel发送的信号（changed），并刷新consumer
@@ -22,6 +22,7 @@
 #include "settings.h"
 #include "mainwindow.h"
 #include "mltxmlchecker.h"
+#include "mediahash.h"
 #include <QFileDialog>
 #include <QStringList>
 #include "../securitybookmark/transport_security_bookmark.h"
@@ -62,7 +63,9 @@ void UnlinkedFilesDialog::on_tableView_doubleClicked(const QModelIndex& index)
         QModelIndex firstColIndex = model->index(index.row(), MltXmlChecker::MissingColumn);
         QModelIndex secondColIndex = model->index(index.row(), MltXmlChecker::ReplacementColumn);
         QString hash = MAIN.getFileHash(filenames[0]);
-        if (hash == model->data(firstColIndex, MltXmlChecker::ShotcutHashRole)) {
+        // The project may have been saved with the other kind of hash.
+        QString missingHash = model->data(firstColIndex, MltXmlChecker::ShotcutHashRole).toString();
+        if (hash == missingHash || MediaHash::singleton().matches(filenames[0], missingHash)) {
             // If the hashes match set icon to OK.
             QIcon icon(":/icons/oxygen/32x32/status/task-complete.png");
             model->setData(firstColIndex, icon, Qt::DecorationRole);
@@ -32,6 +32,7 @@
 #include "registrationchecker.h"
 #include "jobs/encodetask.h"
 #include "encodetaskqueue.h"
+#include "proxymanager.h"
 
 #include <Logger.h>
 #include <QtWidgets>
@@ -909,6 +910,9 @@ MeltJob* EncodeDock::createMeltJob(Mlt::Service* service, const QString& target,
     dom.setContent(&f1);
     f1.close();
 
+    // Encode from the original media, not their proxies.
+    ProxyManager::filterXML(dom, false);
+
 
     // add consumer element
     QDomElement consumerNode = dom.createElement("consumer");
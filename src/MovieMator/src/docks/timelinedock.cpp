@@ -35,6 +35,7 @@
 #include "settings.h"
 #include "../mainwindow.h"
 #include "controllers/filtercontroller.h"
+#include "proxymanager.h"
 #include <util.h>
 
 #include <QtQml>
@@ -229,23 +230,13 @@ int TimelineDock::clipIndexAtPosition(int trackIndex, int position)
     Q_ASSERT(trackIndex >= 0);
     Q_ASSERT(trackIndex < m_model.trackList().size());
     if (trackIndex >= 0 && trackIndex < m_model.trackList().size()) {
-        int i = m_model.trackList().at(trackIndex).mlt_index;
         Q_ASSERT(m_model.tractor());
         if (!m_model.tractor()) {
             return result;
         }
-        QScopedPointer<Mlt::Producer> track(m_model.tractor()->track(i));
-        Q_ASSERT(track);
-        if (track) {
-            Mlt::Playlist playlist(*track);
-            Q_ASSERT(playlist.is_valid());
-            if (!playlist.is_valid()) {
-                return result;
-            }
-            result = playlist.get_clip_index_at(position);
-            if (result > playlist.count() - 1)
-                result = -1;
-        }
+        result = m_model.clipIndex(trackIndex, position);
+        if (result > m_model.rowCount(m_model.index(trackIndex)) - 1)
+            result = -1;
     }
     return result;
 }
@@ -1037,6 +1028,11 @@ void TimelineDock::remakeAudioLevels(int trackIndex, int clipIndex)
     AudioLevelsTask::start(*info->producer, &m_model, modelIndex, /* force */ true);
 }
 
+void TimelineDock::setVisibleRange(int in, int out)
+{
+    AudioLevelsTask::setVisibleRange(in, out);
+}
+
 void TimelineDock::setTrackName(int trackIndex, const QString &value)
 {
     MAIN.pushCommand(
@@ -1270,22 +1266,8 @@ void TimelineDock::seekPreviousEdit()
     Q_ASSERT(m_model.tractor());
     if (!m_model.tractor()) return;
 
-    int newPosition = -1;
-    int n = m_model.tractor()->count();
-    for (int i = 0; i < n; i++) {
-        QScopedPointer<Mlt::Producer> track(m_model.tractor()->track(i));
-        Q_ASSERT(track);
-        if (track) {
-            Mlt::Playlist playlist(*track);
-            Q_ASSERT(playlist.is_valid());
-            int clipIndex = playlist.get_clip_index_at(m_position);
-            if (clipIndex >= 0 && m_position == playlist.clip_start(clipIndex))
-                --clipIndex;
-            if (clipIndex >= 0)
-                newPosition = qMax(newPosition, playlist.clip_start(clipIndex));
-        }
-    }
-    if (newPosition != m_position)
+    int newPosition = m_model.previousEdit(m_position);
+    if (newPosition >= 0 && newPosition != m_position)
         setPosition(newPosition);
 }
 
@@ -1295,22 +1277,8 @@ void TimelineDock::seekNextEdit()
     Q_ASSERT(m_model.tractor());
     if (!m_model.tractor()) return;
 
-    int newPosition = std::numeric_limits<int>::max();
-    int n = m_model.tractor()->count();
-    for (int i = 0; i < n; i++) {
-        QScopedPointer<Mlt::Producer> track(m_model.tractor()->track(i));
-        Q_ASSERT(track);
-        if (track) {
-            Mlt::Playlist playlist(*track);
-            Q_ASSERT(playlist.is_valid());
-            int clipIndex = playlist.get_clip_index_at(m_position) + 1;
-            if (clipIndex < playlist.count())
-                newPosition = qMin(newPosition, playlist.clip_start(clipIndex));
-            else if (clipIndex == playlist.count())
-                newPosition = qMin(newPosition, playlist.clip_start(clipIndex) + playlist.clip_length(clipIndex));
-        }
-    }
-    if (newPosition != m_position)
+    int newPosition = m_model.nextEdit(m_position);
+    if (newPosition >= 0 && newPosition != m_position)
         setPosition(newPosition);
 }
 
@@ -1739,6 +1707,7 @@ void TimelineDock::appendFromPath(int trackIndex, const QString &path)
             p->set("mute_on_pause", 0);
         }
         MLT.setImageDurationFromDefault(p);
+        ProxyManager::generateIfNeeded(*p);
         MAIN.appendClipToPlaylist();
         MAIN.onFileOpened(path);
 
@@ -1753,13 +1722,13 @@ void TimelineDock::appendFromPath(int trackIndex, const QString &path)
 
 void TimelineDock::appendFromUrls(int trackIndex, QList<QUrl> urlList)
 {
+    QStringList paths;
     foreach (QUrl url, urlList) {
-        QString path = Util::removeFileScheme(url);
+        paths << Util::removeFileScheme(url);
         //this->appendFromPath(trackIndex, path);
-
-        //模板文件拷贝到模板目录，再加到时间线
-        MAINCONTROLLER.appendToTimelineFromPath(trackIndex, path);
     }
+    //模板文件拷贝到模板目录，再加到时间线
+    MAINCONTROLLER.appendToTimelineTrack(trackIndex, paths);
 }
 
 
@@ -2020,32 +1989,7 @@ int TimelineDock::getPositionInCurrentClip()
 
 int TimelineDock::getCurrentClipLength()
 {
-//    int trackIndex = currentTrack();//需要使用和clip统一的track
-    int trackIndex = selectedTrackIndex();
-    int length = -1;
-    if ( selection().count() > 0)
-    {
-        int clipIndex = selection().first();
-//        Q_ASSERT(trackIndex >= 0);
-        Q_ASSERT(trackIndex < m_model.trackList().length());
-        if((trackIndex < 0) || (trackIndex >= m_model.trackList().length())) return -1;
-        int mlt_index = m_model.trackList().at(trackIndex).mlt_index;
-        Q_ASSERT(m_model.tractor());
-        if (!m_model.tractor()) {
-            return -1;
-        }
-        QScopedPointer<Mlt::Producer> track(m_model.tractor()->track(mlt_index));
-        Q_ASSERT(track);
-        if (track)
-        {
-            Mlt::Playlist playlist(*track);
-            Q_ASSERT(playlist.is_valid());
-            Q_ASSERT(clipIndex < playlist.count());
-            length = playlist.clip_length(clipIndex);
-        }
-    }
-
-    return length;
+    return selectedClipData(MultitrackModel::DurationRole);
 }
 
 int TimelineDock::getCurrentClipParentLength()
@@ -2119,74 +2063,32 @@ void TimelineDock::seekToKeyFrame(int position)
     }
 }
 
-int TimelineDock::getPositionOnParentProducer(int position)
+int TimelineDock::selectedClipData(int role) const
 {
-    int ret = -1;
-    if (selection().count() > 0)
-    {
-        int clipIndex = selection().first();
-//        int trackIndex = currentTrack();//需要使用和clip统一的track
-        int trackIndex = selectedTrackIndex();
-//        Q_ASSERT(trackIndex >= 0);
-        Q_ASSERT(trackIndex < m_model.trackList().length());
-        if((trackIndex < 0) || (trackIndex >= m_model.trackList().length())) {
-            return -1;
-        }
-        int mlt_index = m_model.trackList().at(trackIndex).mlt_index;
-        Q_ASSERT(m_model.tractor());
-        if (!m_model.tractor()) {
-            return -1;
-        }
-        QScopedPointer<Mlt::Producer> track(m_model.tractor()->track(mlt_index));
-        Q_ASSERT(track);
-        if (track)
-        {
-            Mlt::Playlist playlist(*track);
-            Q_ASSERT(playlist.is_valid());
-            Q_ASSERT(clipIndex < playlist.count());
-            Mlt::ClipInfo *info = playlist.clip_info(clipIndex);
-            Q_ASSERT(info);
-            if (info && (info->frame_in > 0))
-                ret = position + info->frame_in;
-            else
-                ret = position;
-        }
-    }
+    // 关键帧的每次查询都会转换位置，从剪辑缓存取值，不必每次通过 MLT查找轨道和 ClipInfo
+    int trackIndex = selectedTrackIndex();
+    if (selection().count() <= 0 || trackIndex < 0 || trackIndex >= m_model.trackList().size())
+        return -1;
+    QModelIndex index = m_model.index(selection().first(), 0, m_model.index(trackIndex));
+    if (!index.isValid())
+        return -1;
+    return m_model.data(index, role).toInt();
+}
 
-    return ret;
+int TimelineDock::getPositionOnParentProducer(int position)
+{
+    int in = selectedClipData(MultitrackModel::InPointRole);
+    if (in < 0)
+        return -1;
+    return position + in;
 }
 
 int TimelineDock::getPositionOnClip(int position)
 {
-//    int trackIndex = currentTrack();//需要使用和clip统一的track
-    int trackIndex = selectedTrackIndex();
-    int ret = -1;
-    if (selection().count() > 0 && trackIndex != -1)
-    {
-        int clipIndex = selection().first();
-        Q_ASSERT(trackIndex >= 0);
-        Q_ASSERT(trackIndex < m_model.trackList().size());
-        int mlt_index = m_model.trackList().at(trackIndex).mlt_index;
-        Q_ASSERT(m_model.tractor());
-        if (!m_model.tractor()) {
-            return -1;
-        }
-        QScopedPointer<Mlt::Producer> track(m_model.tractor()->track(mlt_index));
-        Q_ASSERT(track);
-        if (track)
-        {
-            Mlt::Playlist playlist(*track);
-            Q_ASSERT(playlist.is_valid());
-            Mlt::ClipInfo *info = playlist.clip_info(clipIndex);
-            Q_ASSERT(info);
-            if (info && (info->frame_in > 0)) {
-                ret = position - info->frame_in;
-            } else {
-                ret = position;
-            }
-        }
-    }
-    return ret;
+    int in = selectedClipData(MultitrackModel::InPointRole);
+    if (in < 0)
+        return -1;
+    return position - in;
 }
 
 int TimelineDock::timeToFrames(QString timecode)
@@ -2273,6 +2175,7 @@ void TimelineDock::exportAsTemplate(int trackIndex, int clipIndex)
 
 //                MLT.saveXML(filename, tempProducer, true);
                 MLT.saveXMLWithoutProfile(filename, tempProducer, true);
+                ProxyManager::filterXMLFile(filename, false);
 
                 //info->producer->set_in_and_out(-1, -1);
                 //QFile::remove(filename);
@@ -144,6 +144,8 @@ public:
     // 发送 showFilterDock()信号
     // 【外部无调用，是否保留】
     Q_INVOKABLE void emitShowFilterDock();
+    // 时间线可见区域 [in, out]（帧），优先生成其中剪辑的音频波形
+    Q_INVOKABLE void setVisibleRange(int in, int out);
 
     // 获取 timelinedock的坐标位置
     // 直接调用的 geometry()，getGeometry()？？？
@@ -422,6 +424,8 @@ private:
     void pulseLockButtonOnTrack(int trackIndex);
     // 加载 timeline.qml界面
     void load(bool force = false);
+    // 当前选中剪辑的 role数据（取自 MultitrackModel的剪辑缓存），没有选中剪辑返回 -1
+    int selectedClipData(int role) const;
 
     // ui界面
     Ui::TimelineDock *ui;
@@ -20,6 +20,7 @@
 #include "registrationchecker.h"
 #include "mltcontroller.h"
 #include "mainwindow.h"
+#include "proxymanager.h"
 
 
 EncodeTask::EncodeTask(Mlt::Producer *producer, Mlt::Profile *profile, Mlt::Properties *presets, QString target) : AbstractTask(target)
@@ -32,7 +33,12 @@ EncodeTask::EncodeTask(Mlt::Producer *producer, Mlt::Profile *profile, Mlt::Prop
 {
     Q_UNUSED(producer)
     //m_producer = new Mlt::Producer(producer);
-    m_producer = new Mlt::Producer(*(MAIN.multitrack()));
+    // Encode from the original media, not their proxies.
+    QString xml = MLT.XML(MAIN.multitrack());
+    if (ProxyManager::filterXML(xml, false))
+        m_producer = new Mlt::Producer(*profile, "xml-string", xml.toUtf8().constData());
+    else
+        m_producer = new Mlt::Producer(*(MAIN.multitrack()));
     m_consumer = createConsumer(profile, presets, target);
     m_consumer->connect(*m_producer);
     m_duration = m_producer->get_length();
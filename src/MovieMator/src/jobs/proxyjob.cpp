@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "proxyjob.h"
+#include "proxymanager.h"
+#include "util.h"
+#include <QFile>
+#include <Logger.h>
+
+static QStringList proxyArguments(const QString& source, const QString& target, int height)
+{
+    QStringList args;
+    args << "-loglevel" << "verbose" << "-y";
+    args << "-i" << source;
+    args << "-max_muxing_queue_size" << "9999";
+    args << "-map" << "0:v:0" << "-map" << "0:a?";
+    args << "-vf" << QString("scale=-2:%1").arg(height);
+    // Short GOPs without B-frames keep scrubbing and reverse play fast.
+    args << "-pix_fmt" << "yuv420p" << "-c:v" << "libx264" << "-preset" << "veryfast";
+    args << "-crf" << "23" << "-g" << "15" << "-bf" << "0";
+    args << "-c:a" << "aac" << "-b:a" << "256k";
+    args << "-f" << "mp4" << target;
+    return args;
+}
+
+ProxyJob::ProxyJob(const QString& source, const QString& hash, int height)
+    : FfmpegJob(source, proxyArguments(source, ProxyManager::proxyPath(hash) + ".part", height))
+    , m_hash(hash)
+    , m_partPath(ProxyManager::proxyPath(hash) + ".part")
+{
+    setLabel(tr("Make proxy for %1").arg(Util::baseName(source)));
+}
+
+ProxyJob::~ProxyJob()
+{
+
+}
+
+void ProxyJob::onFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    if (exitStatus == QProcess::NormalExit && exitCode == 0) {
+        QString path = ProxyManager::proxyPath(m_hash);
+        QFile::remove(path);
+        if (!QFile::rename(m_partPath, path))
+            LOG_WARNING() << "failed to rename proxy" << m_partPath;
+    } else {
+        QFile::remove(m_partPath);
+    }
+    ProxyManager::onProxyFinished(m_hash);
+    FfmpegJob::onFinished(exitCode, exitStatus);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PROXYJOB_H
+#define PROXYJOB_H
+
+#include "ffmpegjob.h"
+
+// Transcodes a media file to a proxy. ffmpeg writes to a partial file which
+// is renamed to the proxy path only when it finishes successfully.
+class ProxyJob : public FfmpegJob
+{
+    Q_OBJECT
+public:
+    ProxyJob(const QString& source, const QString& hash, int height);
+    virtual ~ProxyJob();
+
+protected slots:
+    void onFinished(int exitCode, QProcess::ExitStatus exitStatus);
+
+private:
+    QString m_hash;
+    QString m_partPath;
+};
+
+#endif // PROXYJOB_H
@@ -48,6 +48,10 @@
 
 #include "CrashHandler/CrashHandler.h"
 #include "util.h"
+#include "database.h"
+#include "thumbnailcache.h"
+#include "models/multitrackmodel.h"
+#include "commands/editbenchmark.h"
 
 #ifdef Q_OS_WIN
 extern "C"
@@ -142,6 +146,14 @@ public:
     QTranslator shotcutTranslator;
     QString resourceArg;
     bool isFullScreen;
+    bool benchmarkThumbnails;
+    bool benchmarkThumbnailStore;
+    bool benchmarkTimeline;
+    QString benchmarkProjectLoad;
+    QString benchmarkEdits;
+    int benchmarkTracks;
+    int benchmarkClips;
+    int benchmarkIterations;
 
     Application(int &argc, char **argv)
         : QApplication(argc, argv)
@@ -267,6 +279,36 @@ public:
                                             QCoreApplication::translate("main", "python"));
         parser.addOption(pythonFileOption);
 
+        QCommandLineOption benchmarkThumbnailsOption("benchmark-thumbnails",
+            QCoreApplication::translate("main", "Open the resource, log the thumbnail throughput and quit."));
+        parser.addOption(benchmarkThumbnailsOption);
+        QCommandLineOption benchmarkThumbnailStoreOption("benchmark-thumbnail-store",
+            QCoreApplication::translate("main", "Compare the thumbnail pack with PNG in SQLite, log the result and quit."));
+        parser.addOption(benchmarkThumbnailStoreOption);
+        QCommandLineOption benchmarkTimelineOption("benchmark-timeline",
+            QCoreApplication::translate("main", "Time repainting a synthetic 20 track by 500 clip timeline, log the result and quit."));
+        parser.addOption(benchmarkTimelineOption);
+        QCommandLineOption benchmarkProjectLoadOption("benchmark-project-load",
+            QCoreApplication::translate("main", "Time loading a synthetic 2000 clip project of the media file with and without lazy loading, log the result and quit."),
+            QCoreApplication::translate("main", "file"));
+        parser.addOption(benchmarkProjectLoadOption);
+        QCommandLineOption benchmarkEditsOption("benchmark-edits",
+            QCoreApplication::translate("main", "Time timeline edits, undo and redo on a synthetic project, write the result as JSON and quit."),
+            QCoreApplication::translate("main", "file"));
+        parser.addOption(benchmarkEditsOption);
+        QCommandLineOption benchmarkTracksOption("benchmark-tracks",
+            QCoreApplication::translate("main", "The number of tracks of the --benchmark-edits project, 10 by default."),
+            QCoreApplication::translate("main", "count"), "10");
+        parser.addOption(benchmarkTracksOption);
+        QCommandLineOption benchmarkClipsOption("benchmark-clips",
+            QCoreApplication::translate("main", "The number of clips per track of the --benchmark-edits project, 200 by default."),
+            QCoreApplication::translate("main", "count"), "200");
+        parser.addOption(benchmarkClipsOption);
+        QCommandLineOption benchmarkIterationsOption("benchmark-iterations",
+            QCoreApplication::translate("main", "The number of samples of each --benchmark-edits case, 100 by default."),
+            QCoreApplication::translate("main", "count"), "100");
+        parser.addOption(benchmarkIterationsOption);
+
         parser.process(arguments());
 #ifdef Q_OS_WIN
         isFullScreen = false;
@@ -275,6 +317,14 @@ public:
 #endif
         if (parser.isSet(gpuOption))
             Settings.setPlayerGPU(true);
+        benchmarkThumbnails = parser.isSet(benchmarkThumbnailsOption);
+        benchmarkThumbnailStore = parser.isSet(benchmarkThumbnailStoreOption);
+        benchmarkTimeline = parser.isSet(benchmarkTimelineOption);
+        benchmarkProjectLoad = parser.value(benchmarkProjectLoadOption);
+        benchmarkEdits = parser.value(benchmarkEditsOption);
+        benchmarkTracks = parser.value(benchmarkTracksOption).toInt();
+        benchmarkClips = parser.value(benchmarkClipsOption).toInt();
+        benchmarkIterations = parser.value(benchmarkIterationsOption).toInt();
 
 
         if (!parser.positionalArguments().isEmpty())
@@ -306,6 +356,43 @@ bool Application::event(QEvent *event)
     else return QApplication::event(event);
 }
 
+// Measure how fast the thumbnails of the opened project are served: from the
+// start until the thumbnail store has been idle for a few seconds.
+static void startThumbnailBenchmark(MainWindow* mainWindow)
+{
+    const int idleTimeoutMs = 5000;
+    DB.resetStats();
+    QElapsedTimer* elapsed = new QElapsedTimer;
+    QElapsedTimer* idle = new QElapsedTimer;
+    QTimer* poll = new QTimer(mainWindow);
+    Database::Stats* last = new Database::Stats(DB.stats());
+    elapsed->start();
+    idle->start();
+    QObject::connect(poll, &QTimer::timeout, [=]() {
+        Database::Stats stats = DB.stats();
+        if (stats.gets != last->gets || stats.puts != last->puts) {
+            *last = stats;
+            idle->start();
+            return;
+        }
+        if (stats.gets == 0 || idle->elapsed() < idleTimeoutMs)
+            return;
+        poll->stop();
+        double seconds = (elapsed->elapsed() - idle->elapsed()) / 1000.0;
+        LOG_INFO() << "thumbnail benchmark:" << stats.gets << "requested," << stats.hits << "cached,"
+                   << stats.puts << "generated in" << seconds << "s ="
+                   << (seconds > 0? stats.gets / seconds : 0.0) << "thumbnails/s";
+        ThumbnailCache& cache = ThumbnailCache::singleton();
+        LOG_INFO() << "thumbnail memory cache:" << cache.hits() << "hits," << cache.misses() << "misses,"
+                   << cache.evictions() << "evictions," << cache.size() << "KiB";
+        delete elapsed;
+        delete idle;
+        delete last;
+        mainWindow->close();
+    });
+    poll->start(100);
+}
+
 bool removeDir(const QString & dirName)
 {
     bool result = true;
@@ -429,6 +516,10 @@ int main(int argc, char **argv)
     setenv("QT_DEVICE_PIXEL_RATIO", "auto", 1);
 //    setenv("QT_SCALE_FACTOR", "2", 1);
     Application a(argc, argv);
+    if (a.benchmarkThumbnailStore) {
+        Database::benchmark(1000);
+        return 0;
+    }
 
 
 #if defined (QT_NO_DEBUG) && defined (SHARE_VERSION) //appstore版本不使用
@@ -510,6 +601,24 @@ int main(int argc, char **argv)
     delete g_splash;
     g_splash = nullptr;
 
+    if (a.benchmarkTimeline) {
+        MultitrackModel::benchmark(20, 500);
+        return 0;
+    }
+    if (!a.benchmarkEdits.isEmpty()) {
+        if (a.benchmarkTracks <= 0 || a.benchmarkClips <= 0 || a.benchmarkIterations <= 0) {
+            LOG_WARNING() << "edit benchmark: tracks, clips and iterations must be positive numbers";
+            return 1;
+        }
+        EditBenchmark benchmark(a.benchmarkTracks, a.benchmarkClips);
+        return benchmark.run(a.benchmarkIterations, a.benchmarkEdits)? 0 : 1;
+    }
+    if (!a.benchmarkProjectLoad.isEmpty()) {
+        MltXmlChecker::benchmark(a.benchmarkProjectLoad, 2000);
+        return 0;
+    }
+    if (a.benchmarkThumbnails)
+        startThumbnailBenchmark(a.mainWindow);
     if (!a.resourceArg.isEmpty())
         a.mainWindow->open(a.resourceArg);
     else
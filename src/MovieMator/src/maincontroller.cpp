@@ -25,8 +25,11 @@
 #include "models/multitrackmodel.h"
 #include "controllers/filtercontroller.h"
 #include "settings.h"
+#include "proxymanager.h"
 #include "docks/encodedock.h"
 #include <QMessageBox>
+#include <QProgressDialog>
+#include <Logger.h>
 #include <qmlapplication.h>
 #include <shotcut_mlt_properties.h>
 
@@ -34,6 +37,7 @@
 
 static MainController *g_mainController = nullptr;
 MainController::MainController(QObject *parent) : QObject(parent)
+  , m_importer(m_multitrackModel)
 {
 
 }
@@ -77,9 +81,32 @@ void MainController::appendToTimelineTrack(int trackIndex, const QStringList &fi
 //     }
 //     MAIN.timelineDock()->appendFromUrls(trackIndex, fileList);
 
+    // Projects and copy protected files keep their dialogs.
+    QStringList media;
     foreach (QString file, files) {
-        appendToTimelineFromPath(trackIndex, file);
+        if (file.endsWith(".mmp", Qt::CaseInsensitive)
+                || file.endsWith(".vob", Qt::CaseInsensitive) || file.endsWith(".m4p", Qt::CaseInsensitive))
+            appendToTimelineFromPath(trackIndex, file);
+        else
+            media << file;
     }
+    if (media.size() == 1) {
+        appendToTimelineFromPath(trackIndex, media.first());
+        return;
+    }
+    if (media.isEmpty())
+        return;
+    if (!m_importer.start(trackIndex, media)) {
+        LOG_WARNING() << "an import is already running, ignoring" << media.size() << "files";
+        return;
+    }
+
+    QProgressDialog* progressDialog = new QProgressDialog(tr("Importing files..."), tr("Cancel"), 0, media.size(), &MAIN);
+    progressDialog->setWindowModality(Qt::WindowModal);
+    progressDialog->setMinimumDuration(500);
+    connect(&m_importer, SIGNAL(progress(int,int)), progressDialog, SLOT(setValue(int)));
+    connect(progressDialog, SIGNAL(canceled()), &m_importer, SLOT(cancel()));
+    connect(&m_importer, SIGNAL(finished(int)), progressDialog, SLOT(deleteLater()));
 }
 
 int MainController::appendToTimelineFromPath(int trackIndex, const QString &path)
@@ -127,6 +154,7 @@ int MainController::appendToTimelineFromPath(int trackIndex, const QString &path
             p->set("mute_on_pause", 0);
         }
         MLT.setImageDurationFromDefault(p);
+        ProxyManager::generateIfNeeded(*p);
         MAIN.appendClipToPlaylist();
         MAIN.onFileOpened(path);
 
@@ -387,6 +415,16 @@ void MainController::redo()
     MAIN.undoStack()->redo();
 }
 
+void MainController::beginBatch(const QString &text)
+{
+    MAIN.beginBatch(text);
+}
+
+void MainController::endBatch()
+{
+    MAIN.endBatch();
+}
+
 void MainController::exportFile(const QString &path)
 {
     Q_ASSERT(MAIN.encodeDock());
@@ -21,6 +21,7 @@
 
 #include <QObject>
 #include "models/multitrackmodel.h"
+#include "mediaimporter.h"
 
 
 
@@ -38,6 +39,7 @@ signals:
 public slots:
     int initPythonQt();
     void evalFile(const QString& file);
+    //多个文件在后台线程打开，全部完成后作为一次操作添加到轨道
     void appendToTimelineTrack(int trackIndex, const QStringList& files);
 
     //返回clipIndex，失败返回-1
@@ -73,6 +75,10 @@ public slots:
     void undo();
     void redo();
 
+    //批量操作：begin和 end之间的修改作为一步撤销，时间线只刷新一次
+    void beginBatch(const QString& text);
+    void endBatch();
+
     void exportFile(const QString& path);
 
     int videoTrackNums();
@@ -83,6 +89,7 @@ public slots:
 
 private:
     MultitrackModel m_multitrackModel;
+    MediaImporter m_importer;
 
 };
 
@@ -59,8 +59,11 @@
 #include "settings.h"
 //#include "leapnetworklistener.h"
 #include "database.h"
+#include "mediahash.h"
 #include "widgets/gltestwidget.h"
 #include "docks/timelinedock.h"
+#include "timelinerendercache.h"
+#include "proxymanager.h"
 #include "widgets/lumamixtransition.h"
 #include "qmltypes/mmqmlutilities.h"
 #include <qmlapplication.h>
@@ -71,6 +74,8 @@
 #include "dialogs/textviewerdialog.h"
 #include "widgets/gdigrabwidget.h"
 #include "models/audiolevelstask.h"
+#include "commands/abstractcommand.h"
+#include "commands/undohelper.h"
 #include "widgets/trackpropertieswidget.h"
 #include "widgets/timelinepropertieswidget.h"
 #include "dialogs/unlinkedfilesdialog.h"
@@ -189,6 +194,8 @@ MainWindow::MainWindow()
     : QMainWindow(nullptr)
     , ui(new Ui::MainWindow)
     , m_isKKeyPressed(false)
+    , m_batch(nullptr)
+    , m_batchDepth(0)
 //    , m_meltedServerDock(nullptr)
 //    , m_meltedPlaylistDock(nullptr)
     , m_keyerGroup(nullptr)
@@ -293,6 +300,7 @@ MainWindow::MainWindow()
 
     connect(m_undoStack, SIGNAL(canUndoChanged(bool)), ui->actionUndo, SLOT(setEnabled(bool)));
     connect(m_undoStack, SIGNAL(canRedoChanged(bool)), ui->actionRedo, SLOT(setEnabled(bool)));
+    connect(m_undoStack, SIGNAL(indexChanged(int)), this, SLOT(trimUndoHistory()));
 
 
     LOG_DEBUG() << "setStyleSheet(\"QMainWindow::separator {width: 6px; background: '#1D1E1F'}\");";
@@ -418,6 +426,16 @@ MainWindow::MainWindow()
     connect(m_timelineDock->model(), SIGNAL(seeked(int)), SLOT(seekTimeline(int)));
     connect(m_timelineDock, SIGNAL(selected(Mlt::Producer*)), SLOT(loadProducerWidget(Mlt::Producer*)));
     connect(m_timelineDock, SIGNAL(selectionChanged()), SLOT(onTimelineSelectionChanged()));
+
+    m_renderCache = new TimelineRenderCache(*m_timelineDock->model(), this);
+    ui->actionRenderPreviewAuto->setChecked(m_renderCache->isAutomatic());
+    ui->actionUseProxy->setChecked(Settings.proxyEnabled());
+    connect(m_renderCache, SIGNAL(showStatusMessage(QString)), SLOT(showStatusMessage(QString)));
+    connect(m_timelineDock->model(), SIGNAL(created()), m_renderCache, SLOT(reattach()));
+    connect(m_timelineDock->model(), SIGNAL(loaded()), m_renderCache, SLOT(reattach()));
+    connect(m_timelineDock->model(), SIGNAL(closed()), m_renderCache, SLOT(detach()));
+    connect(m_timelineDock->model(), SIGNAL(modified()), m_renderCache, SLOT(invalidate()));
+    m_renderCache->reattach();
     connect(m_timelineDock, SIGNAL(clipCopied()), SLOT(onClipCopied()));
 //    connect(m_playlistDock, SIGNAL(addAllTimeline(Mlt::Playlist*)), SLOT(onTimelineDockTriggered()));
 //    connect(m_playlistDock, SIGNAL(addAllTimeline(Mlt::Playlist*)), SLOT(onAddAllToTimeline(Mlt::Playlist*)));
@@ -864,6 +882,11 @@ void MainWindow::setupSettingsMenu()
     } else {
         delete ui->menuGamma;
     }
+    group = new QActionGroup(this);
+    group->addAction(ui->actionPreviewScaleFull);
+    group->addAction(ui->actionPreviewScaleHalf);
+    group->addAction(ui->actionPreviewScaleQuarter);
+    group->addAction(ui->actionPreviewScaleAuto);
     m_profileGroup = new QActionGroup(this);
     m_profileGroup->addAction(ui->actionProfileAutomatic);
     ui->actionProfileAutomatic->setData(QString());
@@ -1230,6 +1253,7 @@ bool MainWindow::saveRepairedXmlFile(MltXmlChecker& checker, QString& fileName)
         }
         repaired.close();
         if (n == xml.size()) {
+            ProxyManager::filterXMLFile(repaired.fileName(), false);
             fileName = repaired.fileName();
             return true;
         }
@@ -1364,23 +1388,7 @@ QString MainWindow::untitledFileName() const
 
 QString MainWindow::getFileHash(const QString& path) const
 {
-    // This routine is intentionally copied from Kdenlive.
-    QFile file(path);
-    if (file.open(QIODevice::ReadOnly)) {
-        QByteArray fileData;
-         // 1 MB = 1 second per 450 files (or faster)
-         // 10 MB = 9 seconds per 450 files (or faster)
-        if (file.size() > 1000000*2) {
-            fileData = file.read(1000000);
-            if (file.seek(file.size() - 1000000))
-                fileData.append(file.readAll());
-        } else {
-            fileData = file.readAll();
-        }
-        file.close();
-        return QCryptographicHash::hash(fileData, QCryptographicHash::Md5).toHex();
-    }
-    return QString();
+    return MediaHash::singleton().hash(path);
 }
 
 
@@ -1410,11 +1418,11 @@ void MainWindow::updateAutoSave()
         m_autosaveTimer.start();
 }
 
-static void openFileTask(MainWindow *p, QString url, const Mlt::Properties* properties)
+static void openFileTask(MainWindow *p, QString url, const Mlt::Properties* properties, const QString& projectUrl)
 {
     Q_ASSERT(p);
     LOG_DEBUG() << "Open project";
-    p->open1(url, properties);
+    p->open1(url, properties, projectUrl);
     emit p->hideProgressDialog();
 }
 
@@ -1447,9 +1455,12 @@ void MainWindow::open(QString url, const Mlt::Properties* properties)
 #endif
 
     bool modified = false;
+    // The copy of the project that uses proxies or opens its media lazily,
+    // if any; url stays the project.
+    QString proxyUrl;
+    MltXmlChecker checker;
     if ( url.endsWith(".mmp")) {//xjp
 
-        MltXmlChecker checker;
         if (checker.check(url)) {
             if (!isCompatibleWithGpuMode(checker))
                 return;
@@ -1475,6 +1486,10 @@ void MainWindow::open(QString url, const Mlt::Properties* properties)
         if (!isXmlRepaired(checker, url))
             return;
         modified = checkAutoSave(url);
+        if (!modified && (checker.usesProxies() || checker.defersMedia()) && !checker.isCorrected())
+            proxyUrl = checker.tempFileName();
+        if (checker.defersMedia())
+            LOG_INFO() << checker.deferredCount() << "producers open their media when first played";
         // let the new project change the profile
         if (modified || QFile::exists(url)) {
             MLT.profile().set_explicit(false);
@@ -1506,7 +1521,10 @@ void MainWindow::open(QString url, const Mlt::Properties* properties)
         progressDialog.setModal(false);                        // 指定进度条的模态:true(模态),false(非模态)
         progressDialog.show();
         qApp->processEvents();
-        openFileTask(this, url, properties);
+        if (proxyUrl.isEmpty())
+            openFileTask(this, url, properties, QString());
+        else
+            openFileTask(this, proxyUrl, properties, url);
         //QFuture<void> fut1 = QtConcurrent::run(openFileTask, this, url, properties);
         //fut1.waitForFinished();
         //showLoadProgress();
@@ -1528,9 +1546,19 @@ void MainWindow::open(QString url, const Mlt::Properties* properties)
     }
 }
 
-void MainWindow::open1(QString url, const Mlt::Properties *properties)
+void MainWindow::open1(QString url, const Mlt::Properties *properties, const QString& projectUrl)
 {
     if (!MLT.open(url)) {
+        if (!projectUrl.isEmpty()) {
+            // Opened a copy that uses proxies; the project is still the original file.
+            MLT.setURL(projectUrl);
+            url = projectUrl;
+        } else if (MLT.isClip()) {
+            ProxyManager::generateIfNeeded(*MLT.producer());
+            Mlt::Producer* proxy = ProxyManager::proxyProducer(*MLT.producer());
+            if (proxy)
+                MLT.setProducer(proxy);
+        }
         Mlt::Properties* props = const_cast<Mlt::Properties*>(properties);
 //        Q_ASSERT(props);
 //        Q_ASSERT(props->is_valid());
@@ -1828,6 +1856,13 @@ void MainWindow::readPlayerSettings()
     else
         ui->actionGammaSRGB->setChecked(true);
 
+    switch (Settings.playerPreviewScale()) {
+    case 0: ui->actionPreviewScaleAuto->setChecked(true); break;
+    case 2: ui->actionPreviewScaleHalf->setChecked(true); break;
+    case 4: ui->actionPreviewScaleQuarter->setChecked(true); break;
+    default: ui->actionPreviewScaleFull->setChecked(true); break;
+    }
+
     LOG_DEBUG() << "end";
 }
 
@@ -2743,7 +2778,50 @@ QUndoStack* MainWindow::undoStack() const
 void MainWindow::pushCommand(QUndoCommand *command)
 {
     Q_ASSERT(g_isInUndoRedoProcess == false);
-    m_undoStack->push(command);
+    if (m_batch)
+        m_batch->add(command);
+    else
+        m_undoStack->push(command);
+}
+
+void MainWindow::beginBatch(const QString &text)
+{
+    if (m_batchDepth++ > 0)
+        return;
+    Q_ASSERT(!m_batch);
+    m_batch = new Timeline::BatchCommand(*m_timelineDock->model(), text);
+    m_timelineDock->model()->beginTransaction();
+}
+
+void MainWindow::endBatch()
+{
+    Q_ASSERT(m_batchDepth > 0);
+    if (m_batchDepth <= 0 || --m_batchDepth > 0)
+        return;
+    Timeline::BatchCommand* batch = m_batch;
+    m_batch = nullptr;
+    m_timelineDock->model()->commitTransaction();
+    if (batch->isEmpty())
+        delete batch;
+    else
+        m_undoStack->push(batch);
+}
+
+void MainWindow::trimUndoHistory()
+{
+    qint64 limit = qint64(Settings.undoMemoryLimit()) * 1024 * 1024;
+    UndoXml::Stats stats = UndoHelper::historyStats();
+    // Always keep the command that was just done.
+    for (int i = 0; limit > 0 && stats.storedBytes > limit && i < m_undoStack->index() - 1; ++i) {
+        if (AbstractCommand::discard(const_cast<QUndoCommand*>(m_undoStack->command(i)))) {
+            LOG_INFO() << "undo history over" << Settings.undoMemoryLimit() << "MB, discarded" << m_undoStack->command(i)->text();
+            stats = UndoHelper::historyStats();
+        }
+    }
+    m_historyDock->setToolTip(tr("Undo history: %1 documents, %2 MB (%3 MB uncompressed)")
+                              .arg(stats.documents)
+                              .arg(stats.storedBytes / 1048576.0, 0, 'f', 1)
+                              .arg(stats.rawBytes / 1048576.0, 0, 'f', 1));
 }
 
 void MainWindow::onEncodeTriggered(bool checked)
@@ -2982,6 +3060,7 @@ void MainWindow::onCutModified()
 
 void MainWindow::onFilterModelChanged()
 {
+    m_renderCache->invalidate();
     setWindowModified(true);
     updateAutoSave();
 //    if (playlist())
@@ -3057,6 +3136,8 @@ void MainWindow::saveXML(const QString &filename, bool withRelativePaths)
     } else {
         MLT.saveXML(filename, nullptr, withRelativePaths);
     }
+    // Projects always refer to the original media.
+    ProxyManager::filterXMLFile(filename, false);
 }
 
 void MainWindow::changeTheme(const QString &theme)
@@ -3865,6 +3946,36 @@ void MainWindow::on_actionGammaRec709_triggered(bool checked)
     MLT.refreshConsumer();
 }
 
+void MainWindow::setPreviewScale(int scale)
+{
+    Settings.setPlayerPreviewScale(scale);
+    static_cast<Mlt::GLWidget*>(&(MLT))->setPreviewScale(scale);
+}
+
+void MainWindow::on_actionPreviewScaleFull_triggered(bool checked)
+{
+    Q_UNUSED(checked)
+    setPreviewScale(1);
+}
+
+void MainWindow::on_actionPreviewScaleHalf_triggered(bool checked)
+{
+    Q_UNUSED(checked)
+    setPreviewScale(2);
+}
+
+void MainWindow::on_actionPreviewScaleQuarter_triggered(bool checked)
+{
+    Q_UNUSED(checked)
+    setPreviewScale(4);
+}
+
+void MainWindow::on_actionPreviewScaleAuto_triggered(bool checked)
+{
+    Q_UNUSED(checked)
+    setPreviewScale(0);
+}
+
 void MainWindow::onFocusChanged(QWidget *, QWidget * ) const
 {
     LOG_DEBUG() << "Focuswidget changed";
@@ -4000,6 +4111,43 @@ void MainWindow::on_actionExport_selected_clip_as_template_file_triggered()
     m_timelineDock->exportSelectedClipAsTemplate();
 }
 
+void MainWindow::on_actionRenderPreviewSelection_triggered()
+{
+    MultitrackModel* model = m_timelineDock->model();
+    TIMELINE_SELECTION selection = model->selection();
+    if (selection.nIndexOfSelectedTrack < 0 || selection.nIndexOfSelectedClip < 0) {
+        showStatusMessage(tr("Select a clip in the timeline first"));
+        return;
+    }
+    QModelIndex index = model->index(selection.nIndexOfSelectedClip, 0, model->index(selection.nIndexOfSelectedTrack));
+    int start = model->data(index, MultitrackModel::StartRole).toInt();
+    int duration = model->data(index, MultitrackModel::DurationRole).toInt();
+    m_renderCache->markRange(start, start + duration - 1);
+}
+
+void MainWindow::on_actionRenderPreviewTimeline_triggered()
+{
+    if (multitrack())
+        m_renderCache->markRange(0, multitrack()->get_playtime() - 1);
+}
+
+void MainWindow::on_actionRenderPreviewAuto_triggered(bool checked)
+{
+    Settings.setTimelineRenderPreviewAuto(checked);
+    m_renderCache->setAutomatic(checked);
+}
+
+void MainWindow::on_actionUseProxy_triggered(bool checked)
+{
+    Settings.setProxyEnabled(checked);
+    showStatusMessage(tr("Proxies take effect for media opened from now on and when projects are opened."));
+}
+
+void MainWindow::on_actionClearRenderPreview_triggered()
+{
+    m_renderCache->clear();
+}
+
 void MainWindow::onClipCopied()
 {
     m_player->enableTab(Player::SourceTabIndex);
@@ -4779,6 +4927,7 @@ void MainWindow::onExportTemplate()
         if (fi.suffix() != "mlt")
             filename += ".mlt";
         MLT.saveXML(tmp.fileName(), tempTractor, true);
+        ProxyManager::filterXMLFile(tmp.fileName(), false);
         QFile::remove(filename);
         QFile::copy(tmp.fileName(), filename);
         QFile::remove(tmp.fileName());
@@ -47,6 +47,9 @@
 namespace Ui {
     class MainWindow;
 }
+namespace Timeline {
+    class BatchCommand;
+}
 class Player;
 class EncodeDock;
 class JobsDock;
@@ -60,6 +63,7 @@ class ScopeController;
 class FiltersDock;
 //class HtmlEditor;
 class TimelineDock;
+class TimelineRenderCache;
 class AutoSaveFile;
 class QNetworkReply;
 class FilterWidget;
@@ -209,9 +213,12 @@ private:
     JobsDock* m_jobsDock;//导出文件进度列表dock
 //    PlaylistDock* m_playlistDock;//旧的文件列表dock，暂时无用
     TimelineDock* m_timelineDock;//底下时间线dock
+    TimelineRenderCache* m_renderCache;//时间线预渲染缓存
     QString m_currentFile;//当前的工程文件名
     bool m_isKKeyPressed;//是否按键按下
     QUndoStack* m_undoStack;//undo、redo栈
+    Timeline::BatchCommand* m_batch;//beginBatch()之后 push的 command都加到这里
+    int m_batchDepth;
     QDockWidget* m_historyDock;
 //    MeltedServerDock* m_meltedServerDock;
 //    MeltedPlaylistDock* m_meltedPlaylistDock;
@@ -306,7 +313,7 @@ public slots:
     bool isXmlRepaired(MltXmlChecker& checker, QString& fileName);//修改工程文件xml
     void updateAutoSave();//开启自动保存工程文件
     void open(QString url, const Mlt::Properties* = nullptr);//打开文件
-    void open1(QString url, const Mlt::Properties * = nullptr);
+    void open1(QString url, const Mlt::Properties * = nullptr, const QString& projectUrl = QString());
     void openVideo();//打开多选文件
     void openCut(Mlt::Producer* producer);//打开producer
     void showStatusMessage(QAction* action, int timeoutSeconds = 5);//显示状态信息
@@ -370,6 +377,11 @@ public slots:
     void on_actionCopy_triggered();
     void on_actionPaste_triggered();
     void on_actionExport_selected_clip_as_template_file_triggered();
+    void on_actionRenderPreviewSelection_triggered();
+    void on_actionRenderPreviewTimeline_triggered();
+    void on_actionRenderPreviewAuto_triggered(bool checked);
+    void on_actionUseProxy_triggered(bool checked);
+    void on_actionClearRenderPreview_triggered();
 
     void on_tasksDockTriggered(bool);
 
@@ -385,6 +397,9 @@ public slots:
 
     void setCurrentFilterForVideoWidget(QObject* filter, QmlMetadata* meta);//设置当前的filter的vui.qml到视频播放widget，目前只有text、sizeAndPosition滤镜需要
     void pushCommand(QUndoCommand *command);//添加一条命令到undostack
+    //批量操作：之间 push的 command作为一步撤销，时间线只在 endBatch()时刷新一次。可以嵌套
+    void beginBatch(const QString& text);
+    void endBatch();
 
     void onFileOpened(QString filePath);//添加文件到文件里列表dock
     void onOpenFailed(QString filePath);//打开文件失败
@@ -414,6 +429,7 @@ private slots:
     void onPlaylistDockTriggered(bool checked = true);//无用函数
     void onTimelineDockTriggered(bool checked = true);
     void onHistoryDockTriggered(bool checked = true);//无用函数
+    void trimUndoHistory();//撤销历史超出内存上限时丢弃最早的 command
     void onFiltersDockTriggered(bool checked = true);//无用函数
 
     void onPlaylistCreated();//暂未用到
@@ -469,6 +485,11 @@ private slots:
     void onAutosaveTimeout();
     void on_actionGammaSRGB_triggered(bool checked);//设置播放预览的gamma为iec61966_2_1
     void on_actionGammaRec709_triggered(bool checked);//设置播放预览的gamma为bt709
+    void on_actionPreviewScaleFull_triggered(bool checked);
+    void on_actionPreviewScaleHalf_triggered(bool checked);
+    void on_actionPreviewScaleQuarter_triggered(bool checked);
+    void on_actionPreviewScaleAuto_triggered(bool checked);//播放跟不上时自动降低预览分辨率
+    void setPreviewScale(int scale);
     void onFocusChanged(QWidget *old, QWidget * now) const;
     void onFocusObjectChanged(QObject *obj) const;
     void onFocusWindowChanged(QWindow *window) const;
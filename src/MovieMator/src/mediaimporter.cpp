@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "mediaimporter.h"
+#include "mainwindow.h"
+#include "mltcontroller.h"
+#include "proxymanager.h"
+#include "settings.h"
+#include "models/multitrackmodel.h"
+#include "commands/timelinecommands.h"
+#include <QRunnable>
+#include <QThread>
+#include <QAtomicInt>
+#include <Logger.h>
+
+// The batch the workers are opening files for; 0 when none is.
+static QAtomicInt activeBatch(0);
+
+class MediaImportRunner : public QRunnable
+{
+public:
+    MediaImportRunner(MediaImporter* importer, int batch, int index, const QString& path)
+        : QRunnable()
+        , m_importer(importer)
+        , m_batch(batch)
+        , m_index(index)
+        , m_path(path)
+    {
+    }
+
+    void run()
+    {
+        if (activeBatch.load() != m_batch)
+            return;
+        QString xml;
+        QString proxyHash;
+        int mediaHeight = 0;
+        Mlt::Producer producer(MLT.profile(), m_path.toUtf8().constData());
+        if (producer.is_valid() && activeBatch.load() == m_batch) {
+            // Convert avformat to avformat-novalidate so that XML loads faster.
+            if (!qstrcmp(producer.get("mlt_service"), "avformat")) {
+                producer.set("mlt_service", "avformat-novalidate");
+                producer.set("mute_on_pause", 0);
+            }
+            MLT.setImageDurationFromDefault(&producer);
+            // Hashing reads the file, so do it here; the job is queued on the main thread.
+            if (Settings.proxyEnabled() && ProxyManager::needsProxy(producer)) {
+                proxyHash = MLT.getHash(producer);
+                mediaHeight = producer.get_int("meta.media.height");
+            }
+            xml = MLT.XML(&producer);
+        }
+        QMetaObject::invokeMethod(m_importer, "onOpened", Qt::QueuedConnection,
+                                  Q_ARG(int, m_batch), Q_ARG(int, m_index), Q_ARG(QString, xml),
+                                  Q_ARG(QString, proxyHash), Q_ARG(int, mediaHeight));
+    }
+
+private:
+    MediaImporter* m_importer;
+    int m_batch;
+    int m_index;
+    QString m_path;
+};
+
+MediaImporter::MediaImporter(MultitrackModel& model, QObject* parent)
+    : QObject(parent)
+    , m_model(model)
+    , m_batch(0)
+    , m_trackIndex(-1)
+    , m_done(0)
+    , m_total(0)
+{
+    // Opening is mostly waiting on the disk and demuxer probing.
+    m_pool.setMaxThreadCount(qBound(2, QThread::idealThreadCount(), 8));
+}
+
+MediaImporter::~MediaImporter()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+bool MediaImporter::start(int trackIndex, const QStringList& files)
+{
+    if (isRunning() || files.isEmpty())
+        return false;
+    static int nextBatch = 1;
+    m_batch = nextBatch++;
+    m_trackIndex = trackIndex;
+    m_files = files;
+    m_xml = QVector<QString>(files.size());
+    m_proxyHash = QVector<QString>(files.size());
+    m_mediaHeight = QVector<int>(files.size(), 0);
+    m_done = 0;
+    m_total = files.size();
+    activeBatch = m_batch;
+    LOG_INFO() << "importing" << m_total << "files to track" << trackIndex;
+    for (int i = 0; i < files.size(); ++i)
+        m_pool.start(new MediaImportRunner(this, m_batch, i, files.at(i)));
+    emit progress(0, m_total);
+    return true;
+}
+
+void MediaImporter::cancel()
+{
+    if (!isRunning())
+        return;
+    LOG_INFO() << "import canceled after" << m_done << "of" << m_total << "files";
+    activeBatch = 0;
+    m_pool.clear();
+    m_files.clear();
+    m_xml.clear();
+    m_proxyHash.clear();
+    m_mediaHeight.clear();
+    m_done = m_total = 0;
+    emit finished(0);
+}
+
+void MediaImporter::onOpened(int batch, int index, const QString& xml, const QString& proxyHash, int mediaHeight)
+{
+    if (batch != m_batch || !isRunning())
+        return;
+    if (xml.isEmpty()) {
+        LOG_WARNING() << "failed to open" << m_files.at(index);
+        emit failed(m_files.at(index));
+    } else {
+        m_xml[index] = xml;
+        m_proxyHash[index] = proxyHash;
+        m_mediaHeight[index] = mediaHeight;
+    }
+    ++m_done;
+    emit progress(m_done, m_total);
+    if (m_done == m_total)
+        commit();
+}
+
+void MediaImporter::commit()
+{
+    activeBatch = 0;
+    int count = 0;
+    if (m_trackIndex >= 0 && m_trackIndex < m_model.trackList().size()) {
+        for (int i = 0; i < m_xml.size(); ++i) {
+            if (m_xml.at(i).isEmpty())
+                continue;
+            if (count++ == 0)
+                MAIN.beginBatch(tr("Append %n file(s) to track", nullptr, m_total));
+            MAIN.pushCommand(new Timeline::AppendClipCommand(m_model, m_trackIndex, m_xml.at(i)));
+            MAIN.onFileOpened(m_files.at(i));
+            if (!m_proxyHash.at(i).isEmpty())
+                ProxyManager::generate(m_files.at(i), m_proxyHash.at(i), m_mediaHeight.at(i));
+        }
+        if (count)
+            MAIN.endBatch();
+    } else {
+        LOG_WARNING() << "track" << m_trackIndex << "is gone, nothing imported";
+    }
+    LOG_INFO() << "imported" << count << "of" << m_total << "files";
+    m_files.clear();
+    m_xml.clear();
+    m_proxyHash.clear();
+    m_mediaHeight.clear();
+    m_done = m_total = 0;
+    emit finished(count);
+}
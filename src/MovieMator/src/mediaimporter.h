@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MEDIAIMPORTER_H
+#define MEDIAIMPORTER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <QThreadPool>
+
+class MultitrackModel;
+
+/*!
+  \class MediaImporter
+  \brief Opens many media files on a thread pool and appends them to a track.
+
+  Each file is opened, probed and serialized to XML by a worker; nothing
+  touches the timeline until every file of the batch is done. The clips are
+  then appended in the order the files were given, as one batch. A
+  file that fails to open is skipped and reported with failed(). Large
+  media is hashed by the worker and gets its proxy job queued on commit.
+
+  One batch runs at a time; start() returns false while one is running.
+  cancel() drops the batch: the files still queued are not opened and
+  nothing is appended.
+
+  \threadsafe Use from the main thread only.
+*/
+class MediaImporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MediaImporter(MultitrackModel& model, QObject* parent = nullptr);
+    ~MediaImporter();
+
+    bool start(int trackIndex, const QStringList& files);
+    bool isRunning() const { return m_total > 0; }
+
+public slots:
+    void cancel();
+
+signals:
+    void progress(int done, int total);
+    void failed(const QString& path);
+    // The number of clips appended, 0 if canceled.
+    void finished(int count);
+
+private slots:
+    void onOpened(int batch, int index, const QString& xml, const QString& proxyHash, int mediaHeight);
+
+private:
+    void commit();
+
+    MultitrackModel& m_model;
+    QThreadPool m_pool;
+    int m_batch;
+    int m_trackIndex;
+    QStringList m_files;
+    QVector<QString> m_xml;
+    // The hash and height of media that needs a proxy, empty hash if none does.
+    QVector<QString> m_proxyHash;
+    QVector<int> m_mediaHeight;
+    int m_done;
+    int m_total;
+};
+
+#endif // MEDIAIMPORTER_H
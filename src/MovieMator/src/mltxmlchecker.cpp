@@ -24,11 +24,14 @@
 #include "mltcontroller.h"
 #include "shotcut_mlt_properties.h"
 #include "util.h"
+#include "settings.h"
+#include "proxymanager.h"
 #include <QLocale>
 #include <QDir>
 #include <QCoreApplication>
 #include <QUrl>
 #include <QRegExp>
+#include <QElapsedTimer>
 #include <Logger.h>
 
 #if defined (Q_OS_MAC)
@@ -67,6 +70,9 @@ MltXmlChecker::MltXmlChecker()
     : m_needsGPU(false)
     , m_hasEffects(false)
     , m_isCorrected(false)
+    , m_usesProxies(false)
+    , m_lazyLoad(Settings.projectLazyLoad())
+    , m_deferredCount(0)
     , m_decimalPoint(QLocale::system().decimalPoint())
     , m_tempFile(QDir::tempPath().append("/moviemator-XXXXXX.xml"))//xjp
     , m_hasComma(false)
@@ -225,6 +231,10 @@ void MltXmlChecker::processProperties()
     if (mlt_class == "filter" || mlt_class == "transition" || mlt_class == "producer") {
         checkGpuEffects(mlt_service);
         checkUnlinkedFile(mlt_service);
+        if (mlt_class == "producer") {
+            checkProxy(mlt_service, newProperties);
+            checkLazyLoad(mlt_service, newProperties);
+        }
 
         // Second pass: amend property values.
         m_properties = newProperties;
@@ -262,6 +272,63 @@ void MltXmlChecker::processProperties()
     m_properties.clear();
 }
 
+// Point producers at the proxies of their media. A project may also carry
+// an existing mapping (e.g. an autosave from an older version); it is kept
+// only while its proxy exists.
+void MltXmlChecker::checkProxy(const QString& mlt_service, QVector<MltProperty>& properties)
+{
+    int resourceIndex = -1;
+    int originalIndex = -1;
+    for (int i = 0; i < properties.size(); ++i) {
+        if (properties[i].first == "resource")
+            resourceIndex = i;
+        else if (properties[i].first == kOriginalResourceProperty)
+            originalIndex = i;
+    }
+    if (resourceIndex < 0 || !mlt_service.startsWith("avformat"))
+        return;
+
+    QString hash = m_resource.newHash.isEmpty()? m_resource.hash : m_resource.newHash;
+    bool useProxy = Settings.proxyEnabled() && ProxyManager::hasProxy(hash);
+    if (originalIndex >= 0) {
+        if (!useProxy) {
+            properties[resourceIndex].second = properties[originalIndex].second;
+            properties.remove(originalIndex);
+            return;
+        }
+    } else if (useProxy) {
+        properties << MltProperty(kOriginalResourceProperty, properties[resourceIndex].second);
+    } else {
+        return;
+    }
+    properties[resourceIndex].second = ProxyManager::proxyPath(hash);
+    m_usesProxies = true;
+}
+
+// avformat opens, probes and sets up the decoders of every file as the
+// project is parsed; avformat-novalidate does that on the first frame. The
+// timeline only needs what the project already says about the clip: its
+// length, the in and out of its entries and its hash.
+void MltXmlChecker::checkLazyLoad(const QString& mlt_service, QVector<MltProperty>& properties)
+{
+    if (!m_lazyLoad || mlt_service != "avformat")
+        return;
+    // Without a length the producer must probe the file to get one.
+    int serviceIndex = -1;
+    bool hasLength = false;
+    for (int i = 0; i < properties.size(); ++i) {
+        if (properties[i].first == "mlt_service")
+            serviceIndex = i;
+        else if (properties[i].first == "length")
+            hasLength = properties[i].second.toInt() > 0;
+    }
+    // An unlinked file is left to fail where the user is told about it.
+    if (serviceIndex < 0 || !hasLength || !m_resource.info.exists())
+        return;
+    properties[serviceIndex].second = "avformat-novalidate";
+    ++m_deferredCount;
+}
+
 void MltXmlChecker::checkInAndOutPoints()
 {
     Q_ASSERT(m_xml.isStartElement());
@@ -496,3 +563,105 @@ void MltXmlChecker::fixStreamIndex(QString& value)
         value.clear();
     }
 }
+
+// Descriptors the process holds, or -1 where that is not cheap to know.
+static int openFileCount()
+{
+#if defined(Q_OS_LINUX)
+    return QDir("/proc/self/fd").entryList(QDir::NoDotAndDotDot | QDir::AllEntries | QDir::System).size();
+#else
+    return -1;
+#endif
+}
+
+void MltXmlChecker::benchmark(const QString& mediaFile, int clips)
+{
+    Mlt::Producer media(MLT.profile(), mediaFile.toUtf8().constData());
+    if (!media.is_valid() || qstrcmp(media.get("mlt_service"), "avformat")) {
+        LOG_WARNING() << "project load benchmark: not a media file" << mediaFile;
+        return;
+    }
+    const int length = media.get_length();
+    const int clipOut = qMin(length, 50) - 1;
+    const QString resource = QFileInfo(mediaFile).absoluteFilePath();
+
+    // One track with a producer per clip, as in a project of that many
+    // imported files.
+    QTemporaryFile project(QDir::tempPath().append("/moviemator-benchmark-XXXXXX.mmp"));
+    if (!project.open())
+        return;
+    QXmlStreamWriter xml(&project);
+    auto property = [&xml](const QString& name, const QString& value) {
+        xml.writeStartElement("property");
+        xml.writeAttribute("name", name);
+        xml.writeCharacters(value);
+        xml.writeEndElement();
+    };
+    xml.setAutoFormatting(true);
+    xml.writeStartDocument();
+    xml.writeStartElement("mlt");
+    xml.writeAttribute("LC_NUMERIC", "C");
+    for (int i = 0; i < clips; ++i) {
+        xml.writeStartElement("producer");
+        xml.writeAttribute("id", QString("producer%1").arg(i));
+        xml.writeAttribute("in", "0");
+        xml.writeAttribute("out", QString::number(length - 1));
+        property("length", QString::number(length));
+        property("resource", resource);
+        property("mlt_service", "avformat");
+        property(kShotcutHashProperty, QString("%1").arg(i, 32, 16, QChar('0')));
+        xml.writeEndElement();
+    }
+    xml.writeStartElement("playlist");
+    xml.writeAttribute("id", "playlist0");
+    property(kVideoTrackProperty, "1");
+    for (int i = 0; i < clips; ++i) {
+        xml.writeStartElement("entry");
+        xml.writeAttribute("producer", QString("producer%1").arg(i));
+        xml.writeAttribute("in", "0");
+        xml.writeAttribute("out", QString::number(clipOut));
+        xml.writeEndElement();
+    }
+    xml.writeEndElement();
+    xml.writeStartElement("tractor");
+    xml.writeAttribute("id", "tractor0");
+    xml.writeStartElement("track");
+    xml.writeAttribute("producer", "playlist0");
+    xml.writeEndElement();
+    xml.writeEndElement();
+    xml.writeEndElement();
+    xml.writeEndDocument();
+    project.close();
+
+    const int filesBefore = openFileCount();
+    QElapsedTimer timer;
+    timer.start();
+    qint64 eagerMs, eagerFiles, checkMs, lazyMs, lazyFiles, firstFrameMs;
+    {
+        Mlt::Producer eager(MLT.profile(), "xml", project.fileName().toUtf8().constData());
+        eagerMs = timer.elapsed();
+        eagerFiles = openFileCount() - filesBefore;
+        if (!eager.is_valid())
+            LOG_WARNING() << "project load benchmark: the project did not load";
+    }
+    timer.restart();
+    MltXmlChecker checker;
+    checker.setLazyLoad(true);
+    checker.check(project.fileName());
+    checkMs = timer.elapsed();
+    timer.restart();
+    {
+        Mlt::Producer lazy(MLT.profile(), "xml", checker.tempFileName().toUtf8().constData());
+        lazyMs = timer.elapsed();
+        lazyFiles = openFileCount() - filesBefore;
+        // What the first clip costs when playback reaches it.
+        timer.restart();
+        delete lazy.get_frame();
+        firstFrameMs = timer.elapsed();
+    }
+    LOG_INFO() << "project load benchmark:" << clips << "clips of" << resource;
+    LOG_INFO() << "project load benchmark: eager" << eagerMs << "ms," << eagerFiles << "files open";
+    LOG_INFO() << "project load benchmark: lazy" << checkMs + lazyMs << "ms (" << checkMs << "ms checking),"
+               << lazyFiles << "files open," << checker.deferredCount() << "producers deferred,"
+               << "first frame" << firstFrameMs << "ms";
+}
@@ -54,6 +54,17 @@ public:
     bool needsGPU() const { return m_needsGPU; }
     bool hasEffects() const { return m_hasEffects; }
     bool isCorrected() const { return m_isCorrected; }
+    // Some media were swapped to proxies in tempFileName().
+    bool usesProxies() const { return m_usesProxies; }
+    // Open media only when a frame is first asked of them; on by default
+    // with Settings.projectLazyLoad().
+    void setLazyLoad(bool enabled) { m_lazyLoad = enabled; }
+    // Some producers in tempFileName() were made to open their media lazily.
+    bool defersMedia() const { return m_deferredCount > 0; }
+    int deferredCount() const { return m_deferredCount; }
+    // Logs how long a synthetic project of clips producers of mediaFile
+    // takes to load, with and without lazy loading.
+    static void benchmark(const QString& mediaFile, int clips);
     QString tempFileName() const { return m_tempFile.fileName(); }
     QStandardItemModel& unlinkedFilesModel() { return m_unlinkedFilesModel; }
 
@@ -74,6 +85,8 @@ private:
     void checkUnlinkedFile(const QString& mlt_service);
     bool fixUnlinkedFile(QString& value);
     void fixStreamIndex(QString& value);
+    void checkProxy(const QString& mlt_service, QVector<MltProperty>& properties);
+    void checkLazyLoad(const QString& mlt_service, QVector<MltProperty>& properties);
 
 #if (defined(MOVIEMATOR_PRO) || defined(MOVIEMATOR_FREE))
 #ifndef SHARE_VERSION
@@ -89,6 +102,9 @@ private:
     bool m_needsGPU;
     bool m_hasEffects;
     bool m_isCorrected;
+    bool m_usesProxies;
+    bool m_lazyLoad;
+    int m_deferredCount;
     QChar m_decimalPoint;
     QTemporaryFile m_tempFile;
     bool m_hasComma;
@@ -17,36 +17,96 @@
  */
 
 #include "audiolevelstask.h"
+#include "audiopeaks.h"
 #include "database.h"
 #include "mltcontroller.h"
 #include "shotcut_mlt_properties.h"
 #include <QString>
-#include <QVariantList>
 #include <QImage>
 #include <QCryptographicHash>
-#include <QRgb>
 #include <QThreadPool>
+#include <QThread>
 #include <QMutex>
+#include <QHash>
 #include <QTime>
+#include <QScopedPointer>
 #include <Logger.h>
 #include <QDebug>
+#include <climits>
 
+// Audio is decoded at this rate and channel count whatever the media has.
+static const int kFrequency = 48000;
+static const int kChannels = 2;
+
+// All tasks not yet finished, and those among them waiting for a thread.
 static QList<AudioLevelsTask*> tasksList;
+static QList<AudioLevelsTask*> pendingTasks;
 static QMutex tasksListMutex;
 
-static void deleteQVariantList(QVariantList* list)
+static QAtomicInt visibleIn(0);
+static QAtomicInt visibleOut(-1);
+
+static void deleteAudioPeaks(AudioPeaksPtr* peaks)
 {
-    delete list;
+    delete peaks;
 }
 
+static QThreadPool& audioLevelsPool()
+{
+    static QThreadPool* pool = nullptr;
+    if (!pool) {
+        pool = new QThreadPool;
+        // Decoding is I/O and CPU heavy; leave room for playback and thumbnails.
+        pool->setMaxThreadCount(qBound(1, QThread::idealThreadCount() / 2, 4));
+    }
+    return *pool;
+}
+
+/*!
+  One is started per queued task; when it gets a thread it runs whichever
+  pending task is nearest to the visible range at that time rather than the
+  one it was started for.
+*/
+class AudioLevelsRunner : public QRunnable
+{
+public:
+    void run()
+    {
+        AudioLevelsTask* task = nullptr;
+        tasksListMutex.lock();
+        int best = -1;
+        int bestDistance = INT_MAX;
+        for (int i = 0; i < pendingTasks.size(); ++i) {
+            int distance = pendingTasks.at(i)->distanceToVisibleRange();
+            if (distance < bestDistance) {
+                best = i;
+                bestDistance = distance;
+            }
+        }
+        if (best >= 0)
+            task = pendingTasks.takeAt(best);
+        tasksListMutex.unlock();
+        if (task) {
+            task->run();
+            delete task;
+        }
+    }
+};
+
 AudioLevelsTask::AudioLevelsTask(Mlt::Producer& producer, MultitrackModel* model, const QModelIndex& index)
     : QRunnable()
     , m_model(model)
+    , m_service(QString::fromUtf8(producer.get("mlt_service")))
+    , m_resource(producer.get("resource"))
+    , m_hash(producer.get(kShotcutHashProperty))
+    , m_audioIndex(producer.get("audio_index")? producer.get_int("audio_index") : -1)
     , m_tempProducer(nullptr)
-    , m_isCanceled(false)
+    , m_isCanceled(0)
     , m_isForce(false)
 {
     m_producers << ProducerAndIndex(new Mlt::Producer(producer), index);
+    int start = model->data(index, MultitrackModel::StartRole).toInt();
+    m_ranges << qMakePair(start, start + model->data(index, MultitrackModel::DurationRole).toInt());
 }
 
 AudioLevelsTask::~AudioLevelsTask()
@@ -54,44 +114,117 @@ AudioLevelsTask::~AudioLevelsTask()
     delete m_tempProducer;
     foreach (ProducerAndIndex p, m_producers)
         delete p.first;
+    qDeleteAll(m_retired);
 }
 
 void AudioLevelsTask::start(Mlt::Producer& producer, MultitrackModel* model, const QModelIndex& index, bool force)
 {
-    Q_UNUSED(producer);
-    Q_UNUSED(model);
-    Q_UNUSED(index);
-    Q_UNUSED(force);
+    if (producer.is_valid() && index.isValid())
+    {
+        tasksListMutex.lock();
+
+        // The task copies what run() needs from the producer while it holds the lock.
+        AudioLevelsTask* pAudioLevelsTask = new AudioLevelsTask(producer, model, index);
+
+        // See if there is already a task for this MLT service and resource.
+        foreach (AudioLevelsTask* pTask, tasksList)
+        {
+            // A running task may have read the cache already, so a forced
+            // request gets a task of its own that runs after it.
+            if (force && !pendingTasks.contains(pTask))
+                continue;
+            if (*pTask == *pAudioLevelsTask)
+            {
+                // If so, then just add ourselves to be notified upon completion.
+                bool known = false;
+                foreach (const ProducerAndIndex& p, pTask->m_producers)
+                    known = known || p.second == index;
+                if (!known) {
+                    pTask->m_producers << ProducerAndIndex(new Mlt::Producer(producer), index);
+                    pTask->m_ranges << pAudioLevelsTask->m_ranges.first();
+                }
+                if (force)
+                    pTask->m_isForce = true;
+                delete pAudioLevelsTask;
+                pAudioLevelsTask = nullptr;
+                break;
+            }
+        }
 
-//    if (producer.is_valid() && index.isValid())
-//    {
-//        AudioLevelsTask* pAudioLevelsTask = new AudioLevelsTask(producer, model, index);
+        if (pAudioLevelsTask)
+        {
+            // Otherwise, queue a new audio levels generation.
+            pAudioLevelsTask->m_isForce = force;
+            tasksList << pAudioLevelsTask;
+            pendingTasks << pAudioLevelsTask;
+            audioLevelsPool().start(new AudioLevelsRunner);
+        }
 
-//        tasksListMutex.lock();
+        tasksListMutex.unlock();
+    }
+}
 
-//        // See if there is already a task for this MLT service and resource.
-//        foreach (AudioLevelsTask* pTask, tasksList)
-//        {
-//            if (*pTask == *pAudioLevelsTask)
-//            {
-//                // If so, then just add ourselves to be notified upon completion.
-//                delete pAudioLevelsTask;
-//                pAudioLevelsTask = nullptr;
-//                pTask->m_producers << ProducerAndIndex(new Mlt::Producer(producer), index);
-//                break;
-//            }
-//        }
+void AudioLevelsTask::reindex(MultitrackModel* model)
+{
+    tasksListMutex.lock();
+    bool stale = false;
+    foreach (AudioLevelsTask* task, tasksList) {
+        if (task->m_model != model)
+            continue;
+        foreach (const ProducerAndIndex& p, task->m_producers)
+            stale = stale || !p.second.isValid();
+    }
+    tasksListMutex.unlock();
+    if (!stale)
+        return;
 
-//        if (pAudioLevelsTask)
-//        {
-//            // Otherwise, start a new audio levels generation thread.
-//            pAudioLevelsTask->m_isForce = force;
-//            tasksList << pAudioLevelsTask;
-//            QThreadPool::globalInstance()->start(pAudioLevelsTask);
-//        }
+    // The clips of every parent producer, at their rows after the reset.
+    QHash<mlt_producer, QList<QModelIndex> > clips;
+    Mlt::Tractor* tractor = model->tractor();
+    const TrackList& tracks = model->trackList();
+    for (int t = 0; tractor && t < tracks.size(); ++t) {
+        QScopedPointer<Mlt::Producer> track(tractor->track(tracks.at(t).mlt_index));
+        if (!track)
+            continue;
+        Mlt::Playlist playlist(*track);
+        for (int i = 0; i < playlist.count(); ++i) {
+            QScopedPointer<Mlt::Producer> clip(playlist.get_clip(i));
+            if (clip && clip->is_valid() && !clip->is_blank())
+                clips[clip->parent().get_producer()] << model->index(i, 0, model->index(t));
+        }
+    }
 
-//        tasksListMutex.unlock();
-//    }
+    QMutexLocker locker(&tasksListMutex);
+    foreach (AudioLevelsTask* task, tasksList) {
+        if (task->m_model != model)
+            continue;
+        QList<ProducerAndIndex> producers;
+        QList< QPair<int, int> > ranges;
+        foreach (const ProducerAndIndex& p, task->m_producers) {
+            QList<QModelIndex> indexes;
+            if (p.second.isValid())
+                indexes << p.second;
+            else
+                indexes = clips.value(p.first->get_producer());
+            Mlt::Producer* producer = p.first;
+            foreach (const QModelIndex& index, indexes) {
+                bool known = false;
+                foreach (const ProducerAndIndex& q, producers)
+                    known = known || q.second == index;
+                if (known)
+                    continue;
+                producers << ProducerAndIndex(producer? producer : new Mlt::Producer(*p.first), index);
+                producer = nullptr;
+                int start = model->data(index, MultitrackModel::StartRole).toInt();
+                ranges << qMakePair(start, start + model->data(index, MultitrackModel::DurationRole).toInt());
+            }
+            // publish() may be using it on the worker thread right now.
+            if (producer)
+                task->m_retired << producer;
+        }
+        task->m_producers = producers;
+        task->m_ranges = ranges;
+    }
 }
 
 void AudioLevelsTask::closeAll()
@@ -99,44 +232,66 @@ void AudioLevelsTask::closeAll()
     // Tell all of the audio levels tasks to stop.
     tasksListMutex.lock();
     while (!tasksList.isEmpty()) {
-        AudioLevelsTask* task = tasksList.first();
-        task->m_isCanceled = true;
-        tasksList.removeFirst();
+        AudioLevelsTask* task = tasksList.takeFirst();
+        if (pendingTasks.removeOne(task))
+            delete task;
+        else
+            task->m_isCanceled = 1;
     }
     tasksListMutex.unlock();
 }
 
-bool AudioLevelsTask::operator==(AudioLevelsTask &b)
+void AudioLevelsTask::setVisibleRange(int in, int out)
 {
-    if (!m_producers.isEmpty() && !b.m_producers.isEmpty()) {
-        Mlt::Producer* a_producer = m_producers.first().first;
-        Mlt::Producer* b_producer = b.m_producers.first().first;
-        Q_ASSERT(a_producer);
-        Q_ASSERT(b_producer);
-        return !qstrcmp(a_producer->get("resource"), b_producer->get("resource"));
+    visibleIn = in;
+    visibleOut = out;
+}
+
+int AudioLevelsTask::distanceToVisibleRange() const
+{
+    int in = visibleIn;
+    int out = visibleOut;
+    if (out < in)
+        return 0;
+    int distance = INT_MAX;
+    for (int i = 0; i < m_ranges.size(); ++i) {
+        const QPair<int, int>& range = m_ranges.at(i);
+        if (range.second <= in)
+            distance = qMin(distance, in - range.second + 1);
+        else if (range.first > out)
+            distance = qMin(distance, range.first - out);
+        else
+            return 0;
     }
-    return false;
+    return distance;
+}
+
+bool AudioLevelsTask::operator==(AudioLevelsTask &b)
+{
+    return !m_resource.isEmpty() && m_resource == b.m_resource;
 }
 
 Mlt::Producer* AudioLevelsTask::tempProducer()
 {
     if (!m_tempProducer) {
-        Q_ASSERT(m_producers.first().first);
-        QString service = m_producers.first().first->get("mlt_service");
+        QString service = m_service;
         if (service == "avformat-novalidate")
             service = "avformat";
         else if (service.startsWith("xml"))
             service = "xml-nogl";
-        m_tempProducer = new Mlt::Producer(m_profile, service.toUtf8().constData(),
-            m_producers.first().first->get("resource"));
+        m_tempProducer = new Mlt::Producer(m_profile, service.toUtf8().constData(), m_resource.constData());
         Q_ASSERT(m_tempProducer);
         if (m_tempProducer->is_valid()) {
+            if (service == "avformat") {
+                // Never open the video decoder.
+                m_tempProducer->set("video_index", -1);
+                if (m_audioIndex >= 0)
+                    m_tempProducer->set("audio_index", m_audioIndex);
+            }
             Mlt::Filter channels(m_profile, "audiochannels");
             Mlt::Filter converter(m_profile, "audioconvert");
-            Mlt::Filter levels(m_profile, "audiolevel");
             m_tempProducer->attach(channels);
             m_tempProducer->attach(converter);
-            m_tempProducer->attach(levels);
             LOG_DEBUG() << "generating audio levels for" << m_tempProducer->get("resource");
         }
     }
@@ -145,11 +300,11 @@ Mlt::Producer* AudioLevelsTask::tempProducer()
 
 QString AudioLevelsTask::cacheKey()
 {
-    QString key = QString("%1 audiolevels");
-    if (m_producers.first().first->get(kShotcutHashProperty)) {
-        key = key.arg(m_producers.first().first->get(kShotcutHashProperty));
+    QString key = QString("%1 audiopeaks");
+    if (!m_hash.isEmpty()) {
+        key = key.arg(QString::fromLatin1(m_hash));
     } else {
-        key = key.arg(m_producers.first().first->get("resource"));
+        key = key.arg(QString::fromUtf8(m_resource));
         QCryptographicHash hash(QCryptographicHash::Sha1);
         hash.addData(key.toUtf8());
         key = hash.result().toHex();
@@ -157,104 +312,86 @@ QString AudioLevelsTask::cacheKey()
     return key;
 }
 
-void AudioLevelsTask::run()
+void AudioLevelsTask::generate(AudioPeaks& peaks)
 {
-    // 2 channels interleaved of uchar values
-    QVariantList levels;
-    QImage image = DB.getThumbnail(cacheKey());
-    if (image.isNull() || m_isForce) {
-        const char* key[2] = { "meta.media.audio_level.0", "meta.media.audio_level.1"};
-        QTime updateTime; updateTime.start();
-        // TODO: use project channel count
-        int channels = 2;
-
-        // for each frame
-        int n = tempProducer()->get_playtime();
-        for (int i = 0; i < n && !m_isCanceled; i++) {
-            Mlt::Frame* frame = tempProducer()->get_frame();
-            if (frame && frame->is_valid() && !frame->get_int("test_audio")) {
-                mlt_audio_format format = mlt_audio_s16;
-                int frequency = 48000;
-                int samples = mlt_sample_calculator(float(m_producers.first().first->get_fps()), frequency, i);
-                frame->get_audio(format, frequency, channels, samples);
-                // for each channel
-                for (int channel = 0; channel < channels; channel++)
-                    // Convert real to uint for caching as image.
-                    // Scale by 0.9 because values may exceed 1.0 to indicate clipping.
-                    levels << 256 * qMin(frame->get_double(key[channel]) * 0.9, 1.0);
-            } else if (!levels.isEmpty()) {
-                for (int channel = 0; channel < channels; channel++)
-                    levels << levels.last();
-            }
-            delete frame;
-
-            // Incrementally update the audio levels every 5 seconds.
-            if (updateTime.elapsed() > 5*1000 && !m_isCanceled) {
-                updateTime.restart();
-                foreach (ProducerAndIndex p, m_producers) {
-                    QVariantList* levelsCopy = new QVariantList(levels);
-                    p.first->set(kAudioLevelsProperty, levelsCopy, 0, reinterpret_cast<mlt_destructor>(deleteQVariantList));
-                    m_model->audioLevelsReady(p.second);
-                }
-            }
+    Mlt::Producer* producer = tempProducer();
+    if (!producer->is_valid())
+        return;
+    QVector<qint16> silence;
+    QTime updateTime; updateTime.start();
+    // Show something soon, then refresh less often.
+    int updateInterval = 1000;
+    double fps = m_profile.fps();
+    int n = producer->get_playtime();
+    for (int i = 0; i < n && !m_isCanceled; i++) {
+        int samples = mlt_sample_calculator(float(fps), kFrequency, i);
+        const qint16* data = nullptr;
+        Mlt::Frame* frame = producer->get_frame();
+        if (frame && frame->is_valid()) {
+            mlt_audio_format format = mlt_audio_s16;
+            int frequency = kFrequency;
+            int channels = kChannels;
+            data = static_cast<const qint16*>(frame->get_audio(format, frequency, channels, samples));
+            if (format != mlt_audio_s16 || channels != kChannels)
+                data = nullptr;
         }
-        if (!m_isCanceled) {
-            // Put into an image for caching.
-            int count = levels.size();
-            QImage image((count + 3) / 4 / channels, channels, QImage::Format_ARGB32);
-            n = image.width() * image.height();
-            for (int i = 0; i < n; i ++) {
-                QRgb p;
-                if ((4*i + 3) < count) {
-                    p = qRgba(levels.at(4*i).toInt(), levels.at(4*i+1).toInt(), levels.at(4*i+2).toInt(), levels.at(4*i+3).toInt());
-                } else {
-                    int last = levels.last().toInt();
-                    int r = (4*i+0) < count? levels.at(4*i+0).toInt() : last;
-                    int g = (4*i+1) < count? levels.at(4*i+1).toInt() : last;
-                    int b = (4*i+2) < count? levels.at(4*i+2).toInt() : last;
-                    int a = last;
-                    p = qRgba(r, g, b, a);
-                }
-                image.setPixel(i / 2, i % channels, p);
-            }
-            if (!image.isNull()) {
-                DB.putThumbnail(cacheKey(), image);
-            } else {
-                // If the produducer does not produce audio, make a special 1x1 RGBA(0,0,0,0) image,
-                // which is used to prevent QImage::isNull() from being true and continually trying
-                // to regenerate audio levels for this file.
-                QImage image(1, 1, QImage::Format_ARGB32);
-                DB.putThumbnail(cacheKey(), image);
-            }
+        if (!data) {
+            // Keep the peaks aligned with time.
+            silence.fill(0, samples * kChannels);
+            data = silence.constData();
         }
-    } else if (!m_isCanceled) {
-        // convert cached image
-        int channels = 2;
-        int n = image.width() * image.height();
-        for (int i = 0; n > 1 && i < n; i++) {
-            QRgb p = image.pixel(i / 2, i % channels);
-            levels << qRed(p);
-            levels << qGreen(p);
-            levels << qBlue(p);
-            levels << qAlpha(p);
+        peaks.append(data, samples);
+        delete frame;
+
+        // Incrementally update the audio levels.
+        if (updateTime.elapsed() > updateInterval && !m_isCanceled) {
+            updateTime.restart();
+            updateInterval = 5*1000;
+            publish(peaks);
         }
     }
+}
+
+void AudioLevelsTask::publish(const AudioPeaks& peaks)
+{
+    AudioPeaksPtr shared(new AudioPeaks(peaks));
 
-    // Remove ourself from the global list of audio tasks.
     tasksListMutex.lock();
-    for (int i = 0; i < tasksList.size(); ++i) {
-        if (*tasksList[i] == *this) {
-            tasksList.removeAt(i);
-            break;
-        }
-    }
+    QList<ProducerAndIndex> producers = m_producers;
     tasksListMutex.unlock();
 
-    if (levels.size() > 0 && !m_isCanceled) {
-        foreach (ProducerAndIndex p, m_producers) {
-            QVariantList* levelsCopy = new QVariantList(levels);
-            p.first->set(kAudioLevelsProperty, levelsCopy, 0, reinterpret_cast<mlt_destructor>(deleteQVariantList));
-            m_model->audioLevelsReady(p.second);
+    foreach (ProducerAndIndex p, producers) {
+        p.first->set(kAudioPeaksProperty, new AudioPeaksPtr(shared), 0, reinterpret_cast<mlt_destructor>(deleteAudioPeaks));
+        m_model->audioLevelsReady(p.second);
+    }
+}
+
+void AudioLevelsTask::run()
+{
+    QScopedPointer<AudioPeaks> peaks;
+    if (!m_isForce) {
+        QImage image = DB.getThumbnail(cacheKey());
+        if (!image.isNull())
+            peaks.reset(AudioPeaks::fromImage(image));
+    }
+    if ((!peaks || !peaks->isComplete()) && !m_isCanceled) {
+        QTime time; time.start();
+        peaks.reset(new AudioPeaks(kChannels, kFrequency));
+        generate(*peaks);
+        if (!m_isCanceled) {
+            peaks->finish();
+            // Media without audio still gets an empty entry so that it is not decoded again.
+            DB.putThumbnail(cacheKey(), peaks->toImage());
+            LOG_DEBUG() << "audio peaks of" << m_resource
+                        << "generated in" << time.elapsed() << "ms";
         }
     }
+
+    // Remove ourself from the global list of audio tasks.
+    tasksListMutex.lock();
+    tasksList.removeOne(this);
+    tasksListMutex.unlock();
+
+    if (peaks && !peaks->isEmpty() && !m_isCanceled)
+        publish(*peaks);
 }
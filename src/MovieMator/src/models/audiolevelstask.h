@@ -23,9 +23,24 @@
 #include <QRunnable>
 #include <QPersistentModelIndex>
 #include <QList>
+#include <QAtomicInt>
 #include <MltProducer.h>
 #include <MltProfile.h>
 
+class AudioPeaks;
+
+/*!
+  \class AudioLevelsTask
+  \brief Generates the AudioPeaks of a clip's media for the timeline waveforms.
+
+  Only the audio is decoded. The peaks are published to the clip producers
+  (kAudioPeaksProperty) while they are being generated and stored in the thumbnail cache when done. Tasks for
+  the same resource are merged, and the tasks whose clips are nearest to the
+  visible part of the timeline are run first.
+
+  \threadsafe start(), closeAll(), reindex() and setVisibleRange() are called
+  from the UI thread; run() is called from the audio levels thread pool.
+*/
 class AudioLevelsTask : public QRunnable
 {
 public:
@@ -33,20 +48,40 @@ public:
     virtual ~AudioLevelsTask();
     static void start(Mlt::Producer& producer, MultitrackModel* model, const QModelIndex& index, bool force = false);
     static void closeAll();
+    // Point the tasks at the rows of their clips again after the model was reset.
+    static void reindex(MultitrackModel* model);
+    // The part of the timeline in view, in frames.
+    static void setVisibleRange(int in, int out);
     bool operator==(AudioLevelsTask& b);
 
 protected:
     void run();
 
 private:
+    friend class AudioLevelsRunner;
+
     Mlt::Producer* tempProducer();
     QString cacheKey();
+    void generate(AudioPeaks& peaks);
+    void publish(const AudioPeaks& peaks);
+    // How far the clips are from the visible range; 0 if one is in view.
+    int distanceToVisibleRange() const;
 
     MultitrackModel* m_model;
     typedef QPair<Mlt::Producer*, QPersistentModelIndex> ProducerAndIndex;
     QList<ProducerAndIndex> m_producers;
+    // Timeline extents of the clips, [start, end).
+    QList< QPair<int, int> > m_ranges;
+    // Producers of clips that are gone, deleted with the task.
+    QList<Mlt::Producer*> m_retired;
+    // Copied from the first producer when the task is created; run() must
+    // not touch m_producers, which start() extends on the UI thread.
+    QString m_service;
+    QByteArray m_resource;
+    QByteArray m_hash;
+    int m_audioIndex;
     Mlt::Producer* m_tempProducer;
-    bool m_isCanceled;
+    QAtomicInt m_isCanceled;
     bool m_isForce;
     Mlt::Profile m_profile;
 };
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "audiopeaks.h"
+#include <QtMath>
+#include <QScopedPointer>
+#include <QAtomicInt>
+#include <Logger.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AUDIOPEAKS_SSE2
+#endif
+
+// Cached image layout: a header of kHeaderPixels pixels followed by the
+// levels one after another, one pixel per peak.
+static const int kImageWidth = 1024;
+static const int kHeaderPixels = 64;
+static const QRgb kMagic = 0x415550;   // "AUP"
+static const int kVersion = 1;
+
+static QAtomicInt nextId(1);
+
+// Minimum, maximum and sum of squares of contiguous samples.
+static void scanSamples(const qint16* s, int n, int& minimum, int& maximum, qint64& sumOfSquares)
+{
+    int i = 0;
+#ifdef AUDIOPEAKS_SSE2
+    if (n >= 8) {
+        __m128i vmin = _mm_set1_epi16(32767);
+        __m128i vmax = _mm_set1_epi16(-32768);
+        __m128i vsum = _mm_setzero_si128();
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= n; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+            vmin = _mm_min_epi16(vmin, v);
+            vmax = _mm_max_epi16(vmax, v);
+            // Pairs of squares fit in 32 bits only as unsigned, so widen
+            // them to 64 bits before accumulating.
+            __m128i squares = _mm_madd_epi16(v, v);
+            vsum = _mm_add_epi64(vsum, _mm_unpacklo_epi32(squares, zero));
+            vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi32(squares, zero));
+        }
+        qint16 mins[8], maxs[8];
+        qint64 sums[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mins), vmin);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(maxs), vmax);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), vsum);
+        for (int j = 0; j < 8; ++j) {
+            minimum = qMin(minimum, int(mins[j]));
+            maximum = qMax(maximum, int(maxs[j]));
+        }
+        sumOfSquares += sums[0] + sums[1];
+    }
+#endif
+    // Kept simple so that the compiler can vectorize it on other targets.
+    int lo = minimum, hi = maximum;
+    qint64 sum = 0;
+    for (; i < n; ++i) {
+        int v = s[i];
+        lo = v < lo? v : lo;
+        hi = v > hi? v : hi;
+        sum += v * v;
+    }
+    minimum = lo;
+    maximum = hi;
+    sumOfSquares += sum;
+}
+
+static inline AudioPeaks::Peak mergePeaks(const AudioPeaks::Peak& a, const AudioPeaks::Peak& b)
+{
+    AudioPeaks::Peak p;
+    p.min = qMin(a.min, b.min);
+    p.max = qMax(a.max, b.max);
+    p.rms = quint8(qSqrt((int(a.rms) * a.rms + int(b.rms) * b.rms) / 2.0) + 0.5);
+    p.reserved = 255;
+    return p;
+}
+
+AudioPeaks::AudioPeaks(int channels, int frequency)
+    : m_id(nextId.fetchAndAddRelaxed(1))
+    , m_channels(qMax(1, channels))
+    , m_samplesPerBucket(qMax(1, frequency / kBaseRate))
+    , m_levels(1)
+    , m_filled(0)
+    , m_min(m_channels, 32767)
+    , m_max(m_channels, -32768)
+    , m_sumOfSquares(m_channels, 0)
+    , m_complete(false)
+{
+}
+
+int AudioPeaks::count(int level) const
+{
+    if (level < 0 || level >= m_levels.size())
+        return 0;
+    return m_levels.at(level).size() / m_channels;
+}
+
+const AudioPeaks::Peak* AudioPeaks::data(int level) const
+{
+    if (level < 0 || level >= m_levels.size())
+        return nullptr;
+    return m_levels.at(level).constData();
+}
+
+int AudioPeaks::levelForRate(double bucketsPerSecond) const
+{
+    int level = 0;
+    while (level + 1 < m_levels.size() && rate(level + 1) >= bucketsPerSecond)
+        ++level;
+    return level;
+}
+
+void AudioPeaks::append(const qint16* samples, int frames)
+{
+    m_complete = false;
+    while (frames > 0) {
+        int n = qMin(frames, m_samplesPerBucket - m_filled);
+        for (int c = 0; c < m_channels; ++c) {
+            const qint16* s = samples + c;
+            if (m_channels > 1) {
+                // De-interleave so that the kernel reads contiguous samples.
+                m_scratch.resize(n);
+                qint16* d = m_scratch.data();
+                for (int i = 0; i < n; ++i)
+                    d[i] = samples[i * m_channels + c];
+                s = d;
+            }
+            scanSamples(s, n, m_min[c], m_max[c], m_sumOfSquares[c]);
+        }
+        m_filled += n;
+        samples += n * m_channels;
+        frames -= n;
+        if (m_filled == m_samplesPerBucket)
+            pushBucket();
+    }
+}
+
+void AudioPeaks::pushBucket()
+{
+    QVector<Peak>& base = m_levels[0];
+    for (int c = 0; c < m_channels; ++c) {
+        Peak p;
+        p.min = qint8(m_min[c] >> 8);
+        p.max = qint8(m_max[c] >> 8);
+        double rms = qSqrt(double(m_sumOfSquares[c]) / qMax(1, m_filled));
+        p.rms = quint8(qMin(255, int(rms / 128.0 + 0.5)));
+        p.reserved = 255;
+        base.append(p);
+        m_min[c] = 32767;
+        m_max[c] = -32768;
+        m_sumOfSquares[c] = 0;
+    }
+    m_filled = 0;
+    propagate(0);
+}
+
+void AudioPeaks::propagate(int level)
+{
+    // Each completed pair of buckets makes one bucket of the next level.
+    while (count(level) > 0 && count(level) % 2 == 0) {
+        if (level + 1 == m_levels.size())
+            m_levels.append(QVector<Peak>());
+        const Peak* pair = m_levels.at(level).constData() + (count(level) - 2) * m_channels;
+        QVector<Peak>& next = m_levels[level + 1];
+        for (int c = 0; c < m_channels; ++c)
+            next.append(mergePeaks(pair[c], pair[m_channels + c]));
+        ++level;
+    }
+}
+
+void AudioPeaks::finish()
+{
+    if (m_filled > 0)
+        pushBucket();
+    // Carry odd buckets up so that every level covers the whole duration.
+    for (int level = 0; count(level) > 1; ++level) {
+        if (count(level + 1) * 2 < count(level)) {
+            if (level + 1 == m_levels.size())
+                m_levels.append(QVector<Peak>());
+            const Peak* last = m_levels.at(level).constData() + (count(level) - 1) * m_channels;
+            for (int c = 0; c < m_channels; ++c)
+                m_levels[level + 1].append(last[c]);
+            propagate(level + 1);
+        }
+    }
+    m_complete = true;
+}
+
+QImage AudioPeaks::toImage() const
+{
+    int total = kHeaderPixels;
+    for (int level = 0; level < m_levels.size(); ++level)
+        total += m_levels.at(level).size();
+    if (m_levels.size() > kHeaderPixels - 5)
+        return QImage();
+    QImage image(kImageWidth, (total + kImageWidth - 1) / kImageWidth, QImage::Format_ARGB32);
+    if (image.isNull())
+        return image;
+    image.fill(0xff000000);
+
+    QVector<QRgb> pixels(total, 0xff000000);
+    QRgb* out = pixels.data();
+    out[0] = 0xff000000 | kMagic;
+    out[1] = 0xff000000 | kVersion;
+    out[2] = 0xff000000 | quint32(m_channels);
+    out[3] = 0xff000000 | quint32(m_levels.size());
+    out[4] = 0xff000000 | quint32(m_complete);
+    for (int level = 0; level < m_levels.size(); ++level)
+        out[5 + level] = 0xff000000 | quint32(count(level));
+    out += kHeaderPixels;
+    for (int level = 0; level < m_levels.size(); ++level) {
+        foreach (const Peak& p, m_levels.at(level))
+            *out++ = qRgba(p.rms, quint8(p.max), quint8(p.min), 255);
+    }
+    for (int y = 0; y < image.height(); ++y) {
+        int n = qMin(kImageWidth, total - y * kImageWidth);
+        memcpy(image.scanLine(y), pixels.constData() + y * kImageWidth, size_t(n) * sizeof(QRgb));
+    }
+    return image;
+}
+
+AudioPeaks* AudioPeaks::fromImage(const QImage& cached)
+{
+    if (cached.width() != kImageWidth)
+        return nullptr;
+    // The thumbnail cache may hand back opaque images as RGB888.
+    QImage image = cached.convertToFormat(QImage::Format_ARGB32);
+    const QRgb* header = reinterpret_cast<const QRgb*>(image.constScanLine(0));
+    if ((header[0] & 0xffffff) != kMagic || (header[1] & 0xffffff) != quint32(kVersion))
+        return nullptr;
+    int channels = int(header[2] & 0xffffff);
+    int levelCount = int(header[3] & 0xffffff);
+    if (channels < 1 || channels > 8 || levelCount < 1 || levelCount > kHeaderPixels - 5)
+        return nullptr;
+
+    QScopedPointer<AudioPeaks> peaks(new AudioPeaks(channels));
+    peaks->m_levels.resize(levelCount);
+    peaks->m_complete = (header[4] & 0xffffff) != 0;
+    qint64 available = qint64(image.width()) * image.height() - kHeaderPixels;
+    int offset = kHeaderPixels;
+    for (int level = 0; level < levelCount; ++level) {
+        qint64 n = qint64(header[5 + level] & 0xffffff) * channels;
+        if (n > available) {
+            LOG_WARNING() << "truncated audio peaks in the cache";
+            return nullptr;
+        }
+        available -= n;
+        QVector<Peak>& out = peaks->m_levels[level];
+        out.resize(int(n));
+        for (int i = 0; i < n; ++i, ++offset) {
+            QRgb pixel = reinterpret_cast<const QRgb*>(image.constScanLine(offset / kImageWidth))[offset % kImageWidth];
+            Peak& p = out[i];
+            p.min = qint8(qBlue(pixel));
+            p.max = qint8(qGreen(pixel));
+            p.rms = quint8(qRed(pixel));
+            p.reserved = 255;
+        }
+    }
+    return peaks.take();
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef AUDIOPEAKS_H
+#define AUDIOPEAKS_H
+
+#include <QVector>
+#include <QImage>
+#include <QSharedPointer>
+#include <QMetaType>
+
+/*!
+  \class AudioPeaks
+  \brief Multi-resolution min/max/RMS peaks of a media file's audio.
+
+  Level 0 has kBaseRate buckets per second and each following level merges
+  pairs of buckets of the one below it, down to a single bucket. A bucket
+  holds one Peak per channel; a Peak is 4 bytes, so a whole pyramid of an
+  hour of stereo is under 6 MB and maps directly onto ARGB32 pixels for the
+  thumbnail cache.
+
+  Samples are appended as interleaved signed 16-bit audio in chunks of any
+  size; the upper levels are completed as soon as both of their children
+  are. A partially built pyramid can be copied at any time to publish what
+  is known so far.
+
+  \threadsafe Not thread-safe. Share finished copies through AudioPeaksPtr.
+*/
+class AudioPeaks
+{
+public:
+    enum { kBaseRate = 100 };
+
+    struct Peak {
+        qint8 min;      // most negative sample, full scale 128
+        qint8 max;      // most positive sample
+        quint8 rms;     // root mean square, full scale 255
+        quint8 reserved;    // always 255 so that the pixels are opaque
+    };
+
+    explicit AudioPeaks(int channels = 2, int frequency = 48000);
+
+    // Copies share the id of the pyramid they were taken from, so a view can
+    // tell a more complete snapshot from different audio.
+    int id() const { return m_id; }
+    int channels() const { return m_channels; }
+    int levelCount() const { return m_levels.size(); }
+    // Number of buckets in a level.
+    int count(int level) const;
+    // Buckets per second in a level.
+    double rate(int level) const { return double(kBaseRate) / (1 << level); }
+    // The peaks of a level, count(level) * channels() of them, bucket major.
+    const Peak* data(int level) const;
+    // The coarsest level having at least the given number of buckets per second.
+    int levelForRate(double bucketsPerSecond) const;
+    bool isEmpty() const { return count(0) == 0; }
+    bool isComplete() const { return m_complete; }
+
+    // Add interleaved samples; their channel count must match channels().
+    void append(const qint16* samples, int frames);
+    // Flush the last partial bucket and complete the upper levels.
+    void finish();
+
+    // Serialization for the thumbnail cache.
+    QImage toImage() const;
+    static AudioPeaks* fromImage(const QImage& image);
+
+private:
+    void pushBucket();
+    void propagate(int level);
+
+    int m_id;
+    int m_channels;
+    int m_samplesPerBucket;
+    QVector< QVector<Peak> > m_levels;
+    // The bucket being accumulated, per channel.
+    int m_filled;
+    QVector<int> m_min;
+    QVector<int> m_max;
+    QVector<qint64> m_sumOfSquares;
+    QVector<qint16> m_scratch;
+    bool m_complete;
+};
+
+typedef QSharedPointer<const AudioPeaks> AudioPeaksPtr;
+Q_DECLARE_METATYPE(AudioPeaksPtr)
+
+#endif // AUDIOPEAKS_H
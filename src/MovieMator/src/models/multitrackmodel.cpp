@@ -26,11 +26,15 @@
 //#include <playlistdock.h>
 #include "util.h"
 #include "audiolevelstask.h"
+#include "audiopeaks.h"
+#include "trackclipcache.h"
 #include "shotcut_mlt_properties.h"
+#include "mediahash.h"
 #include <QScopedPointer>
 #include <QApplication>
 #include <qmath.h>
 #include <QTimer>
+#include <QElapsedTimer>
 
 #include <Logger.h>
 #include <QMessageBox>
@@ -88,9 +92,20 @@ MultitrackModel::MultitrackModel(QObject *parent)
     , m_isMakingTransition(false)
     , m_copiedProducer(nullptr)
     , m_selectedProducer(nullptr)
+    , m_transactionDepth(0)
+    , m_signalsWereBlocked(false)
 {
 //    connect(this, SIGNAL(modified()), SLOT(adjustBackgroundDuration()));//sll:将modify放在mainwindow中建立连接，防止界面更新与数据操作顺序问题
     connect(this, SIGNAL(reloadRequested()), SLOT(reload()), Qt::QueuedConnection);
+    connect(&MediaHash::singleton(), SIGNAL(hashReady(QString,QString)),
+            SLOT(onHashReady(QString,QString)));
+    // Connected before any view so that the clip cache is current when they query it.
+    connect(this, SIGNAL(dataChanged(QModelIndex,QModelIndex,QVector<int>)),
+            SLOT(onDataChanged(QModelIndex,QModelIndex)));
+    connect(this, SIGNAL(modelReset()), SLOT(clearClipCache()));
+    connect(this, SIGNAL(rowsInserted(QModelIndex,int,int)), SLOT(onRowsChanged(QModelIndex)));
+    connect(this, SIGNAL(rowsRemoved(QModelIndex,int,int)), SLOT(onRowsChanged(QModelIndex)));
+    connect(this, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)), SLOT(onRowsChanged(QModelIndex)));
 
     m_selection.nIndexOfSelectedClip = -1;
     m_selection.nIndexOfSelectedTrack = -1;
@@ -99,6 +114,7 @@ MultitrackModel::MultitrackModel(QObject *parent)
 
 MultitrackModel::~MultitrackModel()
 {
+    clearClipCache();
     delete m_tractor;
     m_tractor = nullptr;
 }
@@ -110,19 +126,8 @@ int MultitrackModel::rowCount(const QModelIndex &parent) const
     if (parent.isValid()) {
         if (parent.internalId() != NO_PARENT_ID)
             return 0;
-        int i = m_trackList.at(parent.row()).mlt_index;
-        QScopedPointer<Mlt::Producer> track(m_tractor->track(i));
-
-        Q_ASSERT(track);
-
-        if (track) {
-            Mlt::Playlist playlist(*track);
-            Q_ASSERT(playlist.is_valid());
-            int n = playlist.count();
-            return n;
-        } else {
-            return 0;
-        }
+        TrackClipCache* cache = clipCache(parent.row());
+        return cache? cache->count() : 0;
     }
     return m_trackList.count();
 }
@@ -141,120 +146,97 @@ QVariant MultitrackModel::data(const QModelIndex &index, int role) const
         return QVariant();
     if (index.parent().isValid()) {
         // Get data for a clip.
-        int count = m_trackList.count();
-        Q_ASSERT(int(index.internalId()) < count);
-
-        int i = m_trackList.at(int(index.internalId())).mlt_index;
-        QScopedPointer<Mlt::Producer> track(m_tractor->track(i));
-        Q_ASSERT(track);
-        if (track) {
-            Mlt::Playlist playlist(*track);
-            Q_ASSERT(playlist.is_valid());
-            QScopedPointer<Mlt::ClipInfo> info(playlist.clip_info(index.row()));
-            Q_ASSERT(info);
-            if (info)
+        int trackIndex = int(index.internalId());
+        Q_ASSERT(trackIndex < m_trackList.count());
+        TrackClipCache* cache = clipCache(trackIndex);
+        const int row = index.row();
+        if (cache && row < cache->count()) {
             switch (role) {
-            case NameRole: {
-                QString result;
-                if (info->producer && info->producer->is_valid())
-                    result = info->producer->get(kShotcutCaptionProperty);
-                if (result.isNull())
-                    result = Util::baseName(QString::fromUtf8(info->resource));
-                if (result == "<producer>" && info->producer && info->producer->is_valid())
-                    result = QString::fromUtf8(info->producer->get("mlt_service"));
-                if (result == "<tractor>") {
-                    result = QString::fromUtf8(info->producer->get("moviemator:imageName"));
-                    result += "-" + QString::fromUtf8(info->producer->get("moviemator:animationName"));
-                }
-
-                //获取clip在时间线上显示的名字
-                QString strClipCaption;
-                if (info->producer && info->producer->is_valid())
-                    strClipCaption = getClipCaption(*(info->producer));
-
-                if (!strClipCaption.isEmpty())
-                    result = strClipCaption;
-
-                return result;
-            }
+            case NameRole:
+                fillClipDetails(*cache, row);
+                return cache->name.at(row);
             case ResourceRole:
             case Qt::DisplayRole: {
-                QString result = QString::fromUtf8(info->resource);
-                if (result == "<producer>" && info->producer
-                        && info->producer->is_valid() && info->producer->get("mlt_service"))
-                    result = QString::fromUtf8(info->producer->get("mlt_service"));
-                return result;
+                if (cache->resource.at(row) == "<producer>") {
+                    fillClipDetails(*cache, row);
+                    if (!cache->service.at(row).isEmpty())
+                        return cache->service.at(row);
+                }
+                return cache->resource.at(row);
             }
             case ServiceRole:
-                if (info->producer && info->producer->is_valid())
-                    return QString::fromUtf8(info->producer->get("mlt_service"));
+                fillClipDetails(*cache, row);
+                if (!cache->service.at(row).isNull())
+                    return cache->service.at(row);
                 break;
             case IsBlankRole:
-                return playlist.is_blank(index.row());
+                return cache->blank.at(row);
             case StartRole:
-                return info->start;
+                return cache->start.at(row);
             case DurationRole:
-                return info->frame_count;
+                return cache->duration.at(row);
             case InPointRole:
-                return info->frame_in;
+                return cache->in.at(row);
             case OutPointRole:
-                return info->frame_out;
+                return cache->out.at(row);
             case FramerateRole:
-                return info->fps;
+                return cache->fps.at(row);
             case IsAudioRole:
-                return m_trackList[int(index.internalId())].type == AudioTrackType;
+                return m_trackList[trackIndex].type == AudioTrackType;
             case IsVideoRole:
-                return m_trackList[int(index.internalId())].type == VideoTrackType;
+                return m_trackList[trackIndex].type == VideoTrackType;
             case IsFilterRole:
-                return m_trackList[int(index.internalId())].type == FilterTrackType;
+                return m_trackList[trackIndex].type == FilterTrackType;
             case IsTextRole:
-                return m_trackList[int(index.internalId())].type == TextTrackType;
+                return m_trackList[trackIndex].type == TextTrackType;
             case TrackTypeRole:
-                return m_trackList[int(index.internalId())].type;
+                return m_trackList[trackIndex].type;
             case IsDefaultTrackRole:
-                return m_trackList[int(index.internalId())].number == 0;
-            case AudioLevelsRole:
-                if (info->producer->get_data(kAudioLevelsProperty))
-                    return QVariant::fromValue(*(static_cast<QVariantList*>(info->producer->get_data(kAudioLevelsProperty))));
+                return m_trackList[trackIndex].number == 0;
+            case AudioLevelsRole: {
+                Mlt::Producer producer(cache->producer.at(row));
+                if (producer.is_valid() && producer.get_data(kAudioPeaksProperty))
+                    return QVariant::fromValue(*(static_cast<AudioPeaksPtr*>(producer.get_data(kAudioPeaksProperty))));
                 else
                     return QVariant();
+            }
             case FadeInRole: {
-                QScopedPointer<Mlt::Filter> filter(getFilter("fadeInVolume", info->producer));
+                // Filters can change without a dataChanged(), so these are not cached.
+                Mlt::Producer producer(cache->producer.at(row));
+                QScopedPointer<Mlt::Filter> filter(getFilter("fadeInVolume", &producer));
                 if (!filter || !filter->is_valid())
-                    filter.reset(getFilter("fadeInBrightness", info->producer));
+                    filter.reset(getFilter("fadeInBrightness", &producer));
                 if (!filter || !filter->is_valid())
-                    filter.reset(getFilter("fadeInMovit", info->producer));
+                    filter.reset(getFilter("fadeInMovit", &producer));
                 return (filter && filter->is_valid())? filter->get_length() : 0;
             }
             case FadeOutRole: {
-                QScopedPointer<Mlt::Filter> filter(getFilter("fadeOutVolume", info->producer));
+                Mlt::Producer producer(cache->producer.at(row));
+                QScopedPointer<Mlt::Filter> filter(getFilter("fadeOutVolume", &producer));
                 if (!filter || !filter->is_valid())
-                    filter.reset(getFilter("fadeOutBrightness", info->producer));
+                    filter.reset(getFilter("fadeOutBrightness", &producer));
                 if (!filter || !filter->is_valid())
-                    filter.reset(getFilter("fadeOutMovit", info->producer));
+                    filter.reset(getFilter("fadeOutMovit", &producer));
                 return (filter && filter->is_valid())? filter->get_length() : 0;
             }
             case IsTransitionRole:
-                return isTransition(playlist, index.row());
+                fillClipDetails(*cache, row);
+                return cache->transition.at(row);
             case FileHashRole:
-                return MLT.getHash(*info->producer);
-            case SpeedRole: {
-                double speed = 1.0;
-                if (info->producer && info->producer->is_valid()) {
-                    if (!qstrcmp("timewarp", info->producer->get("mlt_service")))
-                        speed = info->producer->get_double("warp_speed");
-                }
-                return speed;
-            }
+                fillClipDetails(*cache, row);
+                return cache->hash.at(row);
+            case SpeedRole:
+                fillClipDetails(*cache, row);
+                return cache->speed.at(row);
             case ThumbnailRole:
-                return QString("..") + QString(info->producer->get("thumbnail"));
-            case HasFilterRole:
-                return hasFilterApplied(info->producer);
-            case IsAnimStickerRole:
-            {
-                QString resource = QString::fromUtf8(info->resource);
-                return resource == "<tractor>";
+                fillClipDetails(*cache, row);
+                return cache->thumbnail.at(row);
+            case HasFilterRole: {
+                Mlt::Producer producer(cache->producer.at(row));
+                return hasFilterApplied(&producer);
             }
+            case IsAnimStickerRole:
+                return cache->resource.at(row) == "<tractor>";
             default:
                 break;
             }
@@ -313,6 +295,141 @@ QVariant MultitrackModel::data(const QModelIndex &index, int role) const
     return QVariant();
 }
 
+TrackClipCache* MultitrackModel::clipCache(int trackIndex) const
+{
+    if (!m_tractor || trackIndex < 0 || trackIndex >= m_trackList.size())
+        return nullptr;
+    if (m_clipCache.size() != m_trackList.size()) {
+        clearClipCache();
+        m_clipCache.resize(m_trackList.size());
+        for (int i = 0; i < m_clipCache.size(); ++i)
+            m_clipCache[i] = new TrackClipCache;
+    }
+    TrackClipCache* cache = m_clipCache.at(trackIndex);
+    int mltIndex = m_trackList.at(trackIndex).mlt_index;
+    // In a transaction the row signals that renumber the caches are blocked,
+    // so make sure the track is still the one the cache follows.
+    if (cache->isStale() || cache->mltIndex() != mltIndex || m_transactionDepth > 0) {
+        QScopedPointer<Mlt::Producer> track(m_tractor->track(mltIndex));
+        Q_ASSERT(track);
+        if (!track)
+            return nullptr;
+        Mlt::Playlist playlist(*track);
+        Q_ASSERT(playlist.is_valid());
+        if (cache->mltIndex() != mltIndex || !cache->isAttachedTo(playlist))
+            cache->attach(playlist, mltIndex);
+        if (cache->isStale())
+            cache->rebuild(playlist);
+    }
+    return cache;
+}
+
+void MultitrackModel::fillClipDetails(TrackClipCache& cache, int row) const
+{
+    if (cache.hasDetails.at(row))
+        return;
+    Mlt::Producer producer(cache.producer.at(row));
+    const QString& resource = cache.resource.at(row);
+    bool valid = producer.is_valid();
+
+    QString service;
+    if (valid && producer.get("mlt_service"))
+        service = QString::fromUtf8(producer.get("mlt_service"));
+
+    QString name;
+    if (valid)
+        name = producer.get(kShotcutCaptionProperty);
+    if (name.isNull())
+        name = Util::baseName(resource);
+    if (name == "<producer>" && valid)
+        name = service;
+    if (name == "<tractor>") {
+        name = QString::fromUtf8(producer.get("moviemator:imageName"));
+        name += "-" + QString::fromUtf8(producer.get("moviemator:animationName"));
+    }
+    //获取clip在时间线上显示的名字
+    if (valid) {
+        QString caption = getClipCaption(producer);
+        if (!caption.isEmpty())
+            name = caption;
+    }
+
+    cache.name[row] = name;
+    cache.service[row] = service;
+    // Hashing reads the media, so do not wait for it here.
+    cache.hash[row] = valid? MLT.getHash(producer, false) : QString();
+    if (valid && cache.hash.at(row).isEmpty()) {
+        // Remember the clip so that onHashReady() does not have to scan the timeline.
+        for (int trackIndex = 0; trackIndex < m_trackList.size(); ++trackIndex) {
+            if (m_trackList.at(trackIndex).mlt_index == cache.mltIndex()) {
+                m_hashWaiters.insert(Mlt::Controller::hashResource(producer),
+                                     QPersistentModelIndex(index(row, 0, index(trackIndex))));
+                break;
+            }
+        }
+    }
+    cache.thumbnail[row] = QString("..") + QString(valid? producer.get("thumbnail") : nullptr);
+    cache.speed[row] = (valid && service == "timewarp")? producer.get_double("warp_speed") : 1.0;
+    cache.transition[row] = valid && producer.get(kShotcutTransitionProperty);
+    cache.hasDetails[row] = true;
+}
+
+void MultitrackModel::beginTransaction()
+{
+    if (m_transactionDepth++ == 0)
+        m_signalsWereBlocked = blockSignals(true);
+}
+
+void MultitrackModel::commitTransaction(bool notify)
+{
+    Q_ASSERT(m_transactionDepth > 0);
+    if (m_transactionDepth <= 0 || --m_transactionDepth > 0)
+        return;
+    blockSignals(m_signalsWereBlocked);
+    // The row details are dropped on dataChanged(), which was blocked.
+    clearClipCache();
+    if (notify) {
+        beginResetModel();
+        endResetModel();
+        // The reset invalidated the indexes the audio level tasks publish to.
+        AudioLevelsTask::reindex(this);
+        emit durationChanged();
+        emit modified();
+    }
+}
+
+bool MultitrackModel::isTransition(TrackClipCache& cache, int clipIndex) const
+{
+    if (clipIndex < 0 || clipIndex >= cache.count())
+        return false;
+    fillClipDetails(cache, clipIndex);
+    return cache.transition.at(clipIndex);
+}
+
+void MultitrackModel::clearClipCache() const
+{
+    qDeleteAll(m_clipCache);
+    m_clipCache.clear();
+    // The details are filled again, and the clips still waiting registered again.
+    m_hashWaiters.clear();
+}
+
+void MultitrackModel::onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+{
+    if (!topLeft.parent().isValid())
+        return;
+    int trackIndex = int(topLeft.internalId());
+    if (trackIndex < m_clipCache.size())
+        m_clipCache.at(trackIndex)->invalidateDetails(topLeft.row(), bottomRight.row());
+}
+
+void MultitrackModel::onRowsChanged(const QModelIndex& parent)
+{
+    // Clip rows are followed through the playlist events; tracks are renumbered.
+    if (!parent.isValid())
+        clearClipCache();
+}
+
 QModelIndex MultitrackModel::index(int row, int column, const QModelIndex &parent) const
 {
     if(!m_tractor) return QModelIndex();
@@ -324,15 +441,9 @@ QModelIndex MultitrackModel::index(int row, int column, const QModelIndex &paren
         int trackCount = m_trackList.count();
         Q_ASSERT(parent.row() < trackCount);
 
-        int i = m_trackList.at(parent.row()).mlt_index;
-        QScopedPointer<Mlt::Producer> track(m_tractor->track(i));
-        Q_ASSERT(track);
-        if (track) {
-            Mlt::Playlist playlist(reinterpret_cast<mlt_playlist>(track->get_producer()));
-            Q_ASSERT(playlist.is_valid());
-            if (row < playlist.count())
-                result = createIndex(row, column, quintptr(parent.row()));
-        }
+        TrackClipCache* cache = clipCache(parent.row());
+        if (cache && row < cache->count())
+            result = createIndex(row, column, quintptr(parent.row()));
     } else if (row < m_trackList.count()) {
         result = createIndex(row, column, NO_PARENT_ID);
     }
@@ -880,13 +991,17 @@ bool MultitrackModel::moveClipValid(int fromTrack, int toTrack, int clipIndex, i
             QScopedPointer<Mlt::Producer> clip(playlistFrom.get_clip(clipIndex));
             Q_ASSERT(clip);
 
+            int end = position + clip->get_playtime() - 1;
+            int first = -1;
+            int last = -1;
             if (position >= playlist.get_playtime())
                 result = true;
             else if (playlist.is_blank_at(0) && playlist.count() == 1)
                 // blank track
                 result = true;
-            else if (playlist.is_blank_at(position) && playlist.is_blank_at(position + clip->get_playtime() - 1)
-                    && playlist.get_clip_index_at(position) == playlist.get_clip_index_at(position + clip->get_playtime() - 1))
+            // This runs on every drag step; the range lookup replaces the playlist scans.
+            else if (end < playlist.get_playtime() && clipsInRange(toTrack, position, end, &first, &last)
+                    && first == last && playlist.is_blank(first))
                 result = true;
             if (!result) {
                 QModelIndex parentIndex = index(fromTrack);
@@ -1099,6 +1214,7 @@ int MultitrackModel::overwriteClip(int trackIndex, Mlt::Producer& clip, int posi
             QModelIndex index = createIndex(result, 0, quintptr(trackIndex));
             AudioLevelsTask::start(clip.parent(), this, index);
             emit modified();
+            MLT.invalidateFrameCache(playlist.clip_start(result), playlist.clip_start(result) + playlist.clip_length(result) - 1);
             if (seek)
             {
                 emit seeked(playlist.clip_start(result) /*+ playlist.clip_length(result)*/);
@@ -1207,6 +1323,7 @@ QString MultitrackModel::overwrite(int trackIndex, Mlt::Producer& clip, int posi
         QModelIndex index = createIndex(targetIndex, 0, quintptr(trackIndex));
         AudioLevelsTask::start(clip.parent(), this, index);
         emit modified();
+        MLT.invalidateFrameCache(playlist.clip_start(targetIndex), playlist.clip_start(targetIndex) + playlist.clip_length(targetIndex) - 1);
         if (seek)
             emit seeked(playlist.clip_start(targetIndex));
     }
@@ -1411,6 +1528,8 @@ int MultitrackModel::insertClip(int trackIndex, Mlt::Producer &clip, int positio
             QModelIndex index = createIndex(result, 0, quintptr(trackIndex));
             AudioLevelsTask::start(clip.parent(), this, index);
             emit modified();
+            // Everything after the inserted clip moved.
+            MLT.invalidateFrameCache(playlist.clip_start(result));
             emit seeked(playlist.clip_start(result));
         }
 
@@ -1455,6 +1574,7 @@ int MultitrackModel::appendClip(int trackIndex, Mlt::Producer &clip)
         setSelection(trackIndex, i);
 
         emit modified();
+        MLT.invalidateFrameCache(playlist.clip_start(i));
         emit seeked(playlist.clip_start(i));
         return i;
     }
@@ -1501,21 +1621,28 @@ void MultitrackModel::removeClip(int trackIndex, int clipIndex)
             endRemoveRows();
             consolidateBlanks(playlist, trackIndex);
             // Ripple all unlocked tracks.
-            if (clipPlaytime > 0 && Settings.timelineRippleAllTracks())
-            for (int j = 0; j < m_trackList.count(); ++j) {
-                if (j == trackIndex)
-                    continue;
-
-                int mltIndex = m_trackList.at(j).mlt_index;
-                QScopedPointer<Mlt::Producer> otherTrack(m_tractor->track(mltIndex));
-                if (otherTrack) {
-                    if (otherTrack->get_int(kTrackLockProperty))
+            if (clipPlaytime > 0 && Settings.timelineRippleAllTracks()) {
+                beginTransaction();
+                for (int j = 0; j < m_trackList.count(); ++j) {
+                    if (j == trackIndex)
                         continue;
 
-                    removeRegion(j, clipStart, clipPlaytime);
+                    int mltIndex = m_trackList.at(j).mlt_index;
+                    QScopedPointer<Mlt::Producer> otherTrack(m_tractor->track(mltIndex));
+                    if (otherTrack) {
+                        if (otherTrack->get_int(kTrackLockProperty))
+                            continue;
+
+                        removeRegion(j, clipStart, clipPlaytime);
+                    }
                 }
+                // Emits modified() as well.
+                commitTransaction();
+            } else {
+                emit modified();
             }
-            emit modified();
+            if (clipStart >= 0)
+                MLT.invalidateFrameCache(clipStart);
 
             // 删除后不选中任何 clip
             setSelection(trackIndex, -1);
@@ -1544,7 +1671,10 @@ void MultitrackModel::liftClip(int trackIndex, int clipIndex)
             // transition (MLT mix clip). So, we null mlt_mix to prevent it.
             clearMixReferences(trackIndex, clipIndex);
 
+            int clipStart = playlist.clip_start(clipIndex);
+            int clipLength = playlist.clip_length(clipIndex);
             playlist.replace_with_blank(clipIndex);
+            MLT.invalidateFrameCache(clipStart, clipStart + clipLength - 1);
 
             QModelIndex index = createIndex(clipIndex, 0, quintptr(trackIndex));
             QVector<int> roles;
@@ -1686,6 +1816,7 @@ void MultitrackModel::appendFromPlaylist(Mlt::Playlist *from, int trackIndex)
     if (track) {
         Mlt::Playlist playlist(*track);
         Q_ASSERT(playlist.is_valid());
+        beginTransaction();
         removeBlankPlaceholder(playlist, trackIndex);
         nPlaylistTime = playlist.get_playtime();
         i = playlist.count();
@@ -1698,14 +1829,15 @@ void MultitrackModel::appendFromPlaylist(Mlt::Playlist *from, int trackIndex)
                 int out = clip->get_out();
                 clip->set_in_and_out(0, clip->get_length() - 1);
                 playlist.append(clip->parent(), in, out);
-                QModelIndex modelIndex = createIndex(j, 0, quintptr(trackIndex));
+                QModelIndex modelIndex = createIndex(i + j, 0, quintptr(trackIndex));
                 AudioLevelsTask::start(clip->parent(), this, modelIndex);
             } else {
                 playlist.blank(clip->get_out());
             }
         }
         endInsertRows();
-        emit modified();
+        commitTransaction();
+        MLT.invalidateFrameCache(nPlaylistTime);
         emit seeked(nPlaylistTime);
     }
 }
@@ -1723,6 +1855,7 @@ void MultitrackModel::overwriteFromPlaylist(Mlt::Playlist& from, int trackIndex,
     QScopedPointer<Mlt::Producer> track(m_tractor->track(i));
     Q_ASSERT(track);
     if (track) {
+        beginTransaction();
         Mlt::Playlist playlist(*track);
         Q_ASSERT(playlist.is_valid());
         int targetIndex = playlist.get_clip_index_at(position);
@@ -1758,7 +1891,8 @@ void MultitrackModel::overwriteFromPlaylist(Mlt::Playlist& from, int trackIndex,
             endInsertRows();
         }
         consolidateBlanks(playlist, trackIndex);
-        emit modified();
+        commitTransaction();
+        MLT.invalidateFrameCache(position, position + from.get_playtime() - 1);
         emit seeked(position);
     }
 
@@ -1974,32 +2108,25 @@ bool MultitrackModel::addTransitionValid(int fromTrack, int toTrack, int clipInd
     Q_ASSERT(m_tractor);
 
     bool result = false;
-    int i = m_trackList.at(toTrack).mlt_index;
-    QScopedPointer<Mlt::Producer> track(m_tractor->track(i));
-    Q_ASSERT(track);
-    if (track) {
-        Mlt::Playlist playlist(*track);
-        Q_ASSERT(playlist.is_valid());
-        int targetIndex = playlist.get_clip_index_at(position);
-        int endOfPreviousClip = playlist.clip_start(clipIndex - 1) + playlist.clip_length(clipIndex - 1);
-        int endOfCurrentClip = position + playlist.clip_length(clipIndex);
-        int startOfNextClip = playlist.clip_start(clipIndex + 1);
+    TrackClipCache* cache = clipCache(toTrack);
+    Q_ASSERT(cache);
+    if (cache) {
+        int targetIndex = cache->clipIndexAt(position);
+        int endOfPreviousClip = cache->clipStart(clipIndex - 1) + cache->clipLength(clipIndex - 1);
+        int endOfCurrentClip = position + cache->clipLength(clipIndex);
+        int startOfNextClip = cache->clipStart(clipIndex + 1);
 
-        int startOfPreviousClip = playlist.clip_start(clipIndex - 1);
+        int startOfPreviousClip = cache->clipStart(clipIndex - 1);
 
-        int endOfNextClip = startOfNextClip + playlist.clip_length(clipIndex + 1);
+        int endOfNextClip = startOfNextClip + cache->clipLength(clipIndex + 1);
 
-        if (playlist.count() > 1)
+        if (cache->count() > 1)
         if (fromTrack == toTrack)//同一轨道
-        if (( targetIndex == (clipIndex - 1) && !playlist.is_blank(clipIndex - 1) && endOfCurrentClip > endOfPreviousClip && !isTransition(playlist, clipIndex - 1) && (position > startOfPreviousClip) ) ||
-            ( targetIndex == clipIndex && !playlist.is_blank(clipIndex + 1) && position < startOfNextClip && !isTransition(playlist, clipIndex + 1) && (endOfNextClip > endOfCurrentClip) )
+        if (( targetIndex == (clipIndex - 1) && !cache->isBlank(clipIndex - 1) && endOfCurrentClip > endOfPreviousClip && !isTransition(*cache, clipIndex - 1) && (position > startOfPreviousClip) ) ||
+            ( targetIndex == clipIndex && !cache->isBlank(clipIndex + 1) && position < startOfNextClip && !isTransition(*cache, clipIndex + 1) && (endOfNextClip > endOfCurrentClip) )
         ){
             result = true;
         }
-
-
-
-
     }
     return result;
 }
@@ -2078,6 +2205,7 @@ int MultitrackModel::addTransition(int trackIndex, int clipIndex, int position)
             roles << DurationRole;
             emit dataChanged(modelIndex, modelIndex, roles);
             emit modified();
+            MLT.invalidateFrameCache(playlist.clip_start(targetIndex));
             emit seeked(playlist.clip_start(targetIndex + 1));
             return targetIndex + 1;
         }
@@ -2913,6 +3041,7 @@ void MultitrackModel::consolidateBlanksAllTracks()
 {
     Q_ASSERT(m_tractor);
     if (!m_tractor) return;
+    beginTransaction();
     int i = 0;
     foreach (Track t, m_trackList) {
         Mlt::Producer* track = m_tractor->track(t.mlt_index);
@@ -2924,6 +3053,7 @@ void MultitrackModel::consolidateBlanksAllTracks()
         }
         ++i;
     }
+    commitTransaction();
 }
 
 void MultitrackModel::audioLevelsReady(const QModelIndex& index)
@@ -2933,6 +3063,79 @@ void MultitrackModel::audioLevelsReady(const QModelIndex& index)
     emit dataChanged(index, index, roles);
 }
 
+void MultitrackModel::benchmark(int tracks, int clipsPerTrack)
+{
+    MultitrackModel model;
+    model.createIfNeeded();
+    Mlt::Producer color(MLT.profile(), "color", "black");
+    color.set(kShotcutCaptionProperty, "benchmark");
+    while (model.m_trackList.size() < tracks)
+        model.addVideoTrack();
+    foreach (const Track& t, model.m_trackList) {
+        QScopedPointer<Mlt::Producer> track(model.m_tractor->track(t.mlt_index));
+        Mlt::Playlist playlist(*track);
+        playlist.clear();
+        for (int c = 0; c < clipsPerTrack; ++c) {
+            // A gap every tenth clip, as on a real timeline.
+            if (c % 10 == 9)
+                playlist.blank(24);
+            else
+                playlist.append(color, 0, 49);
+        }
+    }
+    const QList<int> roles = model.roleNames().keys();
+
+    // What a full repaint asks for: every role of every clip.
+    auto repaint = [&]() -> double {
+        QElapsedTimer timer;
+        timer.start();
+        for (int t = 0; t < model.rowCount(QModelIndex()); ++t) {
+            QModelIndex parent = model.index(t);
+            int n = model.rowCount(parent);
+            for (int row = 0; row < n; ++row) {
+                QModelIndex index = model.index(row, 0, parent);
+                foreach (int role, roles)
+                    model.data(index, role);
+            }
+        }
+        return timer.nsecsElapsed() / 1000000.0;
+    };
+    // What each of those role queries cost in MLT lookups before the cache.
+    auto lookups = [&]() -> double {
+        QElapsedTimer timer;
+        timer.start();
+        foreach (const Track& t, model.m_trackList) {
+            QScopedPointer<Mlt::Producer> track(model.m_tractor->track(t.mlt_index));
+            Mlt::Playlist playlist(*track);
+            int n = playlist.count();
+            for (int row = 0; row < n; ++row) {
+                for (int i = 0; i < roles.size(); ++i) {
+                    QScopedPointer<Mlt::Producer> lookup(model.m_tractor->track(t.mlt_index));
+                    Mlt::Playlist lookupPlaylist(*lookup);
+                    delete lookupPlaylist.clip_info(row);
+                }
+            }
+        }
+        return timer.nsecsElapsed() / 1000000.0;
+    };
+
+    double first = repaint();
+    double again = repaint();
+    {
+        // Trim one clip: only its track is read again.
+        QScopedPointer<Mlt::Producer> track(model.m_tractor->track(model.m_trackList.at(0).mlt_index));
+        Mlt::Playlist playlist(*track);
+        playlist.resize_clip(0, 0, 39);
+    }
+    double afterEdit = repaint();
+    double uncached = lookups();
+    LOG_INFO() << "timeline benchmark:" << tracks << "tracks x" << clipsPerTrack << "clips,"
+               << roles.size() << "roles per clip";
+    LOG_INFO() << "timeline benchmark: first repaint" << first << "ms, repaint" << again
+               << "ms, repaint after a one track edit" << afterEdit << "ms";
+    LOG_INFO() << "timeline benchmark: MLT lookups alone without the clip cache" << uncached << "ms";
+}
+
 bool MultitrackModel::createIfNeeded()
 {
     if (!m_tractor) {
@@ -2967,6 +3170,37 @@ void MultitrackModel::addBackgroundTrack()
     m_tractor->set_track(playlist, m_tractor->count());
 }
 
+void MultitrackModel::onHashReady(const QString& path, const QString& hash)
+{
+    QList<QPersistentModelIndex> waiters = m_hashWaiters.values(path);
+    m_hashWaiters.remove(path);
+    if (!m_tractor || waiters.isEmpty())
+        return;
+    QVector<int> roles;
+    roles << FileHashRole;
+    foreach (const QPersistentModelIndex& waiter, waiters) {
+        // The row follows inserts and removes; skip clips that are gone or replaced.
+        if (!waiter.isValid() || !waiter.parent().isValid())
+            continue;
+        int trackIndex = waiter.parent().row();
+        if (trackIndex >= m_trackList.size())
+            continue;
+        QScopedPointer<Mlt::Producer> track(m_tractor->track(m_trackList.at(trackIndex).mlt_index));
+        if (!track)
+            continue;
+        Mlt::Playlist playlist(*track);
+        QScopedPointer<Mlt::Producer> clip(playlist.get_clip(waiter.row()));
+        if (!clip || !clip->is_valid() || clip->is_blank())
+            continue;
+        Mlt::Producer parent(clip->parent());
+        if (parent.get(kShotcutHashProperty) || Mlt::Controller::hashResource(parent) != path)
+            continue;
+        parent.set(kShotcutHashProperty, hash.toLatin1().constData());
+        QModelIndex modelIndex = waiter;
+        emit dataChanged(modelIndex, modelIndex, roles);
+    }
+}
+
 void MultitrackModel::adjustBackgroundDuration()
 {
     Q_ASSERT(m_tractor);
@@ -3538,6 +3772,7 @@ void MultitrackModel::load()
 
     if (m_tractor) {
         beginResetModel();
+        clearClipCache();
         delete m_tractor;
         m_tractor = nullptr;
         m_trackList.clear();
@@ -3561,7 +3796,10 @@ void MultitrackModel::load()
     addBlackTrackIfNeeded();
     MLT.updateAvformatCaching(m_tractor->count());
     refreshTrackList();
+    // The views learn about the tracks below.
+    beginTransaction();
     consolidateBlanksAllTracks();
+    commitTransaction(false);
     adjustBackgroundDuration();
     initMixReferences();
     if (m_trackList.count() > 0) {
@@ -3597,6 +3835,7 @@ void MultitrackModel::close()
         m_trackList.clear();
         endRemoveRows();
     }
+    clearClipCache();
     delete m_tractor;
     m_tractor = nullptr;
     emit closed();
@@ -3609,16 +3848,39 @@ int MultitrackModel::clipIndex(int trackIndex, int position)
 
     Q_ASSERT(m_tractor);
 
-    int i = m_trackList.at(trackIndex).mlt_index;
+    TrackClipCache* cache = clipCache(trackIndex);
+    if (cache)
+        return cache->clipIndexAt(position);
+    return -1; // error
+}
 
-    QScopedPointer<Mlt::Producer> track(m_tractor->track(i));
-    Q_ASSERT(track);
-    if (track) {
-        Mlt::Playlist playlist(*track);
-        Q_ASSERT(playlist.is_valid());
-        return playlist.get_clip_index_at(position);
+int MultitrackModel::nextEdit(int position) const
+{
+    int result = -1;
+    for (int trackIndex = 0; trackIndex < m_trackList.size(); ++trackIndex) {
+        TrackClipCache* cache = clipCache(trackIndex);
+        int edit = cache? cache->nextEdit(position) : -1;
+        if (edit >= 0 && (result < 0 || edit < result))
+            result = edit;
     }
-    return -1; // error
+    return result;
+}
+
+int MultitrackModel::previousEdit(int position) const
+{
+    int result = -1;
+    for (int trackIndex = 0; trackIndex < m_trackList.size(); ++trackIndex) {
+        TrackClipCache* cache = clipCache(trackIndex);
+        if (cache)
+            result = qMax(result, cache->previousEdit(position));
+    }
+    return result;
+}
+
+bool MultitrackModel::clipsInRange(int trackIndex, int from, int to, int* first, int* last) const
+{
+    TrackClipCache* cache = clipCache(trackIndex);
+    return cache && cache->clipsOverlapping(from, to, first, last);
 }
 
 void MultitrackModel::refreshTrackList()
@@ -3921,6 +4183,7 @@ void MultitrackModel::addFilter(int trackIndex, Mlt::Producer *filter)
         playlist.append(*filter, 0, 100);
         endInsertRows();
         emit modified();
+        MLT.invalidateFrameCache(playlist.clip_start(i));
         emit seeked(playlist.clip_start(i));
     }
 }
@@ -3952,6 +4215,7 @@ void MultitrackModel::addText(int trackIndex, Mlt::Producer *filter)
         playlist.append(*producer);
         endInsertRows();
         emit modified();
+        MLT.invalidateFrameCache(playlist.clip_start(i));
         emit seeked(playlist.clip_start(i));
     }
 }
@@ -4505,16 +4769,9 @@ int MultitrackModel::getClipOfPosition(int nIndexOfTrack, int nFramePostion)
 
     int nResult = -1;
 
-    int nTrackIndexMlt = m_trackList.at(nIndexOfTrack).mlt_index;
-
-    QScopedPointer<Mlt::Producer> trackProducer(m_tractor->track(nTrackIndexMlt));
-    Q_ASSERT(trackProducer);
-    if (trackProducer)
-    {
-        Mlt::Playlist mltPlaylist(*trackProducer);
-        Q_ASSERT(mltPlaylist.is_valid());
-        nResult = mltPlaylist.get_clip_index_at(nFramePostion);
-    }
+    TrackClipCache* cache = clipCache(nIndexOfTrack);
+    if (cache)
+        nResult = cache->clipIndexAt(nFramePostion);
     return nResult;
 }
 
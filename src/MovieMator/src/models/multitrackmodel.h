@@ -25,6 +25,9 @@
 #include <QAbstractItemModel>
 #include <QList>
 #include <QString>
+#include <QVector>
+#include <QMultiHash>
+#include <QPersistentModelIndex>
 #include <MltTractor.h>
 #include <MltPlaylist.h>
 
@@ -61,6 +64,8 @@ char* GetFilenameFromProducer( Mlt::Producer* producer );
 double GetSpeedFromProducer( Mlt::Producer* producer );
 
 
+class TrackClipCache;
+
 class MultitrackModel : public QAbstractItemModel
 {
     Q_OBJECT
@@ -117,6 +122,9 @@ public:
 
     void audioLevelsReady(const QModelIndex &index);
 
+    // Log the cost of repainting every clip of a synthetic timeline.
+    static void benchmark(int tracks, int clipsPerTrack);
+
     bool createIfNeeded();  //    如果还没有轨道列表m_tractor的话就初始化一个
     void addBackgroundTrack();  //添加空白轨道
     int addAudioTrack();    //添加音频轨道
@@ -129,6 +137,11 @@ public:
     Q_INVOKABLE void reload(bool asynchronous = false);
     void close(); //清空轨道列表
     int clipIndex(int trackIndex, int position); //获取指定轨道指定位置的clip的index
+    // 所有轨道上 position之后/之前最近的剪辑边界，没有则返回 -1
+    int nextEdit(int position) const;
+    int previousEdit(int position) const;
+    // 轨道上与 [from, to]重叠的剪辑范围，没有则返回 false
+    bool clipsInRange(int trackIndex, int from, int to, int* first, int* last) const;
     bool trimClipInValid(int trackIndex, int clipIndex, int delta, bool ripple);
     bool trimClipOutValid(int trackIndex, int clipIndex, int delta, bool ripple);
     int trackHeight() const;  //获取轨道高度，没获取到就用默认值
@@ -234,6 +247,14 @@ public slots:
 
     void debugPrintState();
 
+    // 批量修改：事务期间模型不发任何信号，最外层提交时发一次
+    // modelReset、durationChanged和 modified。可以嵌套。
+    // reset之后还没生成完的波形任务改用新的 index。
+    // notify为 false时提交不发信号，用于视图还不知道这些轨道的时候。
+    void beginTransaction();
+    void commitTransaction(bool notify = true);
+    bool isInTransaction() const { return m_transactionDepth > 0; }
+
 private:
     Mlt::Tractor* m_tractor;
     TrackList m_trackList;
@@ -244,6 +265,12 @@ private:
     // 保存时间线轨道上当前选中的 clip
     // 只是给预览后添加滤镜用的，没有其他用途
     QScopedPointer<Mlt::Producer> m_selectedProducer;
+    // 每条轨道的 clip缓存，data()从这里读取
+    mutable QVector<TrackClipCache*> m_clipCache;
+    // 还在等 hash 的 clip，按 hashResource 索引，onHashReady 只更新这些
+    mutable QMultiHash<QString, QPersistentModelIndex> m_hashWaiters;
+    int m_transactionDepth;
+    bool m_signalsWereBlocked;
 
 
     bool moveClipToTrack(int fromTrack, int toTrack, int clipIndex, int position);
@@ -274,8 +301,17 @@ private:
 
     QString getClipCaption(Mlt::Producer &producerClip) const;
 
+    // The up to date clip cache of a track, or null if the track is missing.
+    TrackClipCache* clipCache(int trackIndex) const;
+    void fillClipDetails(TrackClipCache& cache, int row) const;
+    bool isTransition(TrackClipCache& cache, int clipIndex) const;
+
 private slots:
     void adjustBackgroundDuration();
+    void onHashReady(const QString& path, const QString& hash);
+    void onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+    void onRowsChanged(const QModelIndex& parent);
+    void clearClipCache() const;
 
 };
 
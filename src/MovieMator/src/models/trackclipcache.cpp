@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "trackclipcache.h"
+#include <QScopedPointer>
+
+TrackClipCache::TrackClipCache()
+    : m_event(nullptr)
+    , m_playlist(nullptr)
+    , m_mltIndex(-1)
+    , m_stale(1)
+{
+}
+
+TrackClipCache::~TrackClipCache()
+{
+    detach();
+}
+
+void TrackClipCache::attach(Mlt::Playlist& playlist, int mltIndex)
+{
+    detach();
+    m_event = playlist.listen("producer-changed", this, reinterpret_cast<mlt_listener>(onPlaylistChanged));
+    m_playlist = playlist.get_service();
+    m_mltIndex = mltIndex;
+    m_stale = 1;
+}
+
+void TrackClipCache::detach()
+{
+    if (m_event) {
+        // The playlist may outlive the cache.
+        m_event->block();
+        delete m_event;
+        m_event = nullptr;
+    }
+    m_playlist = nullptr;
+    m_mltIndex = -1;
+    m_stale = 1;
+}
+
+void TrackClipCache::onPlaylistChanged(mlt_properties owner, TrackClipCache* self)
+{
+    Q_UNUSED(owner);
+    self->invalidate();
+}
+
+void TrackClipCache::rebuild(Mlt::Playlist& playlist)
+{
+    // Clear first: an edit during the pass marks the cache stale again.
+    m_stale = 0;
+    int n = qMax(0, playlist.count());
+    start.resize(n);
+    duration.resize(n);
+    in.resize(n);
+    out.resize(n);
+    fps.resize(n);
+    blank.resize(n);
+    producer.resize(n);
+    resource.resize(n);
+
+    Mlt::ClipInfo info;
+    for (int i = 0; i < n; ++i) {
+        if (!playlist.clip_info(i, &info)) {
+            start[i] = i > 0? start[i - 1] + duration[i - 1] : 0;
+            duration[i] = in[i] = out[i] = 0;
+            fps[i] = 0.0;
+            blank[i] = true;
+            producer[i] = nullptr;
+            resource[i].clear();
+            continue;
+        }
+        start[i] = info.start;
+        duration[i] = info.frame_count;
+        in[i] = info.frame_in;
+        out[i] = info.frame_out;
+        fps[i] = info.fps;
+        blank[i] = playlist.is_blank(i);
+        producer[i] = info.producer? info.producer->get_producer() : nullptr;
+        resource[i] = QString::fromUtf8(info.resource);
+    }
+
+    hasDetails.fill(false, n);
+    name.resize(n);
+    service.resize(n);
+    hash.resize(n);
+    thumbnail.resize(n);
+    speed.resize(n);
+    transition.resize(n);
+}
+
+void TrackClipCache::invalidateDetails(int first, int last)
+{
+    first = qMax(0, first);
+    last = qMin(last, hasDetails.size() - 1);
+    for (int i = first; i <= last; ++i)
+        hasDetails[i] = false;
+}
+
+int TrackClipCache::clipIndexAt(int position) const
+{
+    // The first clip ending after position, count() if there is none.
+    int lo = 0;
+    int hi = count();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (start.at(mid) + duration.at(mid) > position)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+int TrackClipCache::clipStart(int index) const
+{
+    if (index <= 0 || count() == 0)
+        return 0;
+    if (index >= count())
+        return playtime();
+    return start.at(index);
+}
+
+int TrackClipCache::clipLength(int index) const
+{
+    return (index >= 0 && index < count())? duration.at(index) : 0;
+}
+
+bool TrackClipCache::isBlank(int index) const
+{
+    return index < 0 || index >= count() || blank.at(index);
+}
+
+int TrackClipCache::playtime() const
+{
+    int n = count();
+    return n? start.at(n - 1) + duration.at(n - 1) : 0;
+}
+
+int TrackClipCache::nextEdit(int position) const
+{
+    int index = clipIndexAt(position);
+    if (index >= count())
+        return -1;
+    return start.at(index) + duration.at(index);
+}
+
+int TrackClipCache::previousEdit(int position) const
+{
+    if (count() == 0 || position <= 0)
+        return -1;
+    int index = clipIndexAt(position);
+    if (index >= count())
+        return position > playtime()? playtime() : start.at(count() - 1);
+    if (start.at(index) < position)
+        return start.at(index);
+    return index > 0? start.at(index - 1) : -1;
+}
+
+bool TrackClipCache::clipsOverlapping(int from, int to, int* first, int* last) const
+{
+    if (to < from || count() == 0)
+        return false;
+    int a = clipIndexAt(qMax(0, from));
+    int b = qMin(clipIndexAt(to), count() - 1);
+    if (a >= count() || b < a)
+        return false;
+    if (first)
+        *first = a;
+    if (last)
+        *last = b;
+    return true;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TRACKCLIPCACHE_H
+#define TRACKCLIPCACHE_H
+
+#include <QVector>
+#include <QString>
+#include <QAtomicInt>
+#include <MltPlaylist.h>
+#include <MltEvent.h>
+
+/*!
+  \class TrackClipCache
+  \brief Struct-of-arrays copy of the clips of one timeline track.
+
+  MultitrackModel answers clip roles from here instead of looking up the
+  track, playlist and clip info through MLT for every role of every clip.
+
+  The layout arrays (start, duration, in, out...) are read from the playlist
+  in one pass. The cache listens to the playlist's "producer-changed" event,
+  which MLT fires on every change to its entries, so any edit, including the
+  ones UndoHelper makes directly, marks it stale and the next query rereads
+  the track. The details of a row (name, hash...) are filled on demand by the
+  model and dropped when it emits dataChanged() for that row.
+
+  Since the clips of a track are contiguous, start is a prefix sum of
+  duration and every position lookup is a binary search over it.
+
+  \threadsafe Only invalidate() may be called from another thread.
+*/
+class TrackClipCache
+{
+public:
+    TrackClipCache();
+    ~TrackClipCache();
+
+    void attach(Mlt::Playlist& playlist, int mltIndex);
+    void detach();
+    int mltIndex() const { return m_mltIndex; }
+    bool isAttachedTo(Mlt::Service& playlist) const { return m_playlist && m_playlist == playlist.get_service(); }
+
+    bool isStale() const { return m_stale.load() != 0; }
+    void invalidate() { m_stale = 1; }
+    // Reread the layout of every clip; the details of all rows are dropped.
+    void rebuild(Mlt::Playlist& playlist);
+    void invalidateDetails(int first, int last);
+
+    int count() const { return start.size(); }
+
+    // Position queries in O(log n). They answer like the Mlt::Playlist
+    // functions of the same names, including out of range indexes.
+    int clipIndexAt(int position) const;
+    int clipStart(int index) const;
+    int clipLength(int index) const;
+    bool isBlank(int index) const;
+    bool isBlankAt(int position) const { return isBlank(clipIndexAt(position)); }
+    int playtime() const;
+    // The nearest clip start or end after or before position, or -1.
+    int nextEdit(int position) const;
+    int previousEdit(int position) const;
+    // The rows overlapping [from, to]; false if there are none.
+    bool clipsOverlapping(int from, int to, int* first, int* last) const;
+
+    // Layout, filled by rebuild().
+    QVector<int> start;
+    QVector<int> duration;
+    QVector<int> in;
+    QVector<int> out;
+    QVector<double> fps;
+    QVector<bool> blank;
+    QVector<mlt_producer> producer;     // the clip's parent, owned by the playlist
+    QVector<QString> resource;
+
+    // Details, filled by MultitrackModel when hasDetails is false.
+    QVector<bool> hasDetails;
+    QVector<QString> name;
+    QVector<QString> service;
+    QVector<QString> hash;
+    QVector<QString> thumbnail;
+    QVector<double> speed;
+    QVector<bool> transition;
+
+private:
+    static void onPlaylistChanged(mlt_properties owner, TrackClipCache* self);
+
+    Mlt::Event* m_event;
+    mlt_service m_playlist;     // only compared, never dereferenced
+    int m_mltIndex;
+    QAtomicInt m_stale;
+};
+
+#endif // TRACKCLIPCACHE_H
@@ -26,6 +26,8 @@
 #include "widgets/timespinbox.h"
 #include "widgets/audioscale.h"
 #include "settings.h"
+#include "glwidget.h"
+#include "framepool.h"
 #include "util.h"
 #include <QtWidgets>
 
@@ -137,6 +139,17 @@ Player::Player(QWidget *parent)
 
     glayout->addWidget(m_videoWidget, 0, 0);
 
+    // Playback statistics overlay drawn over the top-left corner of the video.
+    m_statsOverlay = new QLabel(m_videoScrollWidget);
+    m_statsOverlay->setAttribute(Qt::WA_TransparentForMouseEvents);
+    m_statsOverlay->setStyleSheet("QLabel{background-color:rgba(0,0,0,160);color:white;padding:4px;"
+                                  "font-family:monospace;font-size:11px;}");
+    m_statsOverlay->hide();
+    glayout->addWidget(m_statsOverlay, 0, 0, Qt::AlignLeft | Qt::AlignTop);
+    m_statsTimer.setInterval(500);
+    connect(&m_statsTimer, SIGNAL(timeout()), SLOT(updatePlaybackStats()));
+    actionPlaybackStats->setChecked(Settings.playerShowStats());
+
     m_verticalScroll = new QScrollBar(Qt::Vertical);
 
     glayout->addWidget(m_verticalScroll, 0, 1);
@@ -590,6 +603,11 @@ void Player::setupActions(QWidget* widget)
     actionVolume = new QAction(widget);
     actionVolume->setObjectName(QString::fromUtf8("actionVolume"));
     actionVolume->setIcon(QIcon(":/icons/light/32x32/player-volume.png"));
+
+    actionPlaybackStats = new QAction(widget);
+    actionPlaybackStats->setObjectName(QString::fromUtf8("actionPlaybackStats"));
+    actionPlaybackStats->setCheckable(true);
+    widget->addAction(actionPlaybackStats);
     retranslateUi(widget);
     QMetaObject::connectSlotsByName(widget);
 }
@@ -628,6 +646,11 @@ void Player::retranslateUi(QWidget* widget)
 #ifndef QT_NO_TOOLTIP
     actionVolume->setToolTip(tr("Show the volume control"));
 #endif
+    actionPlaybackStats->setText(tr("Playback Statistics"));
+#ifndef QT_NO_TOOLTIP
+    actionPlaybackStats->setToolTip(tr("Show preview latency and dropped frames (Ctrl+Shift+F12)"));
+#endif
+    actionPlaybackStats->setShortcut(QString("Ctrl+Shift+F12"));
 }
 
 void Player::setIn(int pos)
@@ -1455,3 +1478,25 @@ void Player::mouseDoubleClickEvent(QMouseEvent *event)
     Q_UNUSED(event)
     toggleFullScreen();
 }
+
+void Player::on_actionPlaybackStats_toggled(bool checked)
+{
+    Settings.setPlayerShowStats(checked);
+    m_statsOverlay->setVisible(checked);
+    if (checked) {
+        updatePlaybackStats();
+        m_statsTimer.start();
+    } else {
+        m_statsTimer.stop();
+    }
+}
+
+void Player::updatePlaybackStats()
+{
+    Mlt::GLWidget* videoWidget = static_cast<Mlt::GLWidget*>(&(MLT));
+    if (!videoWidget || !videoWidget->playbackStats())
+        return;
+    m_statsOverlay->setText(videoWidget->playbackStats()->summary() + "\n"
+                            + FramePool::singleton().summary());
+    m_statsOverlay->adjustSize();
+}
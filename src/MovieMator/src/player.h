@@ -140,6 +140,7 @@ private:
     QAction *actionRewind;
     QAction *actionFastForward;
     QAction *actionVolume;
+    QAction *actionPlaybackStats;
 
     QPushButton *m_btnSeekPrevious;
     QPushButton *m_btnSeekNext;
@@ -191,6 +192,8 @@ private:
     QPropertyAnimation* m_statusFadeIn;
     QPropertyAnimation* m_statusFadeOut;
     QTimer m_statusTimer;
+    QLabel* m_statsOverlay;
+    QTimer m_statsTimer;
 
     QPushButton *m_fitButton;           // 合适
     QPushButton *m_fullScreenButton;    // 全屏
@@ -222,6 +225,9 @@ private slots:
     void onZoomActionTriggered();
 
     void onShowVolumeSlider();
+
+    void on_actionPlaybackStats_toggled(bool checked);
+    void updatePlaybackStats();
 };
 
 #endif // PLAYER_H
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "proxymanager.h"
+#include "jobqueue.h"
+#include "jobs/proxyjob.h"
+#include "mltcontroller.h"
+#include "settings.h"
+#include "shotcut_mlt_properties.h"
+#include "util.h"
+#include <QStandardPaths>
+#include <QDomDocument>
+#include <QFile>
+#include <QSet>
+#include <Logger.h>
+
+// Proxies are scaled down to this height.
+static const int PROXY_HEIGHT = 540;
+
+// Hashes of the proxies being generated.
+static QSet<QString> pendingProxies;
+
+QDir ProxyManager::dir()
+{
+    QDir dir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+    if (!dir.exists("proxies"))
+        dir.mkpath("proxies");
+    dir.cd("proxies");
+    return dir;
+}
+
+QString ProxyManager::proxyPath(const QString& hash)
+{
+    return dir().filePath(hash + ".mp4");
+}
+
+bool ProxyManager::hasProxy(const QString& hash)
+{
+    return !hash.isEmpty() && QFile::exists(proxyPath(hash));
+}
+
+bool ProxyManager::needsProxy(Mlt::Producer& producer)
+{
+    if (!producer.is_valid() || producer.get(kOriginalResourceProperty))
+        return false;
+    if (!QString(producer.get("mlt_service")).startsWith("avformat"))
+        return false;
+    int videoIndex = producer.get_int("video_index");
+    if (videoIndex < 0 || producer.get_int("meta.media.width") <= 0)
+        return false;
+    if (producer.get_int("meta.media.height") > 1080)
+        return true;
+    // 10 and 12-bit formats such as yuv420p10le.
+    QString key = QString("meta.media.%1.codec.pix_fmt").arg(videoIndex);
+    QString pixelFormat = producer.get(key.toLatin1().constData());
+    return pixelFormat.contains("p10") || pixelFormat.contains("p12");
+}
+
+void ProxyManager::generateIfNeeded(Mlt::Producer& producer)
+{
+    if (!Settings.proxyEnabled() || !needsProxy(producer))
+        return;
+    generate(QString::fromUtf8(producer.get("resource")), MLT.getHash(producer),
+             producer.get_int("meta.media.height"));
+}
+
+void ProxyManager::generate(const QString& resource, const QString& hash, int mediaHeight)
+{
+    if (hash.isEmpty() || hasProxy(hash) || pendingProxies.contains(hash))
+        return;
+    int height = qMin(PROXY_HEIGHT, mediaHeight) / 2 * 2;
+    LOG_INFO() << "generating proxy for" << resource;
+    pendingProxies.insert(hash);
+    JOBS.add(new ProxyJob(resource, hash, height));
+}
+
+Mlt::Producer* ProxyManager::proxyProducer(Mlt::Producer& producer)
+{
+    if (!Settings.proxyEnabled() || !hasProxy(MLT.getHash(producer)))
+        return nullptr;
+    QString xml = MLT.XML(&producer);
+    if (!filterXML(xml, true))
+        return nullptr;
+    Mlt::Producer* proxy = new Mlt::Producer(MLT.profile(), "xml-string", xml.toUtf8().constData());
+    if (!proxy->is_valid()) {
+        delete proxy;
+        return nullptr;
+    }
+    return proxy;
+}
+
+static void setElementText(QDomDocument& dom, QDomElement& element, const QString& text)
+{
+    while (element.hasChildNodes())
+        element.removeChild(element.firstChild());
+    element.appendChild(dom.createTextNode(text));
+}
+
+bool ProxyManager::filterXML(QDomDocument& dom, bool useProxies)
+{
+    bool changed = false;
+    QDomNodeList producers = dom.elementsByTagName("producer");
+    for (int i = 0; i < producers.length(); ++i) {
+        QDomElement producer = producers.at(i).toElement();
+        QDomElement resource;
+        QDomElement original;
+        QString service;
+        QString hash;
+        for (QDomElement p = producer.firstChildElement("property"); !p.isNull(); p = p.nextSiblingElement("property")) {
+            QString name = p.attribute("name");
+            if (name == "resource")
+                resource = p;
+            else if (name == kOriginalResourceProperty)
+                original = p;
+            else if (name == "mlt_service")
+                service = p.text();
+            else if (name == kShotcutHashProperty)
+                hash = p.text();
+        }
+        if (resource.isNull())
+            continue;
+
+        if (useProxies) {
+            if (!original.isNull() || !service.startsWith("avformat") || !hasProxy(hash))
+                continue;
+            original = dom.createElement("property");
+            original.setAttribute("name", kOriginalResourceProperty);
+            setElementText(dom, original, resource.text());
+            producer.appendChild(original);
+            setElementText(dom, resource, proxyPath(hash));
+        } else {
+            if (original.isNull())
+                continue;
+            setElementText(dom, resource, original.text());
+            producer.removeChild(original);
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+bool ProxyManager::filterXML(QString& xml, bool useProxies)
+{
+    // Most documents have nothing to swap; avoid parsing them.
+    if (!xml.contains(useProxies? kShotcutHashProperty : kOriginalResourceProperty))
+        return false;
+    QDomDocument dom;
+    if (!dom.setContent(xml) || !filterXML(dom, useProxies))
+        return false;
+    xml = dom.toString(2);
+    return true;
+}
+
+bool ProxyManager::filterXMLFile(const QString& fileName, bool useProxies)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QString xml = QString::fromUtf8(file.readAll());
+    file.close();
+    if (!filterXML(xml, useProxies))
+        return false;
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        LOG_WARNING() << "failed to write" << fileName;
+        return false;
+    }
+    file.write(xml.toUtf8());
+    file.close();
+    return true;
+}
+
+void ProxyManager::onProxyFinished(const QString& hash)
+{
+    pendingProxies.remove(hash);
+}
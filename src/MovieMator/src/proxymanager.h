@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PROXYMANAGER_H
+#define PROXYMANAGER_H
+
+#include <QString>
+#include <QDir>
+
+class QDomDocument;
+namespace Mlt {
+    class Producer;
+}
+
+/*!
+  \class ProxyManager
+  \brief Generates low-resolution proxies of large media and maps producers between proxies and originals.
+
+  A proxy is named after the media hash (kShotcutHashProperty). While a
+  producer uses its proxy, "resource" holds the proxy path and
+  kOriginalResourceProperty the original. Projects and exports always get
+  the originals back through filterXML(); MltXmlChecker applies the proxies
+  again when a project is opened.
+*/
+class ProxyManager
+{
+public:
+    static QDir dir();
+    static QString proxyPath(const QString& hash);
+    static bool hasProxy(const QString& hash);
+
+    // Whether a video is large enough to be worth a proxy (above HD or more than 8 bits).
+    static bool needsProxy(Mlt::Producer& producer);
+    // Queue a proxy job for the producer's media unless one exists or is running.
+    static void generateIfNeeded(Mlt::Producer& producer);
+    // Queue a proxy job for media already probed and hashed, e.g. by a worker thread.
+    // Main thread only, like generateIfNeeded().
+    static void generate(const QString& resource, const QString& hash, int mediaHeight);
+    // A new producer using the proxy of this one, or null if there is none yet.
+    static Mlt::Producer* proxyProducer(Mlt::Producer& producer);
+
+    // Swap producers to their proxies (useProxies) or back to their originals.
+    // These return whether anything was changed.
+    static bool filterXML(QDomDocument& dom, bool useProxies);
+    static bool filterXML(QString& xml, bool useProxies);
+    static bool filterXMLFile(const QString& fileName, bool useProxies);
+
+    static void onProxyFinished(const QString& hash);
+};
+
+#endif // PROXYMANAGER_H
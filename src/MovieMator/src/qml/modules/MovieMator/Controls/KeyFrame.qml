@@ -91,36 +91,43 @@ RowLayout{
         var position = timeline.getPositionInCurrentClip()
         if (position < 0) return
 
+        //所有关键帧一次设置，只产生一个撤销步骤
+        var keyFrames = []
+
         //添加首尾关键帧
         if (filter.cache_getKeyFrameNumber() <= 0)
         {
+            var position2 = (timeline.getCurrentClipLength() - 1) // filter.producerOut - filter.producerIn + 1
+            var first = {"frame": 0}
+            var last = {"frame": position2}
             var paramCount = metadata.keyframes.parameterCount
             for(var i = 0; i < paramCount; i++)
             {
                 var key = metadata.keyframes.parameters[i].property
                 var value = filter.get(key)
-
-                var position2 = (timeline.getCurrentClipLength() - 1) // filter.producerOut - filter.producerIn + 1
-                
-                filter.cache_setKeyFrameParaValue(position2, key, value.toString() );
-                filter.cache_setKeyFrameParaValue(0, key, value.toString() );
+                first[key] = value.toString()
+                last[key] = value.toString()
             }
+            keyFrames.push(last)
+            keyFrames.push(first)
         }
 
         //插入关键帧
+        var current = {"frame": position}
         paramCount = metadata.keyframes.parameterCount
         for(i = 0; i < paramCount; i++)
         {            
             key = metadata.keyframes.parameters[i].property
             var paraType = metadata.keyframes.parameters[i].paraType
             if (paraType === "rect") {
-                var rect = filter.getAnimRectValue(position, key)
-                filter.cache_setKeyFrameParaRectValue(position, key, rect, 1.0)
+                current[key] = filter.getAnimRectValue(position, key)
             } else {
                 value = filter.get(key)
-                filter.cache_setKeyFrameParaValue(position, key, value.toString() );
+                current[key] = value.toString()
             }
         }
+        keyFrames.push(current)
+        filter.setKeyFrameParaValues(keyFrames)
         filter.syncCacheToProject();
         
         showAddFrameInfo(position)
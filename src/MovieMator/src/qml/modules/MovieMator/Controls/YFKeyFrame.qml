@@ -438,28 +438,33 @@ RowLayout{
 
         bBlockUpdateUI = true
 
+        //所有关键帧一次设置，只产生一个撤销步骤
+        var keyFrames = []
+
         //添加首尾关键帧
         if (filter.cache_getKeyFrameNumber() <= 0)
         {
+            var position2 = timeline.getCurrentClipLength() - 1//filter.producerOut - filter.producerIn + 1
+            var first = {"frame": 0}
+            var last = {"frame": position2}
             var paramCount = metadata.keyframes.parameterCount
             for(var i = 0; i < paramCount; i++)
             {
                 var key = metadata.keyframes.parameters[i].property
                 var paraType = metadata.keyframes.parameters[i].paraType
                 var value = ''
-                var position2 = timeline.getCurrentClipLength() - 1//filter.producerOut - filter.producerIn + 1
                 if(paraType === 'rect'){
                     value = filter.getAnimRectValue(position,key)
-                    filter.cache_setKeyFrameParaRectValue(0, key, value)
-                    filter.cache_setKeyFrameParaRectValue(position2, key, value)
-                    
+                    first[key] = value
+                    last[key] = value
                 }else{
                     value = filter.get(key)
-                    filter.cache_setKeyFrameParaValue(0, key, value.toString());
-                    filter.cache_setKeyFrameParaValue(position2, key, value.toString());
-                    
+                    first[key] = value.toString()
+                    last[key] = value.toString()
                 }
             }
+            keyFrames.push(first)
+            keyFrames.push(last)
         }
 
         bBlockUpdateUI = false
@@ -470,6 +475,7 @@ RowLayout{
             //return
         bBlockUpdateUI = true
         //插入关键帧
+        var current = {"frame": position}
         paramCount = metadata.keyframes.parameterCount
         for(i = 0; i < paramCount; i++)
         {
@@ -480,24 +486,25 @@ RowLayout{
             switch(paraType){
             case 'int':
                 value = filter.getAnimIntValue(position,key)
-                filter.cache_setKeyFrameParaValue(position, key, value.toString());
+                current[key] = value.toString()
                 break;
             case 'double':
                 value = filter.getAnimDoubleValue(position,key)
-                filter.cache_setKeyFrameParaValue(position, key, value.toString());
+                current[key] = value.toString()
                 break;
             case 'string':
                 value = filter.getAnimStringValue(position,key)
-                filter.cache_setKeyFrameParaValue(position, key, value.toString());
+                current[key] = value.toString()
                 break;
             case 'rect':
-                value = filter.getAnimRectValue(position,key)
-                filter.cache_setKeyFrameParaRectValue(position, key, value);
+                current[key] = filter.getAnimRectValue(position,key)
                 break;
             default:
                 break;
             }
         }
+        keyFrames.push(current)
+        filter.setKeyFrameParaValues(keyFrames)
         
         filter.syncCacheToProject();
         bKeyFrame = true
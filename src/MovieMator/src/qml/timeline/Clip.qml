@@ -332,9 +332,8 @@ Rectangle {
                 width: Math.min(waveform.innerWidth, waveform.maxWidth)
                 height: waveform.height
                 fillColor: getWaveColor()
-                property int channels: 2
-                inPoint: Math.round((clipRoot.inPoint + index * waveform.maxWidth / timeScale) * speed) * channels
-                outPoint: inPoint + Math.round(width / timeScale * speed) * channels
+                inPoint: Math.round((clipRoot.inPoint + index * waveform.maxWidth / timeScale) * speed)
+                outPoint: inPoint + Math.round(width / timeScale * speed)
                 levels: audioLevels
             }
         }
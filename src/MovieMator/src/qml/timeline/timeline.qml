@@ -910,6 +910,16 @@ Rectangle {
     Connections {
         target: multitrack
         onLoaded: toolbar.scaleSliderValue = Math.pow(multitrack.scaleFactor - 0.01, 1.0 / 3.0)//scaleSlider.value = Math.pow(multitrack.scaleFactor - 0.01, 1.0 / 3.0)
+        onScaleFactorChanged: updateVisibleRange()
+    }
+
+    // 让可见区域内剪辑的音频波形先生成
+    function updateVisibleRange() {
+        if (!scrollView || multitrack.scaleFactor <= 0)
+            return
+        var contentX = scrollView.flickableItem.contentX
+        timeline.setVisibleRange(Math.floor(contentX / multitrack.scaleFactor),
+                                 Math.ceil((contentX + scrollView.width) / multitrack.scaleFactor))
     }
 
     Connections {
@@ -922,6 +932,7 @@ Rectangle {
         }
         onContentXChanged:
         {
+            updateVisibleRange()
 //            rulerScrollView.flickableItem.contentX =  scrollView.flickableItem.contentX
         }
     }
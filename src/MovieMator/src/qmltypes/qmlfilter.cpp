@@ -34,7 +34,9 @@
 #include <QTemporaryFile>
 #include <QFile>
 #include <QtXml>
+#include <QThread>
 #include <MltProducer.h>
+#include <algorithm>
 #include "docks/timelinedock.h"
 #include "commands/timelinecommands.h"
 
@@ -52,14 +54,114 @@ QmlFilter::QmlFilter(Mlt::Filter* mltFilter, /*const*/ QmlMetadata* metadata, QO
     , m_filter(mltFilter)
     , m_sResourcePath(m_metadata->path().absolutePath().append('/'))
     , m_isNew(false)
+    , m_keyFrameRevision(0)
+    , m_propertyChanged(nullptr)
 {
+    if (m_filter) {
+        if (m_metadata->keyframes()) {
+            int paramCount = m_metadata->keyframes()->parameterCount();
+            for (int i = 0; i < paramCount; i++)
+                m_keyFrameProperties.insert(m_metadata->keyframes()->parameter(i)->property().toUtf8());
+        }
+        m_propertyChanged = m_filter->listen("property-changed", this, reinterpret_cast<mlt_listener>(onPropertyChanged));
+    }
 }
 
 QmlFilter::~QmlFilter()
 {
+    if (m_propertyChanged) {
+        // The filter is shared with the service it is attached to and may outlive this.
+        m_propertyChanged->block();
+        delete m_propertyChanged;
+    }
     delete m_filter;
 }
 
+void QmlFilter::onPropertyChanged(mlt_properties owner, QmlFilter* self, const char* name)
+{
+    Q_UNUSED(owner);
+    // Properties starting with '_' are the filter's own bookkeeping, set while rendering.
+    if (!name || name[0] == '_')
+        return;
+    if (self->m_keyFrameProperties.contains(QByteArray::fromRawData(name, int(qstrlen(name)))))
+        self->invalidateKeyFrames();
+    // Sets from the render threads are not edits; only the GUI thread touches the frame cache.
+    if (QThread::currentThread() != qApp->thread())
+        return;
+    // Frames the viewer cached before the change no longer match.
+    self->invalidateFrameCache();
+}
+
+void QmlFilter::invalidateFrameCache()
+{
+    if (!m_filter)
+        return;
+    mlt_producer service = mlt_producer(m_filter->get_data("service"));
+    MultitrackModel* model = MAIN.timelineDock()->model();
+    if (!service || !MLT.isMultitrack() || !model->tractor()) {
+        // The player shows the filtered clip itself: all of it changed.
+        MLT.invalidateFrameCache();
+        return;
+    }
+    // Filters of a timeline clip are attached to the cut's parent.
+    for (int i = 0; i < model->tractor()->count(); i++) {
+        QScopedPointer<Mlt::Producer> track(model->tractor()->track(i));
+        if (!track)
+            continue;
+        Mlt::Playlist playlist(*track);
+        for (int j = 0; j < playlist.count(); j++) {
+            QScopedPointer<Mlt::ClipInfo> info(playlist.clip_info(j));
+            if (info && info->producer && (info->producer->get_producer() == service
+                                           || (info->cut && info->cut->get_producer() == service)))
+                MLT.invalidateFrameCache(info->start, info->start + info->frame_count - 1);
+        }
+    }
+}
+
+void QmlFilter::animationsChanged()
+{
+    invalidateKeyFrames();
+    if (m_filter)
+        UndoHelper::filterChanged(*m_filter);
+}
+
+QVector<int> QmlFilter::keyFrames(const QString& name)
+{
+    // Read before the animation so that a change made meanwhile is not lost.
+    int revision = m_keyFrameRevision.load();
+    KeyFrameIndex& index = m_keyFrameIndex[name];
+    if (index.revision != revision) {
+        index.frames.clear();
+        if (m_filter) {
+            Mlt::Animation animation = getAnimation(name);
+            if (animation.is_valid()) {
+                int count = animation.key_count();
+                index.frames.reserve(count);
+                for (int i = 0; i < count; i++)
+                    index.frames.append(animation.key_get_frame(i));
+                // MLT keeps the keys in order; make sure of it for the binary searches.
+                std::sort(index.frames.begin(), index.frames.end());
+            }
+        }
+        index.revision = revision;
+    }
+    return index.frames;
+}
+
+// 关键帧 frames 中在 frame 之前的最后一个，没有返回 -1
+static int keyFrameBefore(const QVector<int>& frames, int frame)
+{
+    QVector<int>::const_iterator it = std::lower_bound(frames.constBegin(), frames.constEnd(), frame);
+    return (it == frames.constBegin())? -1 : *(it - 1);
+}
+
+// 关键帧 frames 中在 frame 之后的第一个，没有返回 -1
+static int keyFrameAfter(const QVector<int>& frames, int frame)
+{
+    QVector<int>::const_iterator it = std::upper_bound(frames.constBegin(), frames.constEnd(), frame);
+    return (it == frames.constEnd())? -1 : *it;
+}
+
 //#ifdef MOVIEMATOR_PRO
 Mlt::Animation QmlFilter::getAnimation(const QString& name)
 {
@@ -83,7 +185,7 @@ int QmlFilter::getKeyFrameCountOnProject(QString name)
 {
     if (m_filter)
     {
-        int count = getAnimation(name).key_count();
+        int count = keyFrames(name).count();
         return count;
     }
     else
@@ -96,7 +198,9 @@ int QmlFilter::getKeyFrameOnProjectOnIndex(int index, QString name)
 
     if (m_filter)
     {
-        int nKeyFrame = getAnimation(name).key_get_frame(index);
+        QVector<int> frames = keyFrames(name);
+        if (index < 0 || index >= frames.count()) return -1;
+        int nKeyFrame = frames.at(index);
 
         int nPositionInClip = MAIN.timelineDock()->getPositionOnClip(nKeyFrame);
         int nClipLength = MAIN.timelineDock()->getCurrentClipLength();
@@ -114,7 +218,8 @@ void QmlFilter::removeAnimationKeyFrame(int nFrame, QString name, bool bFromUndo
     int nFrameInClip = nFrame;
     nFrame = MAIN.timelineDock()->getPositionOnParentProducer(nFrame);
 
-    bool bKeyFrame = getAnimation(name).is_key(nFrame);
+    QVector<int> frames = keyFrames(name);
+    bool bKeyFrame = std::binary_search(frames.constBegin(), frames.constEnd(), nFrame);
     if(!bKeyFrame)      return;
 
     if (m_filter)
@@ -155,6 +260,9 @@ void QmlFilter::removeAnimationKeyFrame(int nFrame, QString name, bool bFromUndo
         }
 
         getAnimation(name).remove(nFrame);
+        // Mlt::Animation::remove() does not fire "property-changed".
+        animationsChanged();
+        invalidateFrameCache();
     }
 
     emit keyframeNumberChanged();
@@ -394,6 +502,7 @@ void QmlFilter::anim_set(QString name, QString value)
     QString anim_name = "anim-"+name;
     qDebug()<<"anim_set, key:"<<anim_name<<", value:"<<value;
     m_filter->set(anim_name.toUtf8().constData(),value.toUtf8().constData());
+    invalidateKeyFrames();
     MLT.refreshConsumer();
     emit filterPropertyValueChanged();
 }
@@ -657,9 +766,7 @@ int QmlFilter::cache_getPreKeyFrameNumInParent(int currentKeyFrame, QString prop
     if (propertyName == nullptr) propertyName = getAnyAnimPropertyName();
     if (propertyName == nullptr) return -1;
 
-    if (getAnimation(propertyName).is_key(currentKeyFrame)) currentKeyFrame = currentKeyFrame - 1;
-
-    int nKeyFrame = getAnimation(propertyName).previous_key(currentKeyFrame);
+    int nKeyFrame = keyFrameBefore(keyFrames(propertyName), currentKeyFrame);
 
     return nKeyFrame;
 
@@ -734,9 +841,8 @@ int QmlFilter::cache_getNextKeyFrameNum(int currentKeyFrame, QString propertyNam
     if (propertyName == nullptr) propertyName = getAnyAnimPropertyName();
     if (propertyName == nullptr) return -1;
 
-    if (getAnimation(propertyName).is_key(currentKeyFrame)) currentKeyFrame = currentKeyFrame + 1;
-
-    int nKeyFrame = getAnimation(propertyName).next_key(currentKeyFrame);
+    int nKeyFrame = keyFrameAfter(keyFrames(propertyName), currentKeyFrame);
+    if (nKeyFrame < 0) return -1;
 
     int nPositionInClip = MAIN.timelineDock()->getPositionOnClip(nKeyFrame);
     int nClipLength     = MAIN.timelineDock()->getCurrentClipLength();
@@ -775,6 +881,35 @@ void QmlFilter::cache_setKeyFrameParaRectValue(int frame, QString key, const QRe
     cache_setKeyFrameParaValue(frame, key, sValue);
 }
 
+void QmlFilter::setKeyFrameParaValues(const QVariantList &keyFrames)
+{
+    if (!m_filter) return;
+
+    QVector<key_frame_item> listKeyFrame;
+    foreach (const QVariant &item, keyFrames)
+    {
+        QVariantMap map = item.toMap();
+        if (!map.contains("frame")) continue;
+        key_frame_item para;
+        para.keyFrame = map.take("frame").toInt();
+        if (para.keyFrame < 0) continue;
+        QVariantMap::ConstIterator iter = map.constBegin();
+        for (; iter != map.constEnd(); ++iter)
+        {
+            if (iter.value().type() == QVariant::RectF)
+            {
+                QRectF rect = iter.value().toRectF();
+                para.paraMap.insert(iter.key(), QString("%1 %2 %3 %4 %5").arg(rect.x()).arg(rect.y()).arg(rect.width()).arg(rect.height()).arg(1.0));
+            }
+            else
+                para.paraMap.insert(iter.key(), iter.value().toString());
+        }
+        if (!para.paraMap.isEmpty())
+            listKeyFrame.append(para);
+    }
+    MAIN.filterController()->setKeyFrames(m_filter, listKeyFrame);
+}
+
 void QmlFilter::cache_setKeyFrameParaValue(int frame, QString key, QString value, bool bFromUndo)
 {
     QString from_value  = "";
@@ -856,6 +991,7 @@ void QmlFilter::cache_setKeyFrameParaValue(int frame, QString key, QString value
                         m_filter->anim_set(key.toUtf8().constData(), value.toUtf8().constData(), frame, duration);
                     }
                 }
+                animationsChanged();
 
 
        if(!bFromUndo && (from_value != ""))
@@ -1097,7 +1233,8 @@ bool QmlFilter::cache_bKeyFrame(int frame, QString propertyName)
     if (propertyName == nullptr) propertyName = getAnyAnimPropertyName();
     if (propertyName == nullptr) return false;
 
-    return getAnimation(propertyName).is_key(frame);
+    QVector<int> frames = keyFrames(propertyName);
+    return std::binary_search(frames.constBegin(), frames.constEnd(), frame);
 }
 
 
@@ -1112,8 +1249,8 @@ bool QmlFilter::bHasPreKeyFrame(int frame)
         if (paramCount <= 0) return false;
         QString name = m_metadata->keyframes()->parameter(0)->property();
 
-        if (getAnimation(name).is_key(frameInParent)) frameInParent = frameInParent - 1;
-        int nKeyFrame = getAnimation(name).previous_key(frameInParent);
+        int nKeyFrame = keyFrameBefore(keyFrames(name), frameInParent);
+        if (nKeyFrame < 0) return false;
         nKeyFrame = MAIN.timelineDock()->getPositionOnClip(nKeyFrame);
 
         if (nKeyFrame >= 0 && (nKeyFrame != frame)) return true;
@@ -1133,9 +1270,8 @@ bool QmlFilter::bHasNextKeyFrame(int frame)
         if (paramCount <= 0) return false;
         QString name = m_metadata->keyframes()->parameter(0)->property();
 
-        if (getAnimation(name).is_key(frameInParent)) frameInParent = frameInParent + 1;
-
-        int nKeyFrame = getAnimation(name).next_key(frameInParent);
+        int nKeyFrame = keyFrameAfter(keyFrames(name), frameInParent);
+        if (nKeyFrame < 0) return false;
         nKeyFrame = MAIN.timelineDock()->getPositionOnClip(nKeyFrame);
 
         int nClipLength = MAIN.timelineDock()->getCurrentClipLength();
@@ -1312,7 +1448,9 @@ void QmlFilter::refreshKeyFrame(const QVector<key_frame_item> &listKeyFrame)
 
 void QmlFilter::refreshNoAnimation(const QVector<key_frame_item> &listParameter, bool bFromUndo)
 {
-    for(int nIndex = 0; nIndex < listParameter.count(); nIndex++)
+    // 同一属性只设置最后一个值，前面的值会被覆盖
+    QSet<QString> setNames;
+    for(int nIndex = listParameter.count() - 1; nIndex >= 0; nIndex--)
     {
         key_frame_item para = listParameter.at(nIndex);
         QMap<QString, QString>::Iterator iter = para.paraMap.begin();
@@ -1320,6 +1458,8 @@ void QmlFilter::refreshNoAnimation(const QVector<key_frame_item> &listParameter,
         {
             QString sPropertyName   = iter.key();
             QString sValue          = iter.value();
+            if (setNames.contains(sPropertyName)) { iter++; continue; }
+            setNames.insert(sPropertyName);
 
             QString paraType    = "string";
             int paramCount      = m_metadata->keyframes()->parameterCount();
@@ -1361,6 +1501,152 @@ void QmlFilter::refreshNoAnimation(const QVector<key_frame_item> &listParameter,
     emit keyframeNumberChanged();
 }
 
+void QmlFilter::setKeyFrames(const QVector<key_frame_item> &listKeyFrame)
+{
+    applyKeyFrames(listKeyFrame, QVector<key_frame_item>());
+}
+
+void QmlFilter::removeKeyFrames(const QVector<key_frame_item> &listKeyFrame)
+{
+    applyKeyFrames(QVector<key_frame_item>(), listKeyFrame);
+}
+
+void QmlFilter::refreshAnimations(const QMap<QString, QString> &animations)
+{
+    if (!m_filter) return;
+
+    QMap<QString, QString>::ConstIterator iter = animations.constBegin();
+    for (; iter != animations.constEnd(); ++iter)
+        m_filter->set(iter.key().toUtf8().constData(), iter.value().toUtf8().constData());
+    animationsChanged();
+
+    MLT.refreshConsumer();
+    emit filterPropertyValueChanged();
+    emit keyframeNumberChanged();
+}
+
+void QmlFilter::applyKeyFrames(const QVector<key_frame_item> &listSet, const QVector<key_frame_item> &listRemove)
+{
+    if (!m_filter || !m_metadata || !m_metadata->keyframes()) return;
+    Q_ASSERT(MAIN.timelineDock());
+
+    // 按属性收集要设置和删除的帧（在父 producer中的位置）
+    QMap<QString, QMap<int, QString> > setValues;
+    QMap<QString, QSet<int> > removeFrames;
+    for (int nIndex = 0; nIndex < listSet.count() + listRemove.count(); nIndex++)
+    {
+        bool bRemove = nIndex >= listSet.count();
+        const key_frame_item &para = bRemove? listRemove.at(nIndex - listSet.count()) : listSet.at(nIndex);
+        if (para.keyFrame < 0) continue;
+        int frame = MAIN.timelineDock()->getPositionOnParentProducer(para.keyFrame);
+
+        QMap<QString, QString>::ConstIterator iter = para.paraMap.constBegin();
+        for (; iter != para.paraMap.constEnd(); ++iter)
+        {
+            if (bRemove)
+                removeFrames[iter.key()].insert(frame);
+            else
+                setValues[iter.key()].insert(frame, iter.value());
+        }
+    }
+
+    int paramCount = m_metadata->keyframes()->parameterCount();
+    for (int i = 0; i < paramCount; i++)
+    {
+        QString name        = m_metadata->keyframes()->parameter(i)->property();
+        QString paraType    = m_metadata->keyframes()->parameter(i)->paraType();
+        if (!setValues.contains(name) && !removeFrames.contains(name)) continue;
+
+        if (paraType == "double" || paraType == "int" || paraType == "rect")
+        {
+            writeAnimation(name, paraType, setValues.value(name), removeFrames.value(name));
+        }
+        else
+        {
+            // 字符串的值可能含有 ';'和 '='，不能拼进动画字符串
+            for (int n = 0; n < listRemove.count(); n++)
+                if (listRemove.at(n).paraMap.contains(name))
+                    removeAnimationKeyFrame(listRemove.at(n).keyFrame, name, true);
+            for (int n = 0; n < listSet.count(); n++)
+                if (listSet.at(n).paraMap.contains(name))
+                    cache_setKeyFrameParaValue(listSet.at(n).keyFrame, name, listSet.at(n).paraMap.value(name), true);
+        }
+    }
+    animationsChanged();
+
+    MLT.refreshConsumer();
+    emit filterPropertyValueChanged();
+    emit keyframeNumberChanged();
+}
+
+void QmlFilter::writeAnimation(const QString &name, const QString &paraType,
+                               const QMap<int, QString> &setValues, const QSet<int> &removeFrames)
+{
+    QByteArray propertyName = name.toUtf8();
+    int duration = m_filter->get_length();
+
+    // 现有的关键帧，值按滤镜的 locale序列化，设置回去时也按它解析
+    QMap<int, QString> keys;
+    Mlt::Animation animation = getAnimation(name);
+    if (animation.is_valid())
+    {
+        int count = animation.key_count();
+        for (int i = 0; i < count; i++)
+        {
+            int frame = 0;
+            mlt_keyframe_type type = mlt_keyframe_linear;
+            if (animation.key_get(i, frame, type)) continue;
+            QString sValue = QString::fromUtf8(m_filter->anim_get(propertyName.constData(), frame, duration));
+            if (removeFrames.contains(frame)) continue;
+            QString sType = (type == mlt_keyframe_discrete)? "|" : (type == mlt_keyframe_smooth)? "~" : "";
+            keys.insert(frame, QString("%1%2=%3").arg(frame).arg(sType).arg(sValue));
+        }
+    }
+
+    // 新的关键帧都是线性的，和 cache_setKeyFrameParaValue()一样
+    Mlt::Properties scratch;
+    if (m_filter->get_lcnumeric())
+        scratch.set_lcnumeric(m_filter->get_lcnumeric());
+    QMap<int, QString>::ConstIterator iter = setValues.constBegin();
+    for (; iter != setValues.constEnd(); ++iter)
+    {
+        QString sValue;
+        if (paraType == "double")
+        {
+            scratch.set("value", iter.value().toDouble());
+            sValue = QString::fromUtf8(scratch.get("value"));
+        }
+        else if (paraType == "int")
+        {
+            sValue = QString::number(iter.value().toInt());
+        }
+        else
+        {
+            QStringList listValue = iter.value().split(" ", QString::SkipEmptyParts);
+            if (listValue.count() < 5) continue;
+            scratch.set("value", listValue[0].toDouble(), listValue[1].toDouble(),
+                        listValue[2].toDouble(), listValue[3].toDouble(), listValue[4].toDouble());
+            sValue = QString::fromUtf8(scratch.get("value"));
+        }
+        keys.insert(iter.key(), QString("%1=%2").arg(iter.key()).arg(sValue));
+    }
+
+    if (keys.isEmpty())
+    {
+        // 关键帧都删除了，属性回到不带动画的值：当前位置上的值，和逐个删除时一样
+        if (animation.is_valid() && animation.key_count() > 0)
+        {
+            int position = qMax(0, MAIN.timelineDock()->getPositionInCurrentClip());
+            position = qMax(0, MAIN.timelineDock()->getPositionOnParentProducer(position));
+            QString sValue = QString::fromUtf8(m_filter->anim_get(propertyName.constData(), position, duration));
+            m_filter->set(propertyName.constData(), sValue.toUtf8().constData());
+        }
+        return;
+    }
+    QStringList listKeys = keys.values();
+    m_filter->set(propertyName.constData(), listKeys.join(';').toUtf8().constData());
+}
+
 //#endif
 
 AnalyzeDelegate::AnalyzeDelegate(Mlt::Filter* filter)
@@ -29,8 +29,12 @@
 #include <QVariant>
 #include <QRectF>
 #include <MltFilter.h>
+#include <MltEvent.h>
 #include "qmlmetadata.h"
 #include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QAtomicInt>
 
 class AbstractJob;
 class AbstractTask;
@@ -96,6 +100,27 @@ public:
      */
     void refreshNoAnimation(const QVector<key_frame_item> &listParameter, bool bFromUndo = false) ;
 
+    /** Set many keyframes at once, without pushing an undo command.
+     *
+     * The animation of each property is rebuilt as one string from its
+     * current keyframes and listKeyFrame, and set in one call. The preview
+     * is refreshed once. Properties of type string are still set keyframe
+     * by keyframe.
+     * \param listKeyFrame the keyframes to add or update, frames are relative to the clip
+     */
+    void setKeyFrames(const QVector<key_frame_item> &listKeyFrame);
+
+    /** Remove many keyframes at once, without pushing an undo command.
+     *
+     * \param listKeyFrame the keyframes to remove, only the names of paraMap are used
+     */
+    void removeKeyFrames(const QVector<key_frame_item> &listKeyFrame);
+
+    /** Set whole animation strings, as read with Mlt::Filter::get().
+     * \param animations the animation string by property name
+     */
+    void refreshAnimations(const QMap<QString, QString> &animations);
+
     /** Get a string value by name of Mlt::Filter.
      *
      * \param name the property to get
@@ -319,6 +344,13 @@ public:
      */
     Q_INVOKABLE void cache_setKeyFrameParaRectValue(int frame, QString key, const QRectF& rect, double opacity = 1.0);
 
+    /** Set many keyframes as one undo step, through FilterController::setKeyFrames().
+     *
+     * \param keyFrames a list of maps, each with the "frame" number in the
+     * clip and the values by property name; a QRectF value is set with opacity 1
+     */
+    Q_INVOKABLE void setKeyFrameParaValues(const QVariantList& keyFrames);
+
     /** Remove the keyframe at the specified position.
      *
      * \param frame the frame number in the clip of the animation node to remove
@@ -576,6 +608,42 @@ private:
     //QVector<key_frame_item> m_cacheKeyFrameList; /** Cache data for keyframes*/
     bool m_bEnableAnimation;                /** a flag to indicate if the animation is enable state or not*/
     bool m_bAutoAddKeyFrame;                /** a flag to indicate if automatically add key frames or not*/
+
+    /** Get the sorted keyframe positions of a property, in parent clip frames.
+     *
+     * The positions are read from the animation once and kept until the
+     * property changes, so the keyframe queries above are binary searches
+     * instead of walks over the Mlt::Animation.
+     * \param name the property to get
+     * \return the keyframe positions, empty if the property has no animation
+     */
+    QVector<int> keyFrames(const QString& name);
+
+    /// Drop the keyframe positions of every property.
+    void invalidateKeyFrames() { m_keyFrameRevision.ref(); }
+    /// Drop the keyframe positions and tell the undo snapshots the animations changed.
+    /// Mlt::Animation edits fire no "property-changed", so every animation write calls this.
+    void animationsChanged();
+
+    static void onPropertyChanged(mlt_properties owner, QmlFilter* self, const char* name);
+    /// Drop the cached frames of the timeline clips this filter is attached to.
+    void invalidateFrameCache();
+
+    // 批量增删关键帧的实现，见 setKeyFrames()和 removeKeyFrames()
+    void applyKeyFrames(const QVector<key_frame_item> &listSet, const QVector<key_frame_item> &listRemove);
+    // 重新生成属性 name的动画字符串并一次设置，frames为父 producer中的帧
+    void writeAnimation(const QString &name, const QString &paraType,
+                        const QMap<int, QString> &setValues, const QSet<int> &removeFrames);
+
+    struct KeyFrameIndex {
+        KeyFrameIndex() : revision(-1) {}
+        int revision;           /** m_keyFrameRevision when frames was read*/
+        QVector<int> frames;
+    };
+    QHash<QString, KeyFrameIndex> m_keyFrameIndex;  /** keyframe positions by property name*/
+    QSet<QByteArray> m_keyFrameProperties;          /** the keyframe properties of the metadata, never changed after construction*/
+    QAtomicInt m_keyFrameRevision;                  /** bumped on every change to a keyframe property, also from the render thread*/
+    Mlt::Event* m_propertyChanged;                  /** the "property-changed" listener on m_filter*/
 };
 
 class AnalyzeDelegate : public QObject
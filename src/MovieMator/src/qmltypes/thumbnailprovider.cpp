@@ -19,59 +19,157 @@
 #include "thumbnailprovider.h"
 #include <QQuickImageProvider>
 #include <QCryptographicHash>
+#include <QRunnable>
+#include <QMap>
+#include <QPair>
 #include "mltcontroller.h"
 //#include "models/playlistmodel.h"
 #include "database.h"
 
 #include <Logger.h>
 
+// Producers kept open for the next requests of their resources.
+static const int kMaxIdleProducers = 6;
+
+struct ThumbnailJob
+{
+    QString key;            // of the job, the cache key and the size
+    QString cacheKey;
+    QString resourceKey;
+    QString service;
+    QString resource;
+    int frameNumber;
+    QSize size;
+    QList<ThumbnailResponse*> responses;
+};
+
+class ThumbnailTask : public QRunnable
+{
+public:
+    ThumbnailTask(ThumbnailProvider* provider, const QString& resourceKey)
+        : m_provider(provider)
+        , m_resourceKey(resourceKey)
+    {}
+
+    void run()
+    {
+        m_provider->run(m_resourceKey);
+    }
+
+private:
+    ThumbnailProvider* m_provider;
+    QString m_resourceKey;
+};
+
+ThumbnailResponse::ThumbnailResponse(ThumbnailProvider* provider, const QString& jobKey)
+    : QQuickImageResponse()
+    , m_provider(provider)
+    , m_jobKey(jobKey)
+{
+}
+
+ThumbnailResponse::~ThumbnailResponse()
+{
+    ThumbnailProvider* provider = m_provider.loadAcquire();
+    if (provider)
+        provider->detach(this);
+}
+
+QQuickTextureFactory* ThumbnailResponse::textureFactory() const
+{
+    return QQuickTextureFactory::textureFactoryForImage(m_image);
+}
+
+void ThumbnailResponse::cancel()
+{
+    ThumbnailProvider* provider = m_provider.loadAcquire();
+    if (provider)
+        provider->detach(this);
+}
+
+void ThumbnailResponse::finish(const QImage& image)
+{
+    m_image = image;
+    // The loader connects to finished() after the response is returned, so
+    // always emit it from this object's event loop.
+    QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+    // Last, since the destructor no longer waits for the lock after this.
+    m_provider.storeRelease(nullptr);
+}
+
 ThumbnailProvider::ThumbnailProvider()
-    : QQuickImageProvider(QQmlImageProviderBase::Image, QQmlImageProviderBase::ForceAsynchronousImageLoading)
+    : QQuickAsyncImageProvider()
     , m_profile("atsc_720p_60")
 {
+    m_pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount() / 2, 3));
 }
 
-QImage ThumbnailProvider::requestImage(const QString &id, QSize *size, const QSize &requestedSize)
+ThumbnailProvider::~ThumbnailProvider()
 {
-    Q_ASSERT(size);
-
-    QImage result;
+    m_pool.clear();
+    m_pool.waitForDone();
+    QMutexLocker locker(&m_mutex);
+    foreach (ThumbnailJob* job, m_jobs) {
+        foreach (ThumbnailResponse* response, job->responses)
+            response->finish(QImage());
+        delete job;
+    }
+    m_jobs.clear();
+    m_queues.clear();
+    qDeleteAll(m_producers);
+    m_producers.clear();
+}
 
+QQuickImageResponse* ThumbnailProvider::requestImageResponse(const QString &id, const QSize &requestedSize)
+{
     // id is [hash]/mlt_service/resource#frameNumber
     int index = id.lastIndexOf('#');
+    if (index == -1) {
+        ThumbnailResponse* response = new ThumbnailResponse(this, QString());
+        response->finish(QImage());
+        return response;
+    }
 
-    if (index != -1) {
-        QString hash = id.section('/', 0, 0);
-        QString service = id.section('/', 1, 1);
-        QString resource = id.section('/', 2);
-        int frameNumber = id.mid(index + 1).toInt();
-        Mlt::Properties properties;
-        Q_ASSERT(properties.is_valid());
-
-        // Scale the frameNumber to ThumbnailProvider profile's fps.
-        frameNumber = qRound(frameNumber / MLT.profile().fps() * m_profile.fps());
-
-        resource = resource.left(resource.lastIndexOf('#'));
-        properties.set("_profile", m_profile.get_profile(), 0);
-
-        QString key = cacheKey(properties, service, resource, hash, frameNumber);
-        result = DB.getThumbnail(key);
-        if (result.isNull()) {
-            if (service == "avformat-novalidate")
-                service = "avformat";
-            else if (service.startsWith("xml"))
-                service = "xml-nogl";
-            Mlt::Producer producer(m_profile, service.toUtf8().constData(), resource.toUtf8().constData());
-            if (producer.is_valid()) {
-
-                result = makeThumbnail(producer, frameNumber, requestedSize);
-                DB.putThumbnail(key, result);
-            }
+    QString hash = id.section('/', 0, 0);
+    QString service = id.section('/', 1, 1);
+    QString resource = id.section('/', 2);
+    int frameNumber = id.mid(index + 1).toInt();
+    Mlt::Properties properties;
+    Q_ASSERT(properties.is_valid());
+
+    // Scale the frameNumber to ThumbnailProvider profile's fps.
+    frameNumber = qRound(frameNumber / MLT.profile().fps() * m_profile.fps());
+
+    resource = resource.left(resource.lastIndexOf('#'));
+    properties.set("_profile", m_profile.get_profile(), 0);
+
+    QSize size(80 * 2, 45 * 2);//PlaylistModel::THUMBNAIL_WIDTH * 2;
+    if (!requestedSize.isEmpty())
+        size = requestedSize;
+    QString key = cacheKey(properties, service, resource, hash, frameNumber);
+    QString jobKey = QString("%1 %2x%3").arg(key).arg(size.width()).arg(size.height());
+
+    ThumbnailResponse* response = new ThumbnailResponse(this, jobKey);
+    QMutexLocker locker(&m_mutex);
+    ThumbnailJob* job = m_jobs.value(jobKey);
+    if (!job) {
+        job = new ThumbnailJob;
+        job->key = jobKey;
+        job->cacheKey = key;
+        job->resourceKey = service + '/' + resource;
+        job->service = service;
+        job->resource = resource;
+        job->frameNumber = frameNumber;
+        job->size = size;
+        m_jobs.insert(jobKey, job);
+        m_queues[job->resourceKey] << job;
+        if (!m_scheduled.contains(job->resourceKey)) {
+            m_scheduled.insert(job->resourceKey);
+            m_pool.start(new ThumbnailTask(this, job->resourceKey));
         }
-        if (size)
-            *size = result.size();
     }
-    return result;
+    job->responses << response;
+    return response;
 }
 
 QString ThumbnailProvider::cacheKey(Mlt::Properties& properties, const QString& service,
@@ -96,23 +194,141 @@ QString ThumbnailProvider::cacheKey(Mlt::Properties& properties, const QString&
     return key;
 }
 
-QImage ThumbnailProvider::makeThumbnail(Mlt::Producer &producer, int frameNumber, const QSize& requestedSize)
+void ThumbnailProvider::detach(ThumbnailResponse* response)
 {
-    Q_ASSERT(producer.is_valid());
+    QMutexLocker locker(&m_mutex);
+    if (!response->m_provider.loadAcquire())
+        return;
+    response->m_provider.storeRelease(nullptr);
+    ThumbnailJob* job = m_jobs.value(response->m_jobKey);
+    if (job)
+        job->responses.removeAll(response);
+}
 
-    Mlt::Filter scaler(m_profile, "swscale");
-    Mlt::Filter padder(m_profile, "resize");
-    Mlt::Filter converter(m_profile, "avcolor_space");
-    int height = 45 * 2;//PlaylistModel::THUMBNAIL_HEIGHT * 2;
-    int width  = 80 * 2;//PlaylistModel::THUMBNAIL_WIDTH * 2;
+// Called with the mutex locked.
+void ThumbnailProvider::finish(ThumbnailJob* job, const QImage& image)
+{
+    foreach (ThumbnailResponse* response, job->responses)
+        response->finish(image);
+    m_jobs.remove(job->key);
+    delete job;
+}
 
-    if (!requestedSize.isEmpty()) {
-        width = requestedSize.width();
-        height = requestedSize.height();
+bool ThumbnailProvider::isWanted(const QList<ThumbnailJob*>& jobs)
+{
+    QMutexLocker locker(&m_mutex);
+    foreach (ThumbnailJob* job, jobs) {
+        if (!job->responses.isEmpty())
+            return true;
     }
+    return false;
+}
 
-    producer.attach(scaler);
-    producer.attach(padder);
-    producer.attach(converter);
-    return MLT.image(producer, frameNumber, width, height);
+void ThumbnailProvider::run(const QString& resourceKey)
+{
+    while (true) {
+        // Take everything queued for the resource, dropping what is no longer shown.
+        QList<ThumbnailJob*> jobs;
+        m_mutex.lock();
+        foreach (ThumbnailJob* job, m_queues.take(resourceKey)) {
+            if (job->responses.isEmpty()) {
+                m_jobs.remove(job->key);
+                delete job;
+            } else {
+                jobs << job;
+            }
+        }
+        if (jobs.isEmpty()) {
+            m_scheduled.remove(resourceKey);
+            m_mutex.unlock();
+            return;
+        }
+        m_mutex.unlock();
+
+        QString service = jobs.first()->service;
+        QString resource = jobs.first()->resource;
+        QStringList keys;
+        foreach (ThumbnailJob* job, jobs)
+            keys << job->cacheKey;
+        QHash<QString, QImage> cached = DB.getThumbnails(keys);
+        QMap<QPair<int, int>, QList<ThumbnailJob*> > bySize;
+        m_mutex.lock();
+        foreach (ThumbnailJob* job, jobs) {
+            if (cached.contains(job->cacheKey))
+                finish(job, cached.value(job->cacheKey));
+            else
+                bySize[qMakePair(job->size.width(), job->size.height())] << job;
+        }
+        m_mutex.unlock();
+        if (bySize.isEmpty())
+            continue;
+
+        Mlt::Producer* producer = takeProducer(resourceKey, service, resource);
+        foreach (const QPair<int, int>& size, bySize.keys()) {
+            QList<ThumbnailJob*> remaining = bySize.value(size);
+            QList<int> frames;
+            foreach (ThumbnailJob* job, remaining)
+                frames << job->frameNumber;
+            QHash<QString, QImage> made;
+            if (producer && isWanted(remaining)) {
+                MLT.images(*producer, frames, size.first, size.second, [&](int frameNumber, const QImage& image) {
+                    QMutexLocker locker(&m_mutex);
+                    for (int i = remaining.size() - 1; i >= 0; --i) {
+                        ThumbnailJob* job = remaining[i];
+                        if (job->frameNumber == frameNumber) {
+                            made.insert(job->cacheKey, image);
+                            finish(job, image);
+                            remaining.removeAt(i);
+                        }
+                    }
+                    // Stop once every delegate still waiting has gone.
+                    foreach (ThumbnailJob* job, remaining) {
+                        if (!job->responses.isEmpty())
+                            return true;
+                    }
+                    return false;
+                });
+            }
+            if (!made.isEmpty())
+                DB.putThumbnails(made);
+            m_mutex.lock();
+            foreach (ThumbnailJob* job, remaining)
+                finish(job, QImage());
+            m_mutex.unlock();
+        }
+        if (producer)
+            returnProducer(resourceKey, producer);
+    }
+}
+
+Mlt::Producer* ThumbnailProvider::takeProducer(const QString& resourceKey, const QString& service, const QString& resource)
+{
+    m_mutex.lock();
+    Mlt::Producer* producer = m_producers.take(resourceKey);
+    m_producerOrder.removeAll(resourceKey);
+    m_mutex.unlock();
+    if (!producer) {
+        producer = Mlt::Controller::thumbnailProducer(m_profile, service, resource.toUtf8().constData());
+        if (!producer->is_valid()) {
+            delete producer;
+            producer = nullptr;
+        }
+    }
+    return producer;
+}
+
+void ThumbnailProvider::returnProducer(const QString& resourceKey, Mlt::Producer* producer)
+{
+    QList<Mlt::Producer*> unused;
+    m_mutex.lock();
+    if (m_producers.contains(resourceKey)) {
+        unused << producer;
+    } else {
+        m_producers.insert(resourceKey, producer);
+        m_producerOrder << resourceKey;
+        while (m_producerOrder.size() > kMaxIdleProducers)
+            unused << m_producers.take(m_producerOrder.takeFirst());
+    }
+    m_mutex.unlock();
+    qDeleteAll(unused);
 }
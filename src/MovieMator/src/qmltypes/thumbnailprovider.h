@@ -20,20 +20,80 @@
 #define THUMBNAILPROVIDER_H
 
 #include <QQuickImageProvider>
+#include <QThreadPool>
+#include <QMutex>
+#include <QAtomicPointer>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QStringList>
 #include <MltProducer.h>
 #include <MltProfile.h>
 
-class ThumbnailProvider : public QQuickImageProvider
+class ThumbnailProvider;
+struct ThumbnailJob;
+
+class ThumbnailResponse : public QQuickImageResponse
+{
+    Q_OBJECT
+public:
+    ThumbnailResponse(ThumbnailProvider* provider, const QString& jobKey);
+    ~ThumbnailResponse();
+    QQuickTextureFactory* textureFactory() const;
+    void cancel();
+
+private:
+    friend class ThumbnailProvider;
+    // Called with the provider's mutex locked.
+    void finish(const QImage& image);
+
+    // Cleared once finished; read without the lock by the destructor.
+    QAtomicPointer<ThumbnailProvider> m_provider;
+    QString m_jobKey;
+    QImage m_image;
+};
+
+/*!
+  \class ThumbnailProvider
+  \brief Asynchronous image provider of clip thumbnails for QML.
+
+  Requests are keyed like the thumbnail database. A request for a key that
+  is already pending joins it instead of decoding again, and a pending
+  request whose delegates have all gone is dropped before it is decoded.
+  Work is done on a small pool, one task per resource at a time, which
+  decodes all frames queued for that resource in a single pass with a
+  producer kept from earlier requests.
+
+  \threadsafe
+*/
+class ThumbnailProvider : public QQuickAsyncImageProvider
 {
 public:
     explicit ThumbnailProvider();
-    QImage requestImage(const QString &id, QSize *size, const QSize &requestedSize);
+    ~ThumbnailProvider();
+    QQuickImageResponse* requestImageResponse(const QString &id, const QSize &requestedSize);
 
 private:
+    friend class ThumbnailResponse;
+    friend class ThumbnailTask;
+
     QString cacheKey(Mlt::Properties& properties, const QString& service,
                      const QString& resource, const QString& hash, int frameNumber);
-    QImage makeThumbnail(Mlt::Producer&, int frameNumber, const QSize& requestedSize);
+    void detach(ThumbnailResponse* response);
+    void run(const QString& resourceKey);
+    void finish(ThumbnailJob* job, const QImage& image);
+    bool isWanted(const QList<ThumbnailJob*>& jobs);
+    Mlt::Producer* takeProducer(const QString& resourceKey, const QString& service, const QString& resource);
+    void returnProducer(const QString& resourceKey, Mlt::Producer* producer);
+
     Mlt::Profile m_profile;
+    QThreadPool m_pool;
+    QMutex m_mutex;     // guards the members below
+    QHash<QString, ThumbnailJob*> m_jobs;               // pending, by job key
+    QHash<QString, QList<ThumbnailJob*> > m_queues;     // not started, by resource
+    QSet<QString> m_scheduled;                          // resources with a task
+    QHash<QString, Mlt::Producer*> m_producers;         // idle, by resource
+    QStringList m_producerOrder;                        // least recently used first
 };
 
 #endif // THUMBNAILPROVIDER_H
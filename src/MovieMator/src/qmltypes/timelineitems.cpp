@@ -17,8 +17,12 @@
 
 #include "timelineitems.h"
 #include "mltcontroller.h"
+#include "models/audiopeaks.h"
 
 #include <QQuickPaintedItem>
+#include <QSGGeometryNode>
+#include <QSGFlatColorMaterial>
+#include <QtMath>
 #include <QPainter>
 #include <QPalette>
 #include <QPainterPath>
@@ -113,71 +117,220 @@ void TimelineTriangle::paint(QPainter *painter)
     painter->fillPath(path, Qt::black);
 }
 
-class TimelineWaveform : public QQuickPaintedItem
+// Width in pixels of the waveform tiles; only tiles whose peaks changed are rebuilt.
+static const int kWaveformTileWidth = 256;
+
+/*!
+  \class TimelineWaveform
+  \brief Draws a clip's AudioPeaks as scene graph geometry.
+
+  levels holds an AudioPeaksPtr; inPoint and outPoint are the frames of the
+  media at the item's left and right edges. The pyramid level is chosen so
+  that there is about one bucket per pixel, and the item is split into tiles
+  that keep their geometry until the zoom, size, color or their part of the
+  peaks changes. Scrolling moves the item without touching the geometry.
+*/
+class TimelineWaveform : public QQuickItem
 {
     Q_OBJECT
-    Q_PROPERTY(QVariant levels MEMBER m_audioLevels NOTIFY propertyChanged)
+    Q_PROPERTY(QVariant levels READ levels WRITE setLevels NOTIFY propertyChanged)
     Q_PROPERTY(QColor fillColor MEMBER m_color NOTIFY propertyChanged)
     Q_PROPERTY(int inPoint MEMBER m_inPoint NOTIFY inPointChanged)
     Q_PROPERTY(int outPoint MEMBER m_outPoint NOTIFY outPointChanged)
 
-
 public:
     TimelineWaveform()
+        : m_inPoint(0)
+        , m_outPoint(0)
     {
-        setMipmap(true);
-        setAntialiasing(QPainter::Antialiasing);
+        setFlag(ItemHasContents, true);
         connect(this, SIGNAL(propertyChanged()), this, SLOT(update()));
+        connect(this, SIGNAL(inPointChanged()), this, SLOT(update()));
+        connect(this, SIGNAL(outPointChanged()), this, SLOT(update()));
     }
 
-    void paint(QPainter *painter)
+    QVariant levels() const
     {
-        Q_ASSERT(painter);
-        QVariantList levelsData = m_audioLevels.toList();
+        return QVariant::fromValue(m_peaks);
+    }
+
+    void setLevels(const QVariant& levels)
+    {
+        AudioPeaksPtr peaks = levels.value<AudioPeaksPtr>();
+        if (peaks != m_peaks) {
+            m_peaks = peaks;
+            emit propertyChanged();
+        }
+    }
+
+signals:
+    void propertyChanged();
+    void inPointChanged();
+    void outPointChanged();
 
-        if (levelsData.isEmpty())
+protected:
+    void geometryChanged(const QRectF& newGeometry, const QRectF& oldGeometry)
+    {
+        QQuickItem::geometryChanged(newGeometry, oldGeometry);
+        if (newGeometry.size() != oldGeometry.size())
+            update();
+    }
+
+    QSGNode* updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData*)
+    {
+        WaveformNode* root = static_cast<WaveformNode*>(oldNode);
+        const double fps = MLT.profile().fps();
+        const int w = qCeil(width());
+        if (!m_peaks || m_peaks->isEmpty() || w <= 0 || height() <= 0 || m_outPoint <= m_inPoint || fps <= 0.0) {
+            delete root;
+            return nullptr;
+        }
+        if (!root)
+            root = new WaveformNode;
+
+        // About one bucket per pixel at the coarsest level that has it.
+        const double secondsPerPixel = (m_outPoint - m_inPoint) / fps / width();
+        const int level = m_peaks->levelForRate(1.0 / secondsPerPixel);
+        const double bucketsPerPixel = secondsPerPixel * m_peaks->rate(level);
+        const double firstBucket = m_inPoint / fps * m_peaks->rate(level);
+
+        const int tileCount = (w + kWaveformTileWidth - 1) / kWaveformTileWidth;
+        while (root->tiles.size() > tileCount)
+            delete root->tiles.takeLast();
+        while (root->tiles.size() < tileCount) {
+            WaveformTile* tile = new WaveformTile;
+            root->appendChildNode(tile);
+            root->tiles.append(tile);
+        }
+
+        for (int i = 0; i < tileCount; ++i) {
+            WaveformTile* tile = root->tiles.at(i);
+            int x = i * kWaveformTileWidth;
+            WaveformTile::Key key;
+            key.id = m_peaks->id();
+            key.level = level;
+            key.firstBucket = firstBucket + x * bucketsPerPixel;
+            key.bucketsPerPixel = bucketsPerPixel;
+            key.width = qMin(kWaveformTileWidth, w - x);
+            key.height = height();
+            // Tiles past the generated part change as more peaks arrive.
+            key.available = qMin(m_peaks->count(level), qCeil(key.firstBucket + key.width * bucketsPerPixel));
+            tile->setColors(m_color, m_color.darker());
+            if (!(key == tile->key)) {
+                tile->key = key;
+                tile->build(*m_peaks, x);
+            }
+        }
+        return root;
+    }
+
+private:
+    class WaveformTile : public QSGNode
+    {
+    public:
+        struct Key {
+            Key() : id(0), level(-1), firstBucket(0), bucketsPerPixel(0), width(0), height(0), available(0) {}
+            bool operator==(const Key& o) const
+            {
+                return id == o.id && level == o.level && firstBucket == o.firstBucket
+                    && bucketsPerPixel == o.bucketsPerPixel && width == o.width
+                    && height == o.height && available == o.available;
+            }
+            int id;
+            int level;
+            double firstBucket;
+            double bucketsPerPixel;
+            int width;
+            qreal height;
+            int available;
+        };
+
+        WaveformTile()
         {
-            return;
+            m_peak = newStrip();
+            m_rms = newStrip();
+            appendChildNode(m_peak);
+            appendChildNode(m_rms);
         }
 
-        // In and out points are # frames at current fps,
-        // but audio levels are created at 25 fps.
-        // Scale in and out point to 25 fps.
-        const int nInPoint              = qRound(m_inPoint / MLT.profile().fps() * 25.0);
-        const int nOutPoint             = qRound(m_outPoint / MLT.profile().fps() * 25.0);
-        const qreal indicesPrPixel      = qreal(nOutPoint - nInPoint) / width();
+        void setColors(const QColor& peak, const QColor& rms)
+        {
+            setColor(m_peak, peak);
+            setColor(m_rms, rms);
+        }
 
-        QPainterPath path;
-        path.moveTo(-1, height());
-        int i = 0;
-        for (; i < width(); ++i)
+        // Fill the peak and RMS strips of the columns starting at x.
+        void build(const AudioPeaks& peaks, int x)
         {
-            int idx = nInPoint + int(i * indicesPrPixel);
-            if (idx + 1 >= levelsData.length())
-            {
-                break;
+            const int columns = key.width;
+            const int channels = peaks.channels();
+            const AudioPeaks::Peak* data = peaks.data(key.level);
+            QSGGeometry* peakGeometry = m_peak->geometry();
+            QSGGeometry* rmsGeometry = m_rms->geometry();
+            peakGeometry->allocate(2 * (columns + 1));
+            rmsGeometry->allocate(2 * (columns + 1));
+            QSGGeometry::Point2D* pv = peakGeometry->vertexDataAsPoint2D();
+            QSGGeometry::Point2D* rv = rmsGeometry->vertexDataAsPoint2D();
+            const float h = float(key.height);
+            for (int i = 0; i <= columns; ++i) {
+                int first = qFloor(key.firstBucket + i * key.bucketsPerPixel);
+                int last = qMax(first + 1, qFloor(key.firstBucket + (i + 1) * key.bucketsPerPixel));
+                first = qMax(0, first);
+                last = qMin(last, key.available);
+                int peak = 0;
+                int rms = 0;
+                for (int b = first; b < last; ++b) {
+                    const AudioPeaks::Peak* p = data + b * channels;
+                    for (int c = 0; c < channels; ++c) {
+                        peak = qMax(peak, qMax(-int(p[c].min), int(p[c].max)));
+                        rms = qMax(rms, int(p[c].rms));
+                    }
+                }
+                float px = float(x + i);
+                pv[2 * i].set(px, h);
+                pv[2 * i + 1].set(px, h - h * qMin(peak, 128) / 128.0f);
+                rv[2 * i].set(px, h);
+                rv[2 * i + 1].set(px, h - h * rms / 255.0f);
             }
+            m_peak->markDirty(QSGNode::DirtyGeometry);
+            m_rms->markDirty(QSGNode::DirtyGeometry);
+        }
 
-            qreal level = qMax(levelsData.at(idx).toReal(), levelsData.at(idx + 1).toReal()) / 256;
-            path.lineTo(i, height() - level * height());
+        Key key;
+
+    private:
+        static QSGGeometryNode* newStrip()
+        {
+            QSGGeometryNode* node = new QSGGeometryNode;
+            QSGGeometry* geometry = new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), 0);
+            geometry->setDrawingMode(GL_TRIANGLE_STRIP);
+            node->setGeometry(geometry);
+            node->setFlag(QSGNode::OwnsGeometry);
+            node->setMaterial(new QSGFlatColorMaterial);
+            node->setFlag(QSGNode::OwnsMaterial);
+            return node;
         }
-        path.lineTo(i, height());
 
-//        painter->fillPath(path, m_color.lighter());
-        painter->fillPath(path, m_color);
+        static void setColor(QSGGeometryNode* node, const QColor& color)
+        {
+            QSGFlatColorMaterial* material = static_cast<QSGFlatColorMaterial*>(node->material());
+            if (material->color() != color) {
+                material->setColor(color);
+                node->markDirty(QSGNode::DirtyMaterial);
+            }
+        }
 
-        QPen pen(painter->pen());
-        pen.setColor(m_color.darker());
-        painter->strokePath(path, pen);
-    }
+        QSGGeometryNode* m_peak;
+        QSGGeometryNode* m_rms;
+    };
 
-signals:
-    void propertyChanged();
-    void inPointChanged();
-    void outPointChanged();
+    class WaveformNode : public QSGNode
+    {
+    public:
+        QList<WaveformTile*> tiles;
+    };
 
-private:
-    QVariant m_audioLevels;
+    AudioPeaksPtr m_peaks;
     int m_inPoint;
     int m_outPoint;
     QColor m_color;
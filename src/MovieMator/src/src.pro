@@ -39,6 +39,7 @@ SOURCES += main.cpp\
     docks/encodedock.cpp \
     dialogs/addencodepresetdialog.cpp \
     jobqueue.cpp \
+    timelinerendercache.cpp \
     docks/jobsdock.cpp \
     dialogs/textviewerdialog.cpp \
     dialogs/durationdialog.cpp \
@@ -77,7 +78,11 @@ SOURCES += main.cpp\
     widgets/scopes/videowaveformscopewidget.cpp \
     widgets/audioscale.cpp \
     commands/undohelper.cpp \
+    commands/undoxml.cpp \
+    commands/editbenchmark.cpp \
     models/audiolevelstask.cpp \
+    models/audiopeaks.cpp \
+    models/trackclipcache.cpp \
     mltxmlchecker.cpp \
     widgets/avfoundationproducerwidget.cpp \
     widgets/gdigrabwidget.cpp \
@@ -86,6 +91,9 @@ SOURCES += main.cpp\
     widgets/filterwidget.cpp \
     jobs/ffprobejob.cpp \
     jobs/ffmpegjob.cpp \
+    jobs/proxyjob.cpp \
+    proxymanager.cpp \
+    mediaimporter.cpp \
     dialogs/unlinkedfilesdialog.cpp \
     widgets/textmanagerwidget.cpp \
     qmltypes/qmltextmetadata.cpp \
@@ -146,6 +154,7 @@ HEADERS  += mainwindow.h \
     docks/encodedock.h \
     dialogs/addencodepresetdialog.h \
     jobqueue.h \
+    timelinerendercache.h \
     docks/jobsdock.h \
     dialogs/textviewerdialog.h \
     dialogs/durationdialog.h \
@@ -185,7 +194,11 @@ HEADERS  += mainwindow.h \
     dataqueue.h \
     widgets/audioscale.h \
     commands/undohelper.h \
+    commands/undoxml.h \
+    commands/editbenchmark.h \
     models/audiolevelstask.h \
+    models/audiopeaks.h \
+    models/trackclipcache.h \
     mltxmlchecker.h \
     widgets/avfoundationproducerwidget.h \
     widgets/gdigrabwidget.h \
@@ -194,6 +207,9 @@ HEADERS  += mainwindow.h \
     widgets/filterwidget.h \
     jobs/ffprobejob.h \
     jobs/ffmpegjob.h \
+    jobs/proxyjob.h \
+    proxymanager.h \
+    mediaimporter.h \
     dialogs/unlinkedfilesdialog.h \
     widgets/textmanagerwidget.h \
     qmltypes/qmltextmetadata.h \
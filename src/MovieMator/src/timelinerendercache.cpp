@@ -0,0 +1,518 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "timelinerendercache.h"
+#include "models/multitrackmodel.h"
+#include "mltcontroller.h"
+#include "settings.h"
+#include <Logger.h>
+#include <Mlt.h>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QRunnable>
+#include <QThread>
+#include <QFileInfo>
+#include <QDir>
+#include <QFile>
+
+// Length of a render chunk in seconds.
+static const int CHUNK_SECONDS = 5;
+// Automatic mode renders chunks whose cost (see rehash()) reaches this:
+// several stacked layers or transitions with a handful of filters each,
+// not a clip or two with ordinary color and text filters.
+static const int HEAVY_COST = 8;
+// Renders beyond this are deleted, oldest first.
+static const qint64 MAX_CACHE_BYTES = qint64(4096) * 1024 * 1024;
+static const int REHASH_DELAY_MS = 300;
+
+static const char* kCacheProperty = "_moviemator:render-cache";
+static const char* kSegmentFrameProperty = "_moviemator:render-cache-frame";
+
+// The frame properties below are read by mlt_frame_get_image() once the
+// get_image stack is empty.
+static int segmentGetImage(mlt_frame frame, uint8_t** image, mlt_image_format* format,
+                           int* width, int* height, int writable)
+{
+    mlt_properties properties = MLT_FRAME_PROPERTIES(frame);
+    mlt_frame segmentFrame = static_cast<mlt_frame>(mlt_properties_get_data(properties, kSegmentFrameProperty, nullptr));
+    int error = mlt_frame_get_image(segmentFrame, image, format, width, height, writable);
+    if (!error) {
+        // The buffer is owned by the segment frame, which lives as long as this one.
+        mlt_frame_set_image(frame, *image, 0, nullptr);
+        mlt_properties_set_int(properties, "format", *format);
+        mlt_properties_set_int(properties, "width", *width);
+        mlt_properties_set_int(properties, "height", *height);
+    }
+    return error;
+}
+
+static mlt_frame renderCacheProcess(mlt_filter filter, mlt_frame frame)
+{
+    TimelineRenderCache* cache = static_cast<TimelineRenderCache*>(
+        mlt_properties_get_data(MLT_FILTER_PROPERTIES(filter), kCacheProperty, nullptr));
+    if (!cache)
+        return frame;
+    int offset = 0;
+    QSharedPointer<Mlt::Producer> segment = cache->segmentAt(int(mlt_frame_get_position(frame)), &offset);
+    if (segment) {
+        mlt_frame segmentFrame = nullptr;
+        segment->seek(offset);
+        if (!mlt_service_get_frame(segment->get_service(), &segmentFrame, 0) && segmentFrame) {
+            mlt_properties_set_data(MLT_FRAME_PROPERTIES(frame), kSegmentFrameProperty, segmentFrame, 0,
+                                    reinterpret_cast<mlt_destructor>(mlt_frame_close), nullptr);
+            // Pushed last, so it runs first and never pulls the tracks' images.
+            mlt_frame_push_get_image(frame, segmentGetImage);
+        }
+    }
+    return frame;
+}
+
+// Feed every public property into the hash. Underscore properties are
+// runtime state and meta.* is filled in lazily by the producers.
+static void addProperties(QCryptographicHash& hash, Mlt::Properties& properties)
+{
+    for (int i = 0; i < properties.count(); ++i) {
+        const char* name = properties.get_name(i);
+        const char* value = properties.get(i);
+        if (!name || !value || name[0] == '_' || !qstrncmp(name, "meta.", 5))
+            continue;
+        hash.addData(name);
+        hash.addData("=", 1);
+        hash.addData(value);
+        hash.addData("\n", 1);
+    }
+}
+
+static int addService(QCryptographicHash& hash, Mlt::Service& service)
+{
+    int filters = 0;
+    addProperties(hash, service);
+    for (int i = 0; i < service.filter_count(); ++i) {
+        QScopedPointer<Mlt::Filter> filter(service.filter(i));
+        if (filter && filter->is_valid() && !filter->get_int("_loader") && !filter->get_int("disable")) {
+            addProperties(hash, *filter);
+            ++filters;
+        }
+    }
+    return filters;
+}
+
+class RenderSegmentTask : public QRunnable
+{
+public:
+    RenderSegmentTask(TimelineRenderCache* cache, const QString& xml, int in, int out,
+                      const QByteArray& hash, const QString& path)
+        : QRunnable()
+        , m_cache(cache)
+        , m_xml(xml)
+        , m_in(in)
+        , m_out(out)
+        , m_hash(hash)
+        , m_path(path)
+    {
+        Mlt::Profile& profile = MLT.profile();
+        m_profile.set_width(profile.width());
+        m_profile.set_height(profile.height());
+        m_profile.set_sample_aspect(profile.sample_aspect_num(), profile.sample_aspect_den());
+        m_profile.set_display_aspect(profile.display_aspect_num(), profile.display_aspect_den());
+        m_profile.set_frame_rate(profile.frame_rate_num(), profile.frame_rate_den());
+        m_profile.set_progressive(profile.progressive());
+        m_profile.set_colorspace(profile.colorspace());
+        m_profile.set_explicit(1);
+    }
+
+protected:
+    void run()
+    {
+        bool success = false;
+        if (m_cache->isWanted(m_hash)) {
+            QThread::currentThread()->setPriority(QThread::LowPriority);
+            success = render();
+        }
+        QMetaObject::invokeMethod(m_cache, "onSegmentRendered", Qt::QueuedConnection,
+                                  Q_ARG(QByteArray, m_hash), Q_ARG(bool, success));
+    }
+
+private:
+    bool render()
+    {
+        QString partPath = m_path + ".part";
+        Mlt::Producer producer(m_profile, "xml-string", m_xml.toUtf8().constData());
+        if (!producer.is_valid())
+            return false;
+        QScopedPointer<Mlt::Producer> cut(producer.cut(m_in, m_out));
+        // An intra-only intermediate: every frame decodes on its own when seeking.
+        Mlt::Consumer consumer(m_profile, "avformat", partPath.toUtf8().constData());
+        consumer.set("f", "mov");
+        consumer.set("vcodec", "mjpeg");
+        consumer.set("qscale", 1);
+        consumer.set("pix_fmt", "yuvj422p");
+        consumer.set("an", 1);
+        consumer.set("real_time", 0);
+        consumer.set("terminate_on_pause", 1);
+        consumer.connect(*cut);
+        consumer.start();
+        bool canceled = false;
+        while (!consumer.is_stopped()) {
+            if (!m_cache->isWanted(m_hash)) {
+                consumer.stop();
+                canceled = true;
+                break;
+            }
+            QThread::msleep(100);
+        }
+        if (canceled || !QFile::exists(partPath)) {
+            QFile::remove(partPath);
+            LOG_DEBUG() << "render preview failed or canceled" << m_in << m_out;
+            return false;
+        }
+        QFile::remove(m_path);
+        return QFile::rename(partPath, m_path);
+    }
+
+    TimelineRenderCache* m_cache;
+    QString m_xml;
+    int m_in;
+    int m_out;
+    QByteArray m_hash;
+    QString m_path;
+    Mlt::Profile m_profile;
+};
+
+TimelineRenderCache::TimelineRenderCache(MultitrackModel& model, QObject* parent)
+    : QObject(parent)
+    , m_model(model)
+    , m_tractor(nullptr)
+    , m_automatic(Settings.timelineRenderPreviewAuto())
+    , m_length(0)
+    , m_suspended(true)
+{
+    m_pool.setMaxThreadCount(1);
+    m_rehashTimer.setSingleShot(true);
+    m_rehashTimer.setInterval(REHASH_DELAY_MS);
+    connect(&m_rehashTimer, SIGNAL(timeout()), SLOT(rehash()));
+    QDir().mkpath(cacheDirectory());
+}
+
+TimelineRenderCache::~TimelineRenderCache()
+{
+    m_pool.clear();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_wanted.clear();
+    }
+    m_pool.waitForDone();
+    detach();
+}
+
+void TimelineRenderCache::setAutomatic(bool automatic)
+{
+    m_automatic = automatic;
+    invalidate();
+}
+
+void TimelineRenderCache::markRange(int in, int out)
+{
+    if (out < in)
+        return;
+    m_marks.append(qMakePair(in, out));
+    invalidate();
+}
+
+void TimelineRenderCache::clear()
+{
+    m_marks.clear();
+    QList<QByteArray> hashes = m_producers.keys();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_segments.clear();
+        m_wanted.clear();
+    }
+    m_producers.clear();
+    // A file still open in the consumer may fail to delete; prune() retries.
+    foreach (const QByteArray& hash, hashes)
+        QFile::remove(segmentPath(hash));
+    invalidate();
+}
+
+int TimelineRenderCache::readyCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    int count = 0;
+    foreach (const Segment& segment, m_segments) {
+        if (segment.producer)
+            ++count;
+    }
+    return count;
+}
+
+QSharedPointer<Mlt::Producer> TimelineRenderCache::segmentAt(int position, int* offset)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_suspended || m_length <= 0 || position < 0)
+        return QSharedPointer<Mlt::Producer>();
+    int chunk = position / m_length;
+    if (chunk >= m_segments.size())
+        return QSharedPointer<Mlt::Producer>();
+    *offset = position - chunk * m_length;
+    return m_segments.at(chunk).producer;
+}
+
+bool TimelineRenderCache::isWanted(const QByteArray& hash)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_wanted.contains(hash);
+}
+
+QString TimelineRenderCache::cacheDirectory()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("render");
+}
+
+void TimelineRenderCache::invalidate()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_suspended = true;
+    }
+    if (m_filter)
+        m_rehashTimer.start();
+}
+
+void TimelineRenderCache::reattach()
+{
+    Mlt::Tractor* tractor = m_model.tractor();
+    if (!tractor || !tractor->is_valid() || Settings.playerGPU()) {
+        detach();
+        return;
+    }
+    if (m_filter && m_tractor == tractor->get_tractor()) {
+        invalidate();
+        return;
+    }
+    detach();
+
+    // A bare filter whose process callback does the substitution.
+    mlt_filter filter = mlt_filter_new();
+    if (!filter)
+        return;
+    filter->process = renderCacheProcess;
+    m_filter.reset(new Mlt::Filter(filter));
+    mlt_filter_close(filter);
+    m_filter->set("_loader", 1);
+    m_filter->set(kCacheProperty, static_cast<void*>(this), 0);
+    tractor->attach(*m_filter);
+    m_tractor = tractor->get_tractor();
+    invalidate();
+}
+
+void TimelineRenderCache::detach()
+{
+    m_rehashTimer.stop();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_segments.clear();
+        m_wanted.clear();
+        m_suspended = true;
+    }
+    if (!m_filter)
+        return;
+    m_filter->set(kCacheProperty, static_cast<void*>(nullptr), 0);
+    Mlt::Tractor* tractor = m_model.tractor();
+    if (tractor && tractor->get_tractor() == m_tractor)
+        tractor->detach(*m_filter);
+    m_filter.reset();
+    m_tractor = nullptr;
+    m_marks.clear();
+}
+
+// Chunk hashes cover every track's clips (with their filters and position
+// within the chunk), the track and tractor properties and filters, the
+// tractor's compositing transitions and the profile. The cost of a chunk is
+// the number of extra video layers plus the filters and transitions on them.
+void TimelineRenderCache::rehash()
+{
+    Mlt::Tractor* tractor = m_model.tractor();
+    if (!m_filter || !tractor)
+        return;
+    int length = chunkLength();
+    int playtime = tractor->get_playtime();
+    int count = (playtime + length - 1) / length;
+
+    QCryptographicHash global(QCryptographicHash::Sha1);
+    Mlt::Profile& profile = MLT.profile();
+    global.addData(QString("%1x%2@%3/%4").arg(profile.width()).arg(profile.height())
+                   .arg(profile.frame_rate_num()).arg(profile.frame_rate_den()).toLatin1());
+    addService(global, *tractor);
+    QScopedPointer<Mlt::Service> service(tractor->producer());
+    while (service && service->is_valid()) {
+        if (service->type() == transition_type)
+            addProperties(global, *service);
+        service.reset(service->producer());
+    }
+
+    QVector<QByteArray> content(count);
+    QVector<int> layers(count, 0);
+    QVector<int> costs(count, 0);
+    const TrackList& tracks = m_model.trackList();
+    for (int t = 0; t < tracks.size(); ++t) {
+        QScopedPointer<Mlt::Producer> track(tractor->track(tracks[t].mlt_index));
+        if (!track || !track->is_valid())
+            continue;
+        addService(global, *track);
+        bool isVideo = tracks[t].type != AudioTrackType && !(track->get_int("hide") & 1);
+        Mlt::Playlist playlist(*track);
+        for (int i = 0; i < playlist.count(); ++i) {
+            if (playlist.is_blank(i))
+                continue;
+            QScopedPointer<Mlt::ClipInfo> info(playlist.clip_info(i));
+            if (!info || !info->cut)
+                continue;
+            Mlt::Producer clip(info->cut);
+            QCryptographicHash clipHash(QCryptographicHash::Sha1);
+            int filters = addService(clipHash, clip);
+            bool isTransition = m_model.isTransition(playlist, i);
+            if (isTransition) {
+                // A transition is a small tractor; its tracks and mix are nested.
+                clipHash.addData(MLT.XML(&clip).toUtf8());
+            } else if (clip.parent().is_valid()) {
+                filters += addService(clipHash, clip.parent());
+            }
+            QByteArray digest = clipHash.result();
+            int first = info->start / length;
+            int last = qMin(count - 1, (info->start + info->frame_count - 1) / length);
+            for (int c = first; c <= last; ++c) {
+                content[c].append(QString("%1:%2:").arg(t).arg(info->start - c * length).toLatin1());
+                content[c].append(digest);
+                if (isVideo) {
+                    ++layers[c];
+                    costs[c] += filters + (isTransition? 2 : 0);
+                }
+            }
+        }
+    }
+    QByteArray globalDigest = global.result();
+
+    QVector<Segment> segments(count);
+    QSet<QByteArray> wanted;
+    QString xml;
+    for (int c = 0; c < count; ++c) {
+        int in = c * length;
+        int out = qMin(in + length, playtime) - 1;
+        bool marked = false;
+        for (int m = 0; m < m_marks.size() && !marked; ++m)
+            marked = m_marks[m].first <= out && m_marks[m].second >= in;
+        int cost = costs[c] + qMax(0, layers[c] - 1);
+        if (!marked && !(m_automatic && cost >= HEAVY_COST))
+            continue;
+
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(globalDigest);
+        hash.addData(QByteArray::number(out - in));
+        hash.addData(content[c]);
+        QByteArray key = hash.result().toHex();
+        segments[c].hash = key;
+        wanted.insert(key);
+        segments[c].producer = openSegment(key);
+        if (!segments[c].producer && !m_pending.contains(key)) {
+            if (xml.isEmpty())
+                xml = MLT.XML(tractor);
+            m_pending.insert(key);
+            m_pool.start(new RenderSegmentTask(this, xml, in, out, key, segmentPath(key)));
+        }
+    }
+
+    // Drop producers for renders no longer in use.
+    QMutableHashIterator<QByteArray, QSharedPointer<Mlt::Producer> > i(m_producers);
+    while (i.hasNext()) {
+        i.next();
+        if (!wanted.contains(i.key()))
+            i.remove();
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_segments = segments;
+    m_wanted = wanted;
+    m_length = length;
+    m_suspended = false;
+}
+
+void TimelineRenderCache::onSegmentRendered(const QByteArray& hash, bool success)
+{
+    m_pending.remove(hash);
+    if (success) {
+        QSharedPointer<Mlt::Producer> producer = openSegment(hash);
+        if (producer) {
+            QMutexLocker locker(&m_mutex);
+            for (int c = 0; c < m_segments.size(); ++c) {
+                if (m_segments[c].hash == hash)
+                    m_segments[c].producer = producer;
+            }
+        }
+    } else {
+        QFile::remove(segmentPath(hash));
+    }
+    if (m_pending.isEmpty()) {
+        prune();
+        if (success)
+            emit showStatusMessage(tr("Render preview finished"));
+    }
+}
+
+int TimelineRenderCache::chunkLength() const
+{
+    return qMax(1, qRound(MLT.profile().fps() * CHUNK_SECONDS));
+}
+
+QSharedPointer<Mlt::Producer> TimelineRenderCache::openSegment(const QByteArray& hash)
+{
+    QSharedPointer<Mlt::Producer> producer = m_producers.value(hash);
+    if (producer)
+        return producer;
+    QString path = segmentPath(hash);
+    if (!QFile::exists(path))
+        return producer;
+    producer.reset(new Mlt::Producer(MLT.profile(), path.toUtf8().constData()));
+    if (!producer->is_valid()) {
+        LOG_WARNING() << "failed to open render preview" << path;
+        QFile::remove(path);
+        return QSharedPointer<Mlt::Producer>();
+    }
+    producer->set("audio_index", -1);
+    m_producers.insert(hash, producer);
+    return producer;
+}
+
+QString TimelineRenderCache::segmentPath(const QByteArray& hash) const
+{
+    return QDir(cacheDirectory()).filePath(QString::fromLatin1(hash) + ".mov");
+}
+
+// Keeps the newest renders within MAX_CACHE_BYTES, never those in use.
+void TimelineRenderCache::prune()
+{
+    QDir dir(cacheDirectory());
+    QFileInfoList files = dir.entryInfoList(QStringList() << "*.mov", QDir::Files, QDir::Time);
+    qint64 total = 0;
+    foreach (const QFileInfo& info, files) {
+        total += info.size();
+        if (total > MAX_CACHE_BYTES && !m_producers.contains(info.completeBaseName().toLatin1())) {
+            LOG_DEBUG() << "removing render preview" << info.fileName();
+            QFile::remove(info.filePath());
+        }
+    }
+}
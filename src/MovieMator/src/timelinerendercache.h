@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2016-2019 EffectMatrix Inc.
+ * Author: vgawen <gdb_1986@163.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TIMELINERENDERCACHE_H
+#define TIMELINERENDERCACHE_H
+
+#include <QObject>
+#include <QMutex>
+#include <QTimer>
+#include <QThreadPool>
+#include <QVector>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <QHash>
+#include <QSharedPointer>
+#include <QScopedPointer>
+#include <MltProducer.h>
+#include <MltFilter.h>
+
+class MultitrackModel;
+
+/*!
+  \class TimelineRenderCache
+  \brief Renders heavy timeline segments in the background and plays them back in place of the live composite.
+
+  The timeline is split into fixed-length chunks. A chunk is rendered when it
+  overlaps a marked range, or, in automatic mode, when its stacked clips,
+  filters and transitions exceed a cost threshold. Each chunk is identified by
+  a hash of everything that contributes to its picture, and the rendered file
+  is named after that hash, so an edit anywhere in the chunk simply changes the
+  hash and the old render stops being used.
+
+  Substitution is done by a hidden filter on the timeline tractor which, for
+  frames inside a ready chunk, returns the image of the rendered file instead
+  of pulling it through the tracks. Audio is always produced live. The filter
+  is marked like a loader filter, so it is neither saved nor listed.
+
+  \threadsafe segmentAt() is called from the consumer thread.
+*/
+class TimelineRenderCache : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TimelineRenderCache(MultitrackModel& model, QObject* parent = nullptr);
+    ~TimelineRenderCache();
+
+    bool isAutomatic() const { return m_automatic; }
+    void setAutomatic(bool automatic);
+
+    // Render the chunks overlapping [in, out] regardless of their cost.
+    void markRange(int in, int out);
+    // Forget marked ranges and delete the renders in use.
+    void clear();
+
+    int readyCount() const;
+    int pendingCount() const { return m_pending.size(); }
+
+    // Consumer thread: the rendered producer for a timeline position and the
+    // position within it, or null if that position is not rendered.
+    QSharedPointer<Mlt::Producer> segmentAt(int position, int* offset);
+    // Render worker: whether a render is still wanted.
+    bool isWanted(const QByteArray& hash);
+
+    static QString cacheDirectory();
+
+signals:
+    void showStatusMessage(QString);
+
+public slots:
+    // Something on the timeline changed. Substitution is suspended until
+    // the chunk hashes have been recomputed.
+    void invalidate();
+    // The model's tractor was created, loaded or closed.
+    void reattach();
+    void detach();
+
+private slots:
+    void rehash();
+    void onSegmentRendered(const QByteArray& hash, bool success);
+
+private:
+    struct Segment {
+        QByteArray hash;    // empty if the chunk is not wanted
+        QSharedPointer<Mlt::Producer> producer;
+    };
+
+    int chunkLength() const;
+    QSharedPointer<Mlt::Producer> openSegment(const QByteArray& hash);
+    QString segmentPath(const QByteArray& hash) const;
+    void prune();
+
+    MultitrackModel& m_model;
+    QScopedPointer<Mlt::Filter> m_filter;
+    void* m_tractor;
+    bool m_automatic;
+    QList< QPair<int, int> > m_marks;
+    QTimer m_rehashTimer;
+    QThreadPool m_pool;
+    QSet<QByteArray> m_pending;
+    QHash<QByteArray, QSharedPointer<Mlt::Producer> > m_producers;
+
+    mutable QMutex m_mutex;     // guards the members below
+    QVector<Segment> m_segments;
+    QSet<QByteArray> m_wanted;
+    int m_length;
+    bool m_suspended;
+};
+
+#endif // TIMELINERENDERCACHE_H